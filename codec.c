@@ -55,6 +55,7 @@
 //----------------------------------------------------------------------------
 
 static pthread_mutex_t CodecLockMutex;
+static pthread_cond_t CodecRenderCond;	///< a render outside the lock is done
 
 //----------------------------------------------------------------------------
 //	Video
@@ -69,6 +70,18 @@ struct _video_decoder_
 
     AVCodecContext *VideoCtx;		///< video codec context
     AVFrame *Frame;			///< decoded video frame
+
+    AVCodecContext *ParkedCtx;		///< closed, flushed context for reuse
+    VideoStreamInfo Info;		///< stream info of the opened context
+    int HaveInfo;			///< flag info is valid
+    int Reusable;			///< flag opened context can be parked
+    int Sw;				///< flag software decoder
+
+    int Reused;				///< number of reused contexts
+    int Reopened;			///< number of newly opened contexts
+
+    int Rendering;			///< frames rendered outside the lock
+    int Waiting;			///< close or flush wait for the render
 };
 
 //----------------------------------------------------------------------------
@@ -92,6 +105,45 @@ static enum AVPixelFormat Codec_get_format(AVCodecContext * video_ctx,
 	return Video_get_format(decoder->Render, video_ctx, fmt);
 }
 
+/**
+**	Render a decoded frame outside the codec lock.
+**
+**	Called with the codec lock held.  The context stays valid, close
+**	and flush wait until the render is done.
+**
+**	@param decoder	video decoder data
+**	@param frame	decoded frame, owned by the render
+*/
+static void CodecVideoRender(VideoDecoder * decoder, AVFrame * frame)
+{
+	AVCodecContext *video_ctx = decoder->VideoCtx;
+
+	decoder->Rendering++;
+	pthread_mutex_unlock(&CodecLockMutex);
+	VideoRenderFrame(decoder->Render, video_ctx, frame);
+	pthread_mutex_lock(&CodecLockMutex);
+	if (!--decoder->Rendering) {
+		pthread_cond_broadcast(&CodecRenderCond);
+	}
+}
+
+/**
+**	Wait until no frame is rendered outside the codec lock.
+**
+**	Called with the codec lock held.  A running decode burst ends
+**	after its render.
+**
+**	@param decoder	video decoder data
+*/
+static void CodecVideoWaitRender(VideoDecoder * decoder)
+{
+	decoder->Waiting++;
+	while (decoder->Rendering) {
+		pthread_cond_wait(&CodecRenderCond, &CodecLockMutex);
+	}
+	decoder->Waiting--;
+}
+
 //----------------------------------------------------------------------------
 //	Test
 //----------------------------------------------------------------------------
@@ -122,35 +174,48 @@ VideoDecoder *CodecVideoNewDecoder(VideoRender * render)
 */
 void CodecVideoDelDecoder(VideoDecoder * decoder)
 {
+    if (decoder->ParkedCtx) {
+	avcodec_free_context(&decoder->ParkedCtx);
+    }
     free(decoder);
 }
 
 /**
-**	Open video decoder.
+**	Select the video decoder for a stream.
 **
 **	@param decoder	private video decoder
 **	@param codec_id	video codec id
+**	@param info	parsed SPS/VPS of the stream or NULL
+**	@param[out] type	hw device type, 0 none
 */
-void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Par,
-		AVRational * timebase)
+static AVCodec *CodecVideoFindDecoder(VideoDecoder * decoder, int codec_id,
+		const VideoStreamInfo * info, enum AVHWDeviceType *type)
 {
 	AVCodec * codec;
-	enum AVHWDeviceType type = 0;
-	static AVBufferRef *hw_device_ctx = NULL;
-	int err;
+	int by_name;
 
-	if (VideoCodecMode(decoder->Render) == 1 ||
-		(VideoCodecMode(decoder->Render) == 3 && codec_id == AV_CODEC_ID_H264)) {
+	*type = 0;
+	by_name = VideoCodecMode(decoder->Render) == 1 ||
+		(VideoCodecMode(decoder->Render) == 3 && codec_id == AV_CODEC_ID_H264);
+
+	// mmal and v4l2m2m decoders only handle 8 bit 4:2:0
+	if (by_name && info && (info->BitDepth > 8 || info->ChromaFormat > 1)) {
+		fprintf(stderr, "CodecVideoFindDecoder: %d bit chroma format %d, use regular decoder\n",
+			info->BitDepth, info->ChromaFormat);
+		by_name = 0;
+	}
+
+	if (by_name) {
 
 		if (!(codec = avcodec_find_decoder_by_name(VideoGetDecoderName(
 			avcodec_get_name(codec_id)))))
 
-			fprintf(stderr, "CodecVideoOpen: The video codec %s is not present in libavcodec\n",
+			fprintf(stderr, "CodecVideoFindDecoder: The video codec %s is not present in libavcodec\n",
 				VideoGetDecoderName(avcodec_get_name(codec_id)));
 	} else {
 
 		if (!(codec = avcodec_find_decoder(codec_id)))
-			fprintf(stderr, "CodecVideoOpen: The video codec %s is not present in libavcodec\n",
+			fprintf(stderr, "CodecVideoFindDecoder: The video codec %s is not present in libavcodec\n",
 				avcodec_get_name(codec_id));
 
 		if (!(VideoCodecMode(decoder->Render) == 2 && codec_id == AV_CODEC_ID_MPEG2VIDEO)) {
@@ -158,7 +223,7 @@ void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Pa
 				const AVCodecHWConfig *cfg = avcodec_get_hw_config(codec, n);
 				if (!cfg) {
 #ifdef CODEC_DEBUG
-					fprintf(stderr, "CodecVideoOpen: no HW config found\n");
+					fprintf(stderr, "CodecVideoFindDecoder: no HW config found\n");
 #endif
 					break;
 				}
@@ -166,15 +231,104 @@ void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Pa
 					cfg->device_type == AV_HWDEVICE_TYPE_DRM) {
 
 #ifdef CODEC_DEBUG
-					fprintf(stderr, "CodecVideoOpen: HW codec %s found\n",
+					fprintf(stderr, "CodecVideoFindDecoder: HW codec %s found\n",
 						av_hwdevice_get_type_name(cfg->device_type));
 #endif
-					type = cfg->device_type;
+					*type = cfg->device_type;
 					break;
 				}
 			}
 		}
 	}
+	return codec;
+}
+
+/**
+**	Check if the parked decoder context fits the new stream.
+**
+**	Only the parameters which need new decoder buffers are compared,
+**	everything else is handled by the decoder after a flush.  The
+**	stream must select the same decoder and hw device.
+**
+**	@param decoder	private video decoder
+**	@param codec_id	video codec id
+**	@param codec	selected decoder
+**	@param type	selected hw device type
+**	@param Par	stream parameters from demuxer or NULL
+**	@param info	parsed SPS/VPS of the stream or NULL
+*/
+static int CodecVideoCanReuse(const VideoDecoder * decoder, int codec_id,
+		const AVCodec * codec, enum AVHWDeviceType type,
+		const AVCodecParameters * Par, const VideoStreamInfo * info)
+{
+	const VideoStreamInfo *old = &decoder->Info;
+
+	if (!decoder->ParkedCtx || Par ||
+		decoder->ParkedCtx->codec_id != (enum AVCodecID)codec_id ||
+		decoder->ParkedCtx->codec != codec ||
+		!decoder->ParkedCtx->hw_device_ctx != !type) {
+		return 0;
+	}
+	if (!info || !decoder->HaveInfo) {
+		return !info && !decoder->HaveInfo &&
+			codec_id == AV_CODEC_ID_MPEG2VIDEO;
+	}
+	return info->Width == old->Width && info->Height == old->Height &&
+		info->CodedWidth == old->CodedWidth &&
+		info->CodedHeight == old->CodedHeight &&
+		info->BitDepth == old->BitDepth &&
+		info->ChromaFormat == old->ChromaFormat &&
+		info->Interlaced == old->Interlaced &&
+		info->DpbSize <= old->DpbSize;
+}
+
+/**
+**	Open video decoder.
+**
+**	@param decoder	private video decoder
+**	@param codec_id	video codec id
+**	@param Par	stream parameters from demuxer or NULL
+**	@param timebase	packet timebase or NULL
+**	@param info	parsed SPS/VPS of the stream or NULL
+*/
+void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Par,
+		AVRational * timebase, const VideoStreamInfo * info)
+{
+	AVCodec * codec;
+	enum AVHWDeviceType type = 0;
+	static AVBufferRef *hw_device_ctx = NULL;
+	AVDictionary *opts = NULL;
+	int err;
+
+	codec = CodecVideoFindDecoder(decoder, codec_id, info, &type);
+
+	// same codec and buffers: keep hw device and buffer pools
+	if (CodecVideoCanReuse(decoder, codec_id, codec, type, Par, info)) {
+		pthread_mutex_lock(&CodecLockMutex);
+		decoder->VideoCtx = decoder->ParkedCtx;
+		decoder->ParkedCtx = NULL;
+		if (timebase) {
+			decoder->VideoCtx->pkt_timebase.num = timebase->num;
+			decoder->VideoCtx->pkt_timebase.den = timebase->den;
+		}
+		if (info && info->FrameRate.num && info->FrameRate.den)
+			decoder->VideoCtx->framerate = info->FrameRate;
+		pthread_mutex_unlock(&CodecLockMutex);
+
+		VideoSetStreamInfo(decoder->Render, info, decoder->Sw);
+		decoder->Reused++;
+#ifdef CODEC_DEBUG
+		fprintf(stderr, "CodecVideoOpen: reuse %s context\n",
+			decoder->VideoCtx->codec->name);
+#endif
+		return;
+	}
+	if (decoder->ParkedCtx) {
+		pthread_mutex_lock(&CodecLockMutex);
+		avcodec_free_context(&decoder->ParkedCtx);
+		pthread_mutex_unlock(&CodecLockMutex);
+	}
+
 #ifdef CODEC_DEBUG
 	fprintf(stderr, "CodecVideoOpen: Codec %s found\n", codec->long_name);
 #endif
@@ -187,20 +341,30 @@ void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Pa
 	decoder->VideoCtx->get_format = Codec_get_format;
 	decoder->VideoCtx->opaque = decoder;
 
-	if (strstr(codec->name, "_v4l2")) {
-		int width;
-		int height;
-
-		if (!Par) {
-			ParseResolutionH264(&width, &height);
+	if (info) {
 #ifdef CODEC_DEBUG
-			fprintf(stderr, "CodecVideoOpen: Parsed width %d height %d\n", width, height);
+		fprintf(stderr, "CodecVideoOpen: Parsed %dx%d (coded %dx%d) %d bit"
+			" chroma %d interlaced %d dpb %d rate %d/%d\n",
+			info->Width, info->Height, info->CodedWidth, info->CodedHeight,
+			info->BitDepth, info->ChromaFormat, info->Interlaced,
+			info->DpbSize, info->FrameRate.num, info->FrameRate.den);
 #endif
-			decoder->VideoCtx->coded_width = width;
-			decoder->VideoCtx->coded_height = height;
-		} else {
+		decoder->VideoCtx->width = info->Width;
+		decoder->VideoCtx->height = info->Height;
+		if (info->FrameRate.num && info->FrameRate.den)
+			decoder->VideoCtx->framerate = info->FrameRate;
+	}
+
+	if (strstr(codec->name, "_v4l2")) {
+		if (Par) {
 			decoder->VideoCtx->coded_width = Par->width;
 			decoder->VideoCtx->coded_height = Par->height;
+		} else if (info) {
+			decoder->VideoCtx->coded_width = info->Width;
+			decoder->VideoCtx->coded_height = info->Height;
+			// capture queue must hold the DPB and the frames in display
+			av_dict_set_int(&opts, "num_capture_buffers",
+				FFMAX(20, info->DpbSize + VIDEO_SURFACES_MAX + 2), 0);
 		}
 	}
 
@@ -240,13 +404,25 @@ void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Pa
 		decoder->VideoCtx->pkt_timebase.den = timebase->den;
 	}
 
-	err = avcodec_open2(decoder->VideoCtx, decoder->VideoCtx->codec, NULL);
+	decoder->Sw = !type && !strstr(codec->name, "_v4l2") &&
+		!strstr(codec->name, "_mmal");
+	decoder->Reusable = !Par;
+	decoder->HaveInfo = info != NULL;
+	if (info) {
+		decoder->Info = *info;
+	}
+	VideoSetStreamInfo(decoder->Render, info, decoder->Sw);
+
+	err = avcodec_open2(decoder->VideoCtx, decoder->VideoCtx->codec, &opts);
+	av_dict_free(&opts);
 	if (err < 0) {
 		fprintf(stderr, "CodecVideoOpen: Error opening the decoder: %s\n",
 			av_err2str(err));
 		Fatal(_("CodecVideoOpen: Error opening the decoder: %s\n"),
 			av_err2str(err));
+		return;
 	}
+	decoder->Reopened++;
 }
 
 /**
@@ -260,12 +436,34 @@ void CodecVideoClose(VideoDecoder * decoder)
 	fprintf(stderr, "CodecVideoClose: VideoCtx %p\n", decoder->VideoCtx);
 #endif
 	pthread_mutex_lock(&CodecLockMutex);
+	CodecVideoWaitRender(decoder);
 	if (decoder->VideoCtx) {
-		avcodec_free_context(&decoder->VideoCtx);
+		// park the context, the next stream may use the same codec
+		if (decoder->Reusable) {
+			avcodec_flush_buffers(decoder->VideoCtx);
+			decoder->ParkedCtx = decoder->VideoCtx;
+			decoder->VideoCtx = NULL;
+		} else {
+			avcodec_free_context(&decoder->VideoCtx);
+		}
 	}
 	pthread_mutex_unlock(&CodecLockMutex);
 }
 
+/**
+**	Get video decoder statistics.
+**
+**	@param decoder		video decoder data
+**	@param[out] reused	number of reused decoder contexts
+**	@param[out] reopened	number of newly opened decoder contexts
+*/
+void CodecVideoGetStats(const VideoDecoder * decoder, int *reused,
+		int *reopened)
+{
+	*reused = decoder->Reused;
+	*reopened = decoder->Reopened;
+}
+
 /**
 **	Decode a video packet.
 **
@@ -352,14 +550,12 @@ int CodecVideoReceiveFrame(VideoDecoder * decoder, int no_deint)
 	}
 
 	pthread_mutex_lock(&CodecLockMutex);
-	if (decoder->VideoCtx) {
-		ret = avcodec_receive_frame(decoder->VideoCtx, decoder->Frame);
-	} else {
+	if (!decoder->VideoCtx) {
 		av_frame_free(&decoder->Frame);
 		pthread_mutex_unlock(&CodecLockMutex);
 		return 1;
 	}
-	pthread_mutex_unlock(&CodecLockMutex);
+	ret = avcodec_receive_frame(decoder->VideoCtx, decoder->Frame);
 
 	if (!ret) {
 		if (no_deint) {
@@ -368,8 +564,11 @@ int CodecVideoReceiveFrame(VideoDecoder * decoder, int no_deint)
 			fprintf(stderr, "CodecVideoReceiveFrame: interlaced_frame = 0\n");
 #endif
 		}
-		VideoRenderFrame(decoder->Render, decoder->VideoCtx, decoder->Frame);
-	} else {
+		CodecVideoRender(decoder, decoder->Frame);
+	}
+	pthread_mutex_unlock(&CodecLockMutex);
+
+	if (ret) {
 		av_frame_free(&decoder->Frame);
 #ifdef DEBUG
 		if (ret != AVERROR(EAGAIN))
@@ -382,6 +581,87 @@ int CodecVideoReceiveFrame(VideoDecoder * decoder, int no_deint)
 	return 0;
 }
 
+/**
+**	Run the video decoder until it needs more input or output room.
+**
+**	Ready frames are received first, then packets are sent until the
+**	decoder refuses more.  This repeats as long as something moves, so
+**	a decoder which emits several frames per packet or needs several
+**	packets per frame is drained in one call.  The codec lock is taken
+**	once for the whole burst, it is only released while a frame is
+**	rendered.  The burst ends early, if close or flush wait meanwhile.
+**
+**	@param decoder	video decoder data
+**	@param next	returns the next packet to send, NULL if none, it is
+**			called with the codec lock held and must not wait for
+**			locks held by callers of close or flush
+**	@param done	releases the packet returned by next, drops it from
+**			the queue if the flag is set
+**	@param opaque	argument for next and done
+**
+**	@returns number of packets sent and frames received.
+*/
+int CodecVideoDecode(VideoDecoder * decoder,
+		const AVPacket *(*next)(void *), void (*done)(void *, int),
+		void *opaque)
+{
+	const AVPacket *avpkt;
+	AVFrame *frame;
+	int progress;
+	int work;
+	int ret;
+
+	work = 0;
+	pthread_mutex_lock(&CodecLockMutex);
+	do {
+		progress = 0;
+
+		// receive until EAGAIN or the render queues are full
+		while (decoder->VideoCtx && !decoder->Waiting &&
+			VideoFramesFree(decoder->Render)) {
+			if (!(frame = av_frame_alloc())) {
+				Fatal(_("CodecVideoDecode: can't allocate decoder frame\n"));
+			}
+			ret = avcodec_receive_frame(decoder->VideoCtx, frame);
+			if (ret) {
+				av_frame_free(&frame);
+#ifdef DEBUG
+				if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+					fprintf(stderr, "CodecVideoDecode: receive_frame ret: %s\n",
+						av_err2str(ret));
+#endif
+				break;
+			}
+			CodecVideoRender(decoder, frame);
+			progress++;
+		}
+
+		// send until EAGAIN or the packet queue is empty
+		while (decoder->VideoCtx && !decoder->Waiting &&
+			(avpkt = next(opaque))) {
+			ret = 0;
+			if (avpkt->size) {
+				ret = avcodec_send_packet(decoder->VideoCtx, avpkt);
+			}
+			if (ret == AVERROR(EAGAIN)) {
+				done(opaque, 0);
+				break;
+			}
+#ifdef DEBUG
+			if (ret < 0)
+				fprintf(stderr, "CodecVideoDecode: send_packet ret: %s\n",
+					av_err2str(ret));
+#endif
+			done(opaque, 1);
+			progress++;
+		}
+		work += progress;
+	} while (progress && decoder->VideoCtx && !decoder->Waiting);
+	pthread_mutex_unlock(&CodecLockMutex);
+
+	return work;
+}
+
 /**
 **	Flush the video decoder.
 **
@@ -393,6 +673,7 @@ void CodecVideoFlushBuffers(VideoDecoder * decoder)
 	fprintf(stderr, "CodecVideoFlushBuffers: VideoCtx %p\n", decoder->VideoCtx);
 #endif
 	pthread_mutex_lock(&CodecLockMutex);
+	CodecVideoWaitRender(decoder);
 	if (decoder->VideoCtx) {
 		avcodec_flush_buffers(decoder->VideoCtx);
 	}
@@ -645,6 +926,7 @@ void CodecInit(void)
     avcodec_register_all();		// register all formats and codecs
 #endif
 	pthread_mutex_init(&CodecLockMutex, NULL);
+	pthread_cond_init(&CodecRenderCond, NULL);
 }
 
 /**
@@ -652,5 +934,6 @@ void CodecInit(void)
 */
 void CodecExit(void)
 {
+	pthread_cond_destroy(&CodecRenderCond);
 	pthread_mutex_destroy(&CodecLockMutex);
 }
@@ -59,7 +59,8 @@ extern VideoDecoder *CodecVideoNewDecoder(VideoRender *);
 extern void CodecVideoDelDecoder(VideoDecoder *);
 
     /// Open video codec.
-extern void CodecVideoOpen(VideoDecoder *, int, AVCodecParameters *, AVRational *);
+extern void CodecVideoOpen(VideoDecoder *, int, AVCodecParameters *, AVRational *,
+    const VideoStreamInfo *);
 
     /// Close video codec.
 extern void CodecVideoClose(VideoDecoder *);
@@ -69,9 +70,16 @@ extern int CodecVideoSendPacket(VideoDecoder *, const AVPacket *);
 
 extern int CodecVideoReceiveFrame(VideoDecoder *, int);
 
+    /// Run the video decoder with packets from a queue.
+extern int CodecVideoDecode(VideoDecoder *, const AVPacket *(*)(void *),
+    void (*)(void *, int), void *);
+
     /// Flush video buffers.
 extern void CodecVideoFlushBuffers(VideoDecoder *);
 
+    /// Get video decoder statistics.
+extern void CodecVideoGetStats(const VideoDecoder *, int *, int *);
+
 
     /// Allocate a new audio decoder context.
 extern AudioDecoder *CodecAudioNewDecoder(void);
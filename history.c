@@ -0,0 +1,396 @@
+///
+///	@file history.c	@brief Video packet history module
+///
+///	Copyright (c) 2021 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup History The video packet history module.
+///
+///	Keeps the last compressed video access units in a fixed memory
+///	budget.  Access units are addressed by a running sequence number,
+///	key access units (GOP starts) are kept in an extra index.  The
+///	history always starts with a key access unit, the oldest GOP is
+///	dropped as a whole if the budget is exhausted.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "history.h"
+
+#define HISTORY_ENTRIES_MAX 8192	///< max access units in history
+
+    /// history access unit
+typedef struct _history_entry_
+{
+    int64_t Pts;			///< presentation timestamp
+    size_t Offset;			///< offset of data in buffer
+    int Size;				///< size of data
+    int Key;				///< flag key access unit (GOP start)
+} HistoryEntry;
+
+    /// packet history structure
+struct _history_
+{
+    pthread_mutex_t Lock;		///< writer and reader run in different threads
+
+    uint8_t *Buffer;			///< access unit data
+    size_t Size;			///< bytes in buffer
+    size_t Used;			///< bytes used by access units
+
+    HistoryEntry Entries[HISTORY_ENTRIES_MAX];	///< access unit ring
+    unsigned First;			///< sequence number of oldest entry
+    int Count;				///< number of entries
+
+    unsigned Keys[HISTORY_ENTRIES_MAX];	///< GOP index, sequence numbers
+    int KeyFirst;			///< ring index of oldest key
+    int KeyCount;			///< number of keys
+};
+
+/**
+**	Drop the oldest access unit.
+**
+**	@param h	packet history
+*/
+static void HistoryDropFirst(History * h)
+{
+    HistoryEntry *entry;
+
+    entry = &h->Entries[h->First % HISTORY_ENTRIES_MAX];
+    h->Used -= entry->Size;
+
+    if (h->KeyCount && h->Keys[h->KeyFirst] == h->First) {
+	h->KeyFirst = (h->KeyFirst + 1) % HISTORY_ENTRIES_MAX;
+	h->KeyCount--;
+    }
+    h->First++;
+    h->Count--;
+}
+
+/**
+**	Drop the oldest GOP, a GOP without key access unit is useless.
+**
+**	@param h	packet history
+*/
+static void HistoryDropGop(History * h)
+{
+    HistoryDropFirst(h);
+    while (h->Count && !h->Entries[h->First % HISTORY_ENTRIES_MAX].Key) {
+	HistoryDropFirst(h);
+    }
+}
+
+/**
+**	Reset packet history, drop all access units.
+**
+**	@param h	packet history
+*/
+void HistoryReset(History * h)
+{
+    pthread_mutex_lock(&h->Lock);
+    h->First += h->Count;		// keep old sequence numbers invalid
+    h->Count = 0;
+    h->KeyFirst = 0;
+    h->KeyCount = 0;
+    h->Used = 0;
+    pthread_mutex_unlock(&h->Lock);
+}
+
+/**
+**	Allocate a new packet history.
+**
+**	@param size	memory budget for access unit data
+**
+**	@returns	Allocated packet history, must be freed with
+**			HistoryDel(), NULL for out of memory.
+*/
+History *HistoryNew(size_t size)
+{
+    History *h;
+
+    if (!(h = calloc(1, sizeof(*h)))) {
+	return h;
+    }
+    if (!(h->Buffer = malloc(size))) {
+	free(h);
+	return NULL;
+    }
+
+    h->Size = size;
+    pthread_mutex_init(&h->Lock, NULL);
+
+    return h;
+}
+
+/**
+**	Free an allocated packet history.
+**
+**	@param h	packet history
+*/
+void HistoryDel(History * h)
+{
+    pthread_mutex_destroy(&h->Lock);
+    free(h->Buffer);
+    free(h);
+}
+
+/**
+**	Append one access unit to history.
+**
+**	Oldest GOPs are dropped until the access unit fits into the budget.
+**
+**	@param h	packet history
+**	@param pts	presentation timestamp of access unit
+**	@param data	data of access unit
+**	@param size	size of access unit
+**	@param key	flag access unit starts a GOP
+*/
+void HistoryAdd(History * h, int64_t pts, const uint8_t * data, int size,
+    int key)
+{
+    HistoryEntry *entry;
+    size_t pos;
+
+    if (size <= 0) {
+	return;
+    }
+
+    pthread_mutex_lock(&h->Lock);
+
+    // a single access unit should never eat the whole budget
+    if ((size_t)size > h->Size / 2) {
+	h->First += h->Count;
+	h->Count = 0;
+	h->KeyFirst = 0;
+	h->KeyCount = 0;
+	h->Used = 0;
+	pthread_mutex_unlock(&h->Lock);
+	return;
+    }
+
+    if (h->Count == HISTORY_ENTRIES_MAX) {
+	HistoryDropGop(h);
+    }
+
+    for (;;) {
+	HistoryEntry *first;
+	HistoryEntry *last;
+
+	if (!h->Count) {
+	    pos = 0;
+	    break;
+	}
+	first = &h->Entries[h->First % HISTORY_ENTRIES_MAX];
+	last = &h->Entries[(h->First + h->Count - 1) % HISTORY_ENTRIES_MAX];
+	pos = last->Offset + last->Size;
+
+	if (last->Offset >= first->Offset) {	// data not wrapped
+	    if (pos + size <= h->Size) {
+		break;
+	    }
+	    if ((size_t)size <= first->Offset) {
+		pos = 0;
+		break;
+	    }
+	} else if (pos + size <= first->Offset) {
+	    break;
+	}
+	HistoryDropGop(h);
+    }
+
+    // history must start with a GOP
+    if (!h->Count && !key) {
+	pthread_mutex_unlock(&h->Lock);
+	return;
+    }
+
+    memcpy(h->Buffer + pos, data, size);
+    entry = &h->Entries[(h->First + h->Count) % HISTORY_ENTRIES_MAX];
+    entry->Pts = pts;
+    entry->Offset = pos;
+    entry->Size = size;
+    entry->Key = key;
+
+    if (key) {
+	h->Keys[(h->KeyFirst + h->KeyCount) % HISTORY_ENTRIES_MAX] =
+	    h->First + h->Count;
+	h->KeyCount++;
+    }
+    h->Count++;
+    h->Used += size;
+
+    pthread_mutex_unlock(&h->Lock);
+}
+
+/**
+**	Find the GOP which contains the given presentation timestamp.
+**
+**	If the timestamp is older than the history, the oldest GOP is
+**	returned.
+**
+**	@param h	packet history
+**	@param pts	presentation timestamp
+**	@param[out] seq	sequence number of key access unit
+**
+**	@retval 0	key access unit found
+**	@retval -1	history empty
+*/
+int HistoryFindKey(History * h, int64_t pts, unsigned *seq)
+{
+    int i;
+
+    pthread_mutex_lock(&h->Lock);
+    if (!h->KeyCount) {
+	pthread_mutex_unlock(&h->Lock);
+	return -1;
+    }
+
+    for (i = h->KeyCount - 1; i > 0; --i) {
+	unsigned key;
+
+	key = h->Keys[(h->KeyFirst + i) % HISTORY_ENTRIES_MAX];
+	if (h->Entries[key % HISTORY_ENTRIES_MAX].Pts <= pts) {
+	    break;
+	}
+    }
+    *seq = h->Keys[(h->KeyFirst + i) % HISTORY_ENTRIES_MAX];
+
+    pthread_mutex_unlock(&h->Lock);
+    return 0;
+}
+
+/**
+**	Find the key access unit in front of the given access unit.
+**
+**	@param h	packet history
+**	@param seq	sequence number of access unit
+**	@param[out] prev	sequence number of previous key access unit
+**
+**	@retval 0	key access unit found
+**	@retval -1	no older GOP in history
+*/
+int HistoryPrevKey(History * h, unsigned seq, unsigned *prev)
+{
+    int i;
+
+    pthread_mutex_lock(&h->Lock);
+    for (i = h->KeyCount - 1; i >= 0; --i) {
+	unsigned key;
+
+	key = h->Keys[(h->KeyFirst + i) % HISTORY_ENTRIES_MAX];
+	if ((int)(key - seq) < 0) {
+	    *prev = key;
+	    pthread_mutex_unlock(&h->Lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&h->Lock);
+
+    return -1;
+}
+
+/**
+**	Get sequence number of the newest access unit.
+**
+**	@param h	packet history
+**	@param[out] seq	sequence number of newest access unit
+**
+**	@retval 0	ok
+**	@retval -1	history empty
+*/
+int HistoryLast(History * h, unsigned *seq)
+{
+    int ret;
+
+    pthread_mutex_lock(&h->Lock);
+    ret = -1;
+    if (h->Count) {
+	*seq = h->First + h->Count - 1;
+	ret = 0;
+    }
+    pthread_mutex_unlock(&h->Lock);
+
+    return ret;
+}
+
+/**
+**	Copy one access unit out of history.
+**
+**	Data is only copied, if the access unit fits into the buffer.
+**
+**	@param h	packet history
+**	@param seq	sequence number of access unit
+**	@param[out] pts	presentation timestamp of access unit
+**	@param buf	buffer for access unit data
+**	@param size	size of buffer
+**
+**	@returns size of access unit, -1 if access unit isn't in history.
+*/
+int HistoryGet(History * h, unsigned seq, int64_t * pts, uint8_t * buf,
+    int size)
+{
+    HistoryEntry *entry;
+    int n;
+
+    pthread_mutex_lock(&h->Lock);
+    n = seq - h->First;
+    if (n < 0 || n >= h->Count) {
+	pthread_mutex_unlock(&h->Lock);
+	return -1;
+    }
+
+    entry = &h->Entries[seq % HISTORY_ENTRIES_MAX];
+    *pts = entry->Pts;
+    if (entry->Size <= size) {
+	memcpy(buf, h->Buffer + entry->Offset, entry->Size);
+    }
+    n = entry->Size;
+    pthread_mutex_unlock(&h->Lock);
+
+    return n;
+}
+
+/**
+**	Get packet history statistics.
+**
+**	@param h	packet history
+**	@param[out] used	bytes used by access units
+**	@param[out] count	number of access units
+**	@param[out] gops	number of GOPs
+**	@param[out] duration	pts difference newest - oldest access unit
+*/
+void HistoryGetStats(History * h, size_t * used, int *count, int *gops,
+    int64_t * duration)
+{
+    pthread_mutex_lock(&h->Lock);
+    *used = h->Used;
+    *count = h->Count;
+    *gops = h->KeyCount;
+    *duration = 0;
+    if (h->Count) {
+	*duration =
+	    h->Entries[(h->First + h->Count - 1) % HISTORY_ENTRIES_MAX].Pts -
+	    h->Entries[h->First % HISTORY_ENTRIES_MAX].Pts;
+    }
+    pthread_mutex_unlock(&h->Lock);
+}
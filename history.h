@@ -0,0 +1,56 @@
+///
+///	@file history.h	@brief Video packet history module header file
+///
+///	Copyright (c) 2021 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup History
+/// @{
+
+    /// packet history typedef
+typedef struct _history_ History;
+
+    /// create new packet history
+extern History *HistoryNew(size_t);
+
+    /// free packet history
+extern void HistoryDel(History *);
+
+    /// drop all packets of history
+extern void HistoryReset(History *);
+
+    /// append one access unit to history
+extern void HistoryAdd(History *, int64_t, const uint8_t *, int, int);
+
+    /// find last key access unit with pts before or equal given pts
+extern int HistoryFindKey(History *, int64_t, unsigned *);
+
+    /// find key access unit in front of given access unit
+extern int HistoryPrevKey(History *, unsigned, unsigned *);
+
+    /// get newest access unit of history
+extern int HistoryLast(History *, unsigned *);
+
+    /// copy access unit out of history
+extern int HistoryGet(History *, unsigned, int64_t *, uint8_t *, int);
+
+    /// get history statistics
+extern void HistoryGetStats(History *, size_t *, int *, int *, int64_t *);
+
+/// @}
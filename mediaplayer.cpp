@@ -470,6 +470,8 @@ void cSoftHdMenu::MainMenu(void)
 	int duped;
 	int dropped;
 	int counter;
+	int reused;
+	int reopened;
 
 	current = Current();		// get current menu item index
 	Clear();				// clear the menu
@@ -478,7 +480,7 @@ void cSoftHdMenu::MainMenu(void)
 	Add(new cOsdItem(hk(tr(" select play list")), osUser2));
 	Add(new cOsdItem(NULL, osUnknown, false));
 	Add(new cOsdItem(NULL, osUnknown, false));
-	GetStats(&duped, &dropped, &counter);
+	GetStats(&duped, &dropped, &counter, &reused, &reopened);
 	Add(new cOsdItem(cString::sprintf(tr
 		(" Frames duped(%d) dropped(%d) total(%d)"),
 		duped, dropped, counter), osUnknown, false));
@@ -1,11 +1,15 @@
 #define __STL_CONFIG_H
 #include <algorithm>
+#include <climits>
+#include <map>
 #include "openglosd.h"
 #include <inttypes.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <string>
 
 #ifdef WRITE_PNG
 #include <png.h>
@@ -99,6 +103,16 @@ void ConvertColor(const GLint &colARGB, glm::vec4 &col) {
     col.b = ((colARGB & 0x000000FF)      ) / 255.0;
 }
 
+// limit drawing to rect, given top-down in a framebuffer of the given height
+void EnableScissor(const cRect &rect, GLint height) {
+    GL_CHECK(glEnable(GL_SCISSOR_TEST));
+    GL_CHECK(glScissor(rect.X(), height - rect.Y() - rect.Height(), rect.Width(), rect.Height()));
+}
+
+void DisableScissor(void) {
+    GL_CHECK(glDisable(GL_SCISSOR_TEST));
+}
+
 void glCheckError(const char *stmt, const char *fname, int line) {
     GLint err = glGetError();
     if (err != GL_NO_ERROR)
@@ -133,6 +147,259 @@ void eglReleaseContext()
     EGL_CHECK(assert(eglMakeCurrent(render->eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_TRUE));
 }
 
+/****************************************************************************************
+* EGL contexts
+* The GL thread renders through one of them, set by InitOpenGL()
+****************************************************************************************/
+static cOglContext *GlContext = NULL;
+
+//------------------ cOglRenderContext --------------------
+cOglRenderContext::cOglRenderContext(void) {
+    bufferAge = false;
+}
+
+bool cOglRenderContext::Init(void) {
+    VideoRender *render = (VideoRender *)GetVideoRender();
+    if (!render) {
+        fprintf(stderr, "failed to get VideoRender\n");
+        abort();
+    }
+
+    // Wait for the EGL context to be created
+    while(!render->GlInit) {
+        fprintf(stderr, "wait for EGL context\n");
+        usleep(20000);
+    }
+
+    eglAcquireContext(); /* eglMakeCurrent with new eglSurface */
+    // EGL_EXT_buffer_age available, output can be updated partially
+    bufferAge = strstr(eglQueryString(render->eglDisplay, EGL_EXTENSIONS), "EGL_EXT_buffer_age") != NULL;
+    return true;
+}
+
+EGLDisplay cOglRenderContext::Display(void) {
+    VideoRender *render = (VideoRender *)GetVideoRender();
+    return render ? render->eglDisplay : EGL_NO_DISPLAY;
+}
+
+EGLint cOglRenderContext::BufferAge(void) {
+    VideoRender *render = (VideoRender *)GetVideoRender();
+    EGLint age = 0;
+
+    if (bufferAge && render)
+        EGL_CHECK(eglQuerySurface(render->eglDisplay, render->eglSurface, EGL_BUFFER_AGE_EXT, &age));
+    return age;
+}
+
+void cOglRenderContext::Present(int width, int height, int active) {
+    // eglSwapBuffers and gbm_surface_lock_front_buffer in OsdDrawARGB(),
+    // the osd plane waits for the rendering with a fence, no glFinish() here
+    if (active)
+        OsdDrawARGB(0, 0, width, height, 0, 0, 0, 0);
+    else
+        OsdClose();
+}
+
+//------------------ cOglPbufferContext --------------------
+cOglPbufferContext::cOglPbufferContext(int width, int height) {
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+    context = EGL_NO_CONTEXT;
+    this->width = width;
+    this->height = height;
+}
+
+bool cOglPbufferContext::Init(void) {
+    static const EGLint configAttribs[] = {
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_NONE
+    };
+    static const EGLint contextAttribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    EGLint surfaceAttribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint matched;
+
+    // surfaceless platform if available, it needs neither DRM master nor X
+    const char *ext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (ext && strstr(ext, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+        EGL_CHECK(display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL));
+    if (display == EGL_NO_DISPLAY)
+        EGL_CHECK(display = eglGetDisplay(EGL_DEFAULT_DISPLAY));
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        esyslog("[softhddev]cOglPbufferContext: no EGL display");
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_ES_API) ||
+        !eglChooseConfig(display, configAttribs, &config, 1, &matched) || !matched) {
+        esyslog("[softhddev]cOglPbufferContext: no pbuffer config");
+        return false;
+    }
+    EGL_CHECK(context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs));
+    if (context == EGL_NO_CONTEXT) {
+        esyslog("[softhddev]cOglPbufferContext: can't create context");
+        return false;
+    }
+    // the output is drawn to the default framebuffer, the pbuffer here
+    EGL_CHECK(surface = eglCreatePbufferSurface(display, config, surfaceAttribs));
+    if (surface == EGL_NO_SURFACE) {
+        esyslog("[softhddev]cOglPbufferContext: can't create %dx%d pbuffer", width, height);
+        return false;
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        esyslog("[softhddev]cOglPbufferContext: can't make context current");
+        return false;
+    }
+    return true;
+}
+
+void cOglPbufferContext::Exit(void) {
+    if (display == EGL_NO_DISPLAY)
+        return;
+    EGL_CHECK(eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT));
+    if (surface != EGL_NO_SURFACE)
+        EGL_CHECK(eglDestroySurface(display, surface));
+    if (context != EGL_NO_CONTEXT)
+        EGL_CHECK(eglDestroyContext(display, context));
+    EGL_CHECK(eglTerminate(display));
+    surface = EGL_NO_SURFACE;
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+}
+
+void cOglPbufferContext::Present(int width, int height, int active) {
+    // nothing is shown, the rendering is finished like before a page flip
+    (void)width;
+    (void)height;
+    (void)active;
+    GL_CHECK(glFinish());
+}
+
+/****************************************************************************************
+* Disk cache
+* Shader program binaries and rasterized glyphs are kept in the plugin cache
+* directory. A file is only used if its key matches, otherwise the shaders are
+* compiled and the glyphs rasterized again.
+****************************************************************************************/
+#define OGL_CACHE_MAGIC 0x4f474c43  // "OGLC"
+
+struct sOglCacheHeader {
+    uint32_t magic;
+    uint32_t count;                 // binary format or number of records
+    uint64_t key;
+    uint64_t size;                  // bytes following the header
+};
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+/*
+ * A font file is read once for all its sizes, the hash is reused as long as
+ * modification time and size of the file are the same.
+ */
+struct sOglFileHash {
+    time_t mtime;
+    off_t size;
+    uint64_t hash;
+};
+
+static cMutex FileHashMutex;
+static std::unordered_map<std::string, sOglFileHash> FileHashes;
+
+static uint64_t HashFile(const char *file) {
+    struct stat st;
+    if (stat(file, &st))
+        return 0;
+
+    cMutexLock lock(&FileHashMutex);
+    auto it = FileHashes.find(file);
+    if (it != FileHashes.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size)
+        return it->second.hash;
+
+    FILE *f = fopen(file, "rb");
+    if (!f)
+        return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        hash = HashBytes(hash, buf, n);
+    fclose(f);
+
+    sOglFileHash h = { st.st_mtime, st.st_size, hash };
+    FileHashes[file] = h;
+    return hash;
+}
+
+static cString CacheFile(const char *name) {
+    const char *dir = cPlugin::CacheDirectory("softhddevice-drm");
+    if (!dir)
+        return cString(NULL);
+    return cString::sprintf("%s/%s", dir, name);
+}
+
+static bool ReadCacheFile(const char *name, uint64_t key, uint32_t &count, std::vector<char> &data) {
+    cString file = CacheFile(name);
+    if (!*file)
+        return false;
+    FILE *f = fopen(file, "rb");
+    if (!f)
+        return false;
+
+    sOglCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              header.magic == OGL_CACHE_MAGIC && header.key == key && header.size < (64 << 20);
+    if (ok) {
+        data.resize(header.size);
+        ok = !header.size || fread(&data[0], header.size, 1, f) == 1;
+        count = header.count;
+    }
+    fclose(f);
+    if (!ok)
+        dsyslog("[softhddev]cache file %s does not match, ignored", *file);
+    return ok;
+}
+
+static void WriteCacheFile(const char *name, uint64_t key, uint32_t count, const void *data, size_t size) {
+    cString file = CacheFile(name);
+    if (!*file)
+        return;
+
+    // write to a temporary file first, readers never see a partial file
+    cString tmp = cString::sprintf("%s.tmp", *file);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        esyslog("[softhddev]can't write cache file %s: %m", *tmp);
+        return;
+    }
+    sOglCacheHeader header = { OGL_CACHE_MAGIC, count, key, size };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              (!size || fwrite(data, size, 1, f) == 1);
+    if (fclose(f) || !ok || rename(tmp, file)) {
+        esyslog("[softhddev]can't write cache file %s", *file);
+        unlink(tmp);
+    }
+}
+
 /****************************************************************************************
 * cShader
 ****************************************************************************************/
@@ -140,14 +407,14 @@ const char *rectVertexShader =
 "#version 100 \n\
 \
 attribute vec2 position; \
+attribute vec4 color; \
 varying vec4 rectCol; \
-uniform vec4 inColor; \
 uniform mat4 projection; \
 \
 void main() \
 { \
     gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
-    rectCol = inColor; \
+    rectCol = color; \
 } \
 ";
 
@@ -240,18 +507,18 @@ const char *textVertexShader =
 \
 attribute vec2 position; \
 attribute vec2 texCoords; \
+attribute vec4 color; \
 \
 varying vec2 TexCoords; \
 varying vec4 textColor; \
 \
 uniform mat4 projection; \
-uniform vec4 inColor; \
 \
 void main() \
 { \
     gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
     TexCoords = texCoords; \
-    textColor = inColor; \
+    textColor = color; \
 } \
 ";
 
@@ -271,9 +538,108 @@ void main() \
 ";
 
 static cShader *Shaders[stCount]; 
+static cOglBatch *Batch;
+
+GLuint cShader::current = 0;
+uint64_t cShader::binaryKey = 0;
+
+static PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinary = NULL;
+static PFNGLPROGRAMBINARYOESPROC glProgramBinary = NULL;
+
+/*
+ * Program binaries are only valid for the driver which created them.
+ */
+void cShader::InitBinaryCache(void) {
+    GLint formats = 0;
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+
+    binaryKey = 0;
+    if (!extensions || !strstr(extensions, "GL_OES_get_program_binary"))
+        return;
+    GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats));
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+    glProgramBinary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+    if (formats <= 0 || !glGetProgramBinary || !glProgramBinary)
+        return;
+
+    const GLenum ids[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    binaryKey = 14695981039346656037ULL;
+    for (int i = 0; i < 3; i++) {
+        const char *str = (const char *)glGetString(ids[i]);
+        if (str)
+            binaryKey = HashBytes(binaryKey, str, strlen(str));
+    }
+}
+
+bool cShader::LoadBinary(const char *name, uint64_t key) {
+    uint32_t format;
+    std::vector<char> data;
+    if (!ReadCacheFile(name, key, format, data) || data.empty())
+        return false;
+
+    GLint success = GL_FALSE;
+    GL_CHECK(id = glCreateProgram());
+    GL_CHECK(glProgramBinary(id, format, &data[0], data.size()));
+    GL_CHECK(glGetProgramiv(id, GL_LINK_STATUS, &success));
+    if (!success) {
+        dsyslog("[softhddev]shader binary %s rejected by the driver, compile", name);
+        GL_CHECK(glDeleteProgram(id));
+        id = 0;
+        return false;
+    }
+    return true;
+}
+
+void cShader::SaveBinary(const char *name, uint64_t key) {
+    GLint length = 0;
+    GL_CHECK(glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH_OES, &length));
+    if (length <= 0)
+        return;
+
+    std::vector<char> data(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    GL_CHECK(glGetProgramBinary(id, length, &written, &format, &data[0]));
+    if (written > 0)
+        WriteCacheFile(name, key, format, &data[0], written);
+}
+
+cShader::~cShader(void) {
+    if (current == id)
+        current = 0;
+    if (id)
+        GL_CHECK(glDeleteProgram(id));
+}
 
 void cShader::Use(void) {
+    if (current == id)
+        return;
     GL_CHECK(glUseProgram(id));
+    current = id;
+}
+
+GLint cShader::Location(const GLchar *name) {
+    for (int i = 0; i < numUniforms; i++) {
+        if (uniforms[i].name == name || !strcmp(uniforms[i].name, name))
+            return uniforms[i].location;
+    }
+    GLint location;
+    GL_CHECK(location = glGetUniformLocation(id, name));
+    if (numUniforms < OGL_SHADER_UNIFORMS) {
+        uniforms[numUniforms].name = name;
+        uniforms[numUniforms].location = location;
+        numUniforms++;
+    }
+    return location;
+}
+
+void cShader::SetProjectionMatrix(GLint width, GLint height) {
+    if (width == projectionWidth && height == projectionHeight)
+        return;
+    glm::mat4 projection = glm::ortho(0.0f, (GLfloat)width, (GLfloat)height, 0.0f, -1.0f, 1.0f);
+    SetMatrix4("projection", projection);
+    projectionWidth = width;
+    projectionHeight = height;
 }
 
 bool cShader::Load(eShaderType type) {
@@ -309,35 +675,47 @@ bool cShader::Load(eShaderType type) {
         return false;
     }
 
+    // the key changes with the driver and with the shader sources
+    uint64_t key = 0;
+    cString name = cString::sprintf("shader%d.bin", type);
+    if (binaryKey) {
+        key = HashBytes(binaryKey, vertexCode, strlen(vertexCode));
+        key = HashBytes(key, fragmentCode, strlen(fragmentCode));
+        if (LoadBinary(name, key))
+            return true;
+    }
+
     if (!Compile(vertexCode, fragmentCode)) {
         esyslog("[softhddev]ERROR compiling shader\n");
         return false;
     }
+    if (binaryKey)
+        SaveBinary(name, key);
     return true;
 }
 
 void cShader::SetFloat(const GLchar *name, GLfloat value) {
-    GL_CHECK(glUniform1f(glGetUniformLocation(id, name), value));
+    GL_CHECK(glUniform1f(Location(name), value));
 }
 
 void cShader::SetInteger(const GLchar *name, GLint value) {
-    GL_CHECK(glUniform1i(glGetUniformLocation(id, name), value));
+    GL_CHECK(glUniform1i(Location(name), value));
 }
 
 void cShader::SetVector2f(const GLchar *name, GLfloat x, GLfloat y) {
-    GL_CHECK(glUniform2f(glGetUniformLocation(id, name), x, y));
+    GL_CHECK(glUniform2f(Location(name), x, y));
 }
 
 void cShader::SetVector3f(const GLchar *name, GLfloat x, GLfloat y, GLfloat z) {
-    GL_CHECK(glUniform3f(glGetUniformLocation(id, name), x, y, z));
+    GL_CHECK(glUniform3f(Location(name), x, y, z));
 }
 
 void cShader::SetVector4f(const GLchar *name, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
-    GL_CHECK(glUniform4f(glGetUniformLocation(id, name), x, y, z, w));
+    GL_CHECK(glUniform4f(Location(name), x, y, z, w));
 }
 
 void cShader::SetMatrix4(const GLchar *name, const glm::mat4 &matrix) {
-    GL_CHECK(glUniformMatrix4fv(glGetUniformLocation(id, name), 1, GL_FALSE, glm::value_ptr(matrix)));
+    GL_CHECK(glUniformMatrix4fv(Location(name), 1, GL_FALSE, glm::value_ptr(matrix)));
 }
 
 bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
@@ -360,6 +738,7 @@ bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
     GL_CHECK(glAttachShader(id, sFragment));
     GL_CHECK(glBindAttribLocation(id, 0, "position"));
     GL_CHECK(glBindAttribLocation(id, 1, "texCoords"));
+    GL_CHECK(glBindAttribLocation(id, 2, "color"));
     GL_CHECK(glLinkProgram(id));
     if (!CheckCompileErrors(id, true))
         return false;
@@ -391,75 +770,13 @@ bool cShader::CheckCompileErrors(GLuint object, bool program) {
 }
 
 #define KERNING_UNKNOWN  (-10000)
-/****************************************************************************************
-* cOglGlyph
-****************************************************************************************/
-cOglGlyph::cOglGlyph(FT_ULong charCode, FT_BitmapGlyph ftGlyph) {
-    this->charCode = charCode;
-    bearingLeft = ftGlyph->left;
-    bearingTop = ftGlyph->top;
-    width = ftGlyph->bitmap.width;
-    height = ftGlyph->bitmap.rows;
-    advanceX = ftGlyph->root.advance.x >> 16;   //value in 1/2^16 pixel
-    LoadTexture(ftGlyph);
-}
-
-cOglGlyph::~cOglGlyph(void) {
-    if (texture)
-        GL_CHECK(glDeleteTextures(1, &texture));
-}
-
-int cOglGlyph::GetKerningCache(FT_ULong prevSym) {
-    for (int i = kerningCache.Size(); --i > 0; ) {
-        if (kerningCache[i].prevSym == prevSym)
-            return kerningCache[i].kerning;
-    }
-    return KERNING_UNKNOWN;
-}
-
-void cOglGlyph::SetKerningCache(FT_ULong prevSym, int kerning) {
-    kerningCache.Append(tKerning(prevSym, kerning));
-}
-
-void cOglGlyph::BindTexture(void) {
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
-}
-
-void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
-    // Disable byte-alignment restriction
-    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-    GL_CHECK(glGenTextures(1, &texture));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
-
-    GL_CHECK(glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_LUMINANCE,
-        ftGlyph->bitmap.width,
-        ftGlyph->bitmap.rows,
-        0,
-        GL_LUMINANCE,
-        GL_UNSIGNED_BYTE,
-        ftGlyph->bitmap.buffer
-    ));
-
-    // Set texture options
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
-    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
-}
-
-
 /****************************************************************************************
 * cOglAtlasGlyph
 ****************************************************************************************/
 cOglAtlasGlyph::cOglAtlasGlyph(FT_ULong charCode, float advanceX, float advanceY,
                                float width, float height,
                                float bearingLeft, float bearingTop,
-                               float xoffset, float yoffset) {
+                               int page, float xoffset, float yoffset) {
     this->charCode = charCode;
     this->bearingLeft = bearingLeft;
     this->bearingTop = bearingTop;
@@ -467,8 +784,10 @@ cOglAtlasGlyph::cOglAtlasGlyph(FT_ULong charCode, float advanceX, float advanceY
     this->height = height;
     this->advanceX = advanceX;   //value in 1/2^16 pixel
     this->advanceY = advanceY;   //value in 1/2^16 pixel
+    this->page = page;
     this->xoffset = xoffset;
     this->yoffset = yoffset;
+    this->used = 0;
 }
 
 cOglAtlasGlyph::~cOglAtlasGlyph(void) {
@@ -490,188 +809,390 @@ void cOglAtlasGlyph::SetKerningCache(FT_ULong prevSym, int kerning) {
 
 /****************************************************************************************
 * cOglFontAtlas
+*
+* Glyphs are rendered on first use and packed into shelves of up to OGL_ATLAS_PAGES
+* luminance textures. If all pages are full, the page which was not used for the
+* longest time is repacked: its most recently used glyphs are uploaded again into
+* the first half, the least recently used ones are dropped and refilled on demand.
 ****************************************************************************************/
-cOglFontAtlas::cOglFontAtlas(FT_Face face, int height) {
+cOglFontAtlas::cOglFontAtlas(FT_Face face, const char *fontFile, int height) : fontFile(fontFile) {
+    this->face = face;
     this->fontheight = height;
+    bitmapsBytes = 0;
+    bitmapsLoaded = false;
+    bitmapsDirty = false;
+    bitmapsKey = 0;
+    stroker = 0;
+    numPages = 0;
+    stamp = 0;
+    exhausted = false;
+    generation = 0;
 
     FT_Set_Pixel_Sizes(face, 0, height);
-    FT_GlyphSlot g = face->glyph;
+    if (FT_Stroker_New(face->glyph->library, &stroker)) {
+        esyslog("[softhddev]FT_Stroker_New error!");
+        stroker = 0;
+    } else {
+        FT_Stroker_Set(stroker, OGL_GLYPH_OUTLINE,
+                       FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+    }
+
+    // a page holds at least 12 rows of glyphs
+    size = OGL_ATLAS_MIN_SIZE;
+    while (size < height * 12 && size < OGL_ATLAS_MAX_SIZE)
+        size *= 2;
+
+    for (int i = 0; i < OGL_ATLAS_PAGES; i++) {
+        pages[i].tex = 0;
+        pages[i].bottom = 0;
+        pages[i].used = 0;
+    }
+}
 
-    int roww = 0;
-    int rowh = 0;
-    w = 0;
-    h = 0;
+cOglFontAtlas::~cOglFontAtlas(void) {
+    SaveBitmaps();
+    for (auto it = glyphs.begin(); it != glyphs.end(); ++it)
+        delete it->second;
+    for (int i = 0; i < numPages; i++)
+        GL_CHECK(glDeleteTextures(1, &pages[i].tex));
+    if (stroker)
+        FT_Stroker_Done(stroker);
+}
+
+bool cOglFontAtlas::PackOnPage(int page, int width, int height, int &x, int &y) {
+    sPage &p = pages[page];
+    sShelf *best = NULL;
+
+    // best fitting shelf, new shelf if the best one wastes more than half of its height
+    for (auto it = p.shelves.begin(); it != p.shelves.end(); ++it) {
+        if (it->height < height || it->x + width > size)
+            continue;
+        if (!best || it->height < best->height)
+            best = &*it;
+    }
+    if ((!best || best->height - height > height / 2) && p.bottom + height <= size) {
+        sShelf shelf = { 0, p.bottom, height };
+        p.shelves.push_back(shelf);
+        p.bottom += height;
+        best = &p.shelves.back();
+    }
+    if (!best)
+        return false;
+
+    x = best->x;
+    y = best->y;
+    best->x += width;
+    return true;
+}
 
-    /* Find the minimum size for the texture holding all visible ASCII characters */
-    for (int i = MIN_CHARCODE; i <= MAX_CHARCODE; i++) {
-        if (FT_Load_Char(face, i, FT_LOAD_NO_BITMAP)) {
+int cOglFontAtlas::Pack(int width, int height, int &x, int &y) {
+    if (width > size || height > size)
+        return -1;
+
+    // newest page first, older pages are filled already
+    for (int i = numPages - 1; i >= 0; i--) {
+        if (PackOnPage(i, width, height, x, y))
+            return i;
+    }
+
+    if (numPages < OGL_ATLAS_PAGES) {
+        sPage &p = pages[numPages];
+        GL_CHECK(glGenTextures(1, &p.tex));
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, p.tex));
+        GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, size, size, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, 0));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+        numPages++;
 #ifdef GL_DEBUG
-            fprintf(stderr, "Loading char %d failed!\n", i);
+        fprintf(stderr, "FontAtlas for fontsize %d: new %d x %d page %d\n", fontheight, size, size, numPages);
 #endif
+        if (PackOnPage(numPages - 1, width, height, x, y))
+            return numPages - 1;
+        return -1;
+    }
+
+    // all pages full, drop the coldest one not used by the current text
+    int cold = -1;
+    for (int i = 0; i < numPages; i++) {
+        if (pages[i].used == stamp)
             continue;
-        }
+        if (cold < 0 || (int)(pages[i].used - pages[cold].used) < 0)
+            cold = i;
+    }
+    if (cold < 0) {
+        exhausted = true;
+        return -1;
+    }
+    EvictPage(cold, true);
+    if (PackOnPage(cold, width, height, x, y))
+        return cold;
+    // the hot glyphs leave no room for a big one
+    EvictPage(cold, false);
+    if (PackOnPage(cold, width, height, x, y))
+        return cold;
+    return -1;
+}
+
+void cOglFontAtlas::EvictPage(int page, bool keepHot) {
+    std::multimap<unsigned int, cOglAtlasGlyph *> evicted;     // by age
+
+    // pending text may still use the old glyphs
+    if (Batch)
+        Batch->Flush();
+    for (auto it = glyphs.begin(); it != glyphs.end(); ) {
+        if (it->second->Page() == page) {
+            evicted.insert(std::make_pair(stamp - it->second->Used(), it->second));
+            it = glyphs.erase(it);
+        } else
+            ++it;
+    }
+    pages[page].shelves.clear();
+    pages[page].bottom = 0;
+    generation++;
+
+    // most recently used first, they are kept until half of the page is filled
+    size_t kept = 0;
+    for (auto it = evicted.begin(); it != evicted.end(); ++it) {
+        cOglAtlasGlyph *g = it->second;
+        // only glyphs kept in memory, the spare bitmap may be the caller's
+        auto b = bitmaps.find(g->CharCode());
+        int ox, oy;
+
+        if (keepHot && pages[page].bottom <= size / 2 && b != bitmaps.end() &&
+            PackOnPage(page, b->second.width + 2, b->second.height + 2, ox, oy)) {
+            Upload(page, ox, oy, &b->second);
+            g->Move((ox + 1) / (float)size, (oy + 1) / (float)size);
+            glyphs[g->CharCode()] = g;
+            kept++;
+        } else
+            delete g;
+    }
+#ifdef GL_DEBUG
+    fprintf(stderr, "FontAtlas for fontsize %d: evict page %d, %zu of %zu glyphs kept\n",
+            fontheight, page, kept, evicted.size());
+#else
+    (void)kept;
+#endif
+}
 
-        // do some glyph manipulation
-        FT_Glyph ftGlyph;
-        FT_Stroker stroker;
-        if (FT_Stroker_New(g->library, &stroker)) {
-            fprintf(stderr, "FT_Stroker_New error!\n");
-            return;
-        }
+void cOglFontAtlas::Touch(const std::vector<cOglAtlasGlyph *> &glyphs) {
+    for (auto it = glyphs.begin(); it != glyphs.end(); ++it)
+        (*it)->Use(stamp);
+}
 
-        float outlineWidth = 0.25f;
-        FT_Stroker_Set(stroker, (int)(outlineWidth * 64),
-                       FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+/*
+ * Copy a glyph bitmap with a 1 pixel transparent border to a page, no
+ * bleeding of neighbours with linear filtering.
+ */
+void cOglFontAtlas::Upload(int page, int x, int y, const sBitmap *b) {
+    int bw = b->width;
+    int bh = b->height;
 
-        if (FT_Get_Glyph(g, &ftGlyph)) {
-            fprintf(stderr, "FT_Get_Glyph error!\n");
-            return;
-        }
+    scratch.assign((bw + 2) * (bh + 2), 0);
+    for (int row = 0; row < bh; row++)
+        memcpy(&scratch[(row + 1) * (bw + 2) + 1], &b->pixels[row * bw], bw);
 
-        if (FT_Glyph_StrokeBorder(&ftGlyph, stroker, 0, 1)) {
-            fprintf(stderr, "FT_Glyph_StrokeBoder error!\n");
-            return;
-        }
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, pages[page].tex));
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bw + 2, bh + 2, GL_LUMINANCE, GL_UNSIGNED_BYTE, &scratch[0]));
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
 
-        FT_Stroker_Done(stroker);
+/*
+ * Glyph cache file: header, then per glyph a record followed by its pixels.
+ * The key covers the font file contents, the size and the glyph rendering.
+ */
+struct sOglGlyphRecord {
+    uint32_t charCode;
+    int16_t advanceX;
+    int16_t advanceY;
+    int16_t left;
+    int16_t top;
+    uint16_t width;
+    uint16_t height;
+};
+
+/*
+ * Rasterized bitmap of a glyph, from memory, the disk cache or FreeType.
+ */
+const cOglFontAtlas::sBitmap *cOglFontAtlas::Bitmap(FT_ULong sym) {
+    if (!bitmapsLoaded)
+        LoadBitmaps();
+
+    auto it = bitmaps.find(sym);
+    if (it != bitmaps.end())
+        return &it->second;
+
+    if (!stroker)
+        return NULL;
 
-        if (FT_Glyph_To_Bitmap(&ftGlyph, FT_RENDER_MODE_NORMAL, 0, 1)) {
-            fprintf(stderr, "FT_Glyph_To_Bitmap error!\n");
-            return;
-        }
+    int error = FT_Load_Glyph(face, FT_Get_Char_Index(face, sym), FT_LOAD_NO_BITMAP);
+    if (error) {
+        esyslog("[softhddev]FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
+        return NULL;
+    }
 
-        FT_BitmapGlyph bGlyph = (FT_BitmapGlyph)ftGlyph;
+    FT_Glyph ftGlyph;
+    error = FT_Get_Glyph(face->glyph, &ftGlyph);
+    if (error) {
+        esyslog("[softhddev]FT_Get_Glyph FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
+        return NULL;
+    }
 
-        if (roww + bGlyph->bitmap.width + 1 >= MAX_ATLAS_WIDTH) {
-            w = std::max(w, roww);
-            h += rowh;
-            roww = 0;
-            rowh = 0;
-        }
-        roww += bGlyph->bitmap.width + 1;
-        rowh = std::max(rowh, (int)bGlyph->bitmap.rows);
+    error = FT_Glyph_StrokeBorder(&ftGlyph, stroker, 0, 1);
+    if (error) {
+        esyslog("[softhddev]FT_Glyph_StrokeBorder FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
+        FT_Done_Glyph(ftGlyph);
+        return NULL;
+    }
 
+    error = FT_Glyph_To_Bitmap(&ftGlyph, FT_RENDER_MODE_NORMAL, 0, 1);
+    if (error) {
+        esyslog("[softhddev]FT_Glyph_To_Bitmap FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
         FT_Done_Glyph(ftGlyph);
+        return NULL;
     }
 
-    w = std::max(w, roww);
-    h += rowh;
+    // glyphs beyond the limit are rasterized again, they are not saved
+    FT_BitmapGlyph bGlyph = (FT_BitmapGlyph)ftGlyph;
+    size_t n = (size_t)bGlyph->bitmap.width * bGlyph->bitmap.rows;
+    bool keep = bitmapsBytes + n + sizeof(sOglGlyphRecord) <= OGL_GLYPH_CACHE;
+    sBitmap &b = keep ? bitmaps[sym] : spare;
+    b.advanceX = bGlyph->root.advance.x >> 16;
+    b.advanceY = bGlyph->root.advance.y >> 16;
+    b.left = bGlyph->left;
+    b.top = bGlyph->top;
+    b.width = bGlyph->bitmap.width;
+    b.height = bGlyph->bitmap.rows;
+    b.pixels.resize(b.width * b.height);
+    for (int row = 0; row < b.height; row++)
+        memcpy(&b.pixels[row * b.width], bGlyph->bitmap.buffer + row * bGlyph->bitmap.pitch, b.width);
+    FT_Done_Glyph(ftGlyph);
+    if (keep) {
+        bitmapsBytes += n + sizeof(sOglGlyphRecord);
+        bitmapsDirty = true;
+    }
 
-    /* Create a texture that will be used to hold all ASCII glyphs */
-    GL_CHECK(glGenTextures(1, &tex));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, tex));
-    GL_CHECK(glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_LUMINANCE,
-        w,
-        h,
-        0,
-        GL_LUMINANCE,
-        GL_UNSIGNED_BYTE,
-        0
-    ));
+    return &b;
+}
 
-    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+cOglAtlasGlyph* cOglFontAtlas::GetGlyph(FT_ULong sym) {
+    // Non-breaking space:
+    if (sym == 0xA0)
+        sym = 0x20;
 
-    int ox = 0;
-    int oy = 0;
+    auto it = glyphs.find(sym);
+    if (it != glyphs.end()) {
+        if (it->second->Page() >= 0)
+            pages[it->second->Page()].used = stamp;
+        it->second->Use(stamp);
+        return it->second;
+    }
 
-    rowh = 0;
+    const sBitmap *b = Bitmap(sym);
+    if (!b)
+        return NULL;
 
-    // Now do the real upload
-    for (int i = MIN_CHARCODE; i <= MAX_CHARCODE; i++) {
-        if (FT_Load_Char(face, i, FT_LOAD_NO_BITMAP)) {
-            fprintf(stderr, "Loading char %c failed (1)!\n", i);
-            continue;
+    int bw = b->width;
+    int bh = b->height;
+    int page = -1;
+    float tx = 0.0f;
+    float ty = 0.0f;
+
+    // blank glyphs like space take no room on a page
+    if (bw && bh) {
+        int ox, oy;
+
+        page = Pack(bw + 2, bh + 2, ox, oy);
+        if (page < 0) {
+            if (!exhausted)
+                esyslog("[softhddev]ERROR: glyph %lx (%d x %d) does not fit in font atlas", sym, bw, bh);
+            return NULL;
         }
 
-        // do some glyph manipulation
-        FT_Glyph ftGlyph;
-        FT_Stroker stroker;
-        if (FT_Stroker_New(g->library, &stroker)) {
-            fprintf(stderr, "FT_Stroker_New error!\n");
-            return;
-        }
+        Upload(page, ox, oy, b);
 
-        float outlineWidth = 0.25f;
-        FT_Stroker_Set(stroker, (int)(outlineWidth * 64),
-                       FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+        pages[page].used = stamp;
+        tx = (ox + 1) / (float)size;
+        ty = (oy + 1) / (float)size;
+    }
 
-        if (FT_Get_Glyph(g, &ftGlyph)) {
-            fprintf(stderr, "FT_Get_Glyph error!\n");
-            return;
-        }
+    cOglAtlasGlyph *glyph = new cOglAtlasGlyph(sym, b->advanceX, b->advanceY,
+                                               bw, bh, b->left, b->top, page, tx, ty);
+    glyph->Use(stamp);
+    glyphs[sym] = glyph;
 
-        if (FT_Glyph_StrokeBorder(&ftGlyph, stroker, 0, 1)) {
-            fprintf(stderr, "FT_Glyph_StrokeBoder error!\n");
-            return;
-        }
+    return glyph;
+}
 
-        FT_Stroker_Done(stroker);
+void cOglFontAtlas::LoadBitmaps(void) {
+    bitmapsLoaded = true;
 
-        if (FT_Glyph_To_Bitmap(&ftGlyph, FT_RENDER_MODE_NORMAL, 0, 1)) {
-            fprintf(stderr, "FT_Glyph_To_Bitmap error!\n");
-            return;
-        }
-        FT_BitmapGlyph bGlyph = (FT_BitmapGlyph)ftGlyph;
+    // outline width and record layout are part of the rendering
+    bitmapsKey = HashFile(*fontFile);
+    if (!bitmapsKey)
+        return;
+    int params[] = { fontheight, OGL_GLYPH_OUTLINE, (int)sizeof(sOglGlyphRecord) };
+    bitmapsKey = HashBytes(bitmapsKey, params, sizeof(params));
 
-        // pushing the glyphs to the texture
-        if (ox + bGlyph->bitmap.width + 1 >= MAX_ATLAS_WIDTH) {
-            oy += rowh;
-            rowh = 0;
-            ox = 0;
-        }
+    uint32_t count;
+    std::vector<char> data;
+    cString name = cString::sprintf("font-%016" PRIx64 ".glyphs", bitmapsKey);
+    if (!ReadCacheFile(name, bitmapsKey, count, data))
+        return;
 
-        GL_CHECK(glTexSubImage2D(
-            GL_TEXTURE_2D,
-            0,
-            ox,
-            oy,
-            bGlyph->bitmap.width,
-            bGlyph->bitmap.rows,
-            GL_LUMINANCE,
-            GL_UNSIGNED_BYTE,
-            bGlyph->bitmap.buffer
-        ));
-
-        float ax = bGlyph->root.advance.x >> 16; // AdvanceX
-        float ay = bGlyph->root.advance.y >> 16; // AdvanceX
-        float bw = bGlyph->bitmap.width; // Width
-        float bh = bGlyph->bitmap.rows; // Height
-        float bl = bGlyph->left; // BearingLeft
-        float bt = bGlyph->top; // BearingTop
-        float tx = ox / (float)w;
-        float ty = oy / (float)h;
-
-        Glyph[i] = new cOglAtlasGlyph(i, ax, ay, bw, bh, bl, bt, tx, ty);
-        rowh = std::max(rowh, (int)bGlyph->bitmap.rows);
-        ox += bGlyph->bitmap.width + 1;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sOglGlyphRecord r;
+        if (pos + sizeof(r) > data.size())
+            break;
+        memcpy(&r, &data[pos], sizeof(r));
+        pos += sizeof(r);
+        size_t n = (size_t)r.width * r.height;
+        if (pos + n > data.size() || bitmapsBytes + n + sizeof(r) > OGL_GLYPH_CACHE)
+            break;
 
-        FT_Done_Glyph(ftGlyph);
+        sBitmap &b = bitmaps[r.charCode];
+        b.advanceX = r.advanceX;
+        b.advanceY = r.advanceY;
+        b.left = r.left;
+        b.top = r.top;
+        b.width = r.width;
+        b.height = r.height;
+        b.pixels.assign(data.begin() + pos, data.begin() + pos + n);
+        bitmapsBytes += n + sizeof(r);
+        pos += n;
+    }
+    if (pos != data.size()) {
+        esyslog("[softhddev]glyph cache %s is damaged, rasterize again", *name);
+        bitmaps.clear();
+        bitmapsBytes = 0;
+        return;
     }
-
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
 #ifdef GL_DEBUG
-    fprintf(stderr, "Created a %d x %d (%d kB) FontAtlas for fontsize %d, rowh %d, roww %d\n", w, h, w * h / 1024, height, rowh, roww);
+    fprintf(stderr, "FontAtlas for fontsize %d: %d glyphs from cache\n", fontheight, count);
 #endif
 }
 
-cOglFontAtlas::~cOglFontAtlas(void) {
-    if (tex)
-        GL_CHECK(glDeleteTextures(1, &tex));
-}
-
-cOglAtlasGlyph* cOglFontAtlas::GetGlyph(int sym) const {
-    return Glyph[sym];
-}
+void cOglFontAtlas::SaveBitmaps(void) {
+    if (!bitmapsDirty || !bitmapsKey)
+        return;
 
-void cOglFontAtlas::BindTexture(void) {
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, tex));
+    std::vector<char> data;
+    for (auto it = bitmaps.begin(); it != bitmaps.end(); ++it) {
+        const sBitmap &b = it->second;
+        sOglGlyphRecord r = { (uint32_t)it->first, (int16_t)b.advanceX, (int16_t)b.advanceY,
+                              (int16_t)b.left, (int16_t)b.top, (uint16_t)b.width, (uint16_t)b.height };
+        data.insert(data.end(), (const char *)&r, (const char *)&r + sizeof(r));
+        data.insert(data.end(), b.pixels.begin(), b.pixels.end());
+    }
+    cString name = cString::sprintf("font-%016" PRIx64 ".glyphs", bitmapsKey);
+    WriteCacheFile(name, bitmapsKey, bitmaps.size(), data.data(), data.size());
+    bitmapsDirty = false;
 }
 
 /****************************************************************************************
@@ -680,9 +1201,12 @@ void cOglFontAtlas::BindTexture(void) {
 FT_Library cOglFont::ftLib = 0;
 cList<cOglFont> *cOglFont::fonts = 0;
 bool cOglFont::initiated = false;
+cMutex cOglFont::fontsMutex;
 
 cOglFont::cOglFont(const char *fontName, int charHeight) : name(fontName) {
     size = charHeight;
+    runHits = 0;
+    runMisses = 0;
     height = 0;
     bottom = 0;
 
@@ -709,13 +1233,14 @@ cOglFont::cOglFont(const char *fontName, int charHeight) : name(fontName) {
     FT_Set_Char_Size(face, 0, charHeight * 64, 0, 0);
     height = (face->size->metrics.ascender - face->size->metrics.descender + 63) / 64;
     bottom = abs((face->size->metrics.descender - 63) / 64);
-    this->atlas = new cOglFontAtlas(face, charHeight);
+    this->atlas = new cOglFontAtlas(face, fontName, charHeight);
 #ifdef GL_DEBUG
     fprintf(stderr, "Created new font: %s (%d) height: %d, bottom: %d - %d chars (%d - %d)\n", fontName, charHeight, height, bottom, count, min_index, max_index);
 #endif
 }
 
 cOglFont::~cOglFont(void) {
+    delete atlas;
     FT_Done_Face(face);
 }
 
@@ -729,6 +1254,7 @@ cOglFont *cOglFont::Get(const char *name, int charHeight) {
             return font;
         }
     font = new cOglFont(name, charHeight);
+    cMutexLock lock(&fontsMutex);
     fonts->Add(font);
     return font;
 }
@@ -745,107 +1271,168 @@ void cOglFont::Init(void) {
 void cOglFont::Cleanup(void) {
     if (!initiated)
         return;
+    fontsMutex.Lock();
     delete fonts;
     fonts = 0;
+    fontsMutex.Unlock();
     if (ftLib && FT_Done_FreeType(ftLib))
         esyslog("failed to deinitialize FreeType library!");
 
     ftLib = 0;
 }
 
-cOglGlyph* cOglFont::Glyph(FT_ULong charCode) const {
-    // Non-breaking space:
-    if (charCode == 0xA0)
-        charCode = 0x20;
-
-    // Lookup in cache:
-    for (cOglGlyph *g = glyphCache.First(); g; g = glyphCache.Next(g)) {
-        if (g->CharCode() == charCode) {
-            return g;
+int cOglFont::AtlasKerning(cOglAtlasGlyph *glyph, FT_ULong prevSym) const {
+    int kerning = 0;
+    if (glyph && prevSym) {
+        kerning = glyph->GetKerningCache(prevSym);
+        if (kerning == KERNING_UNKNOWN) {
+            FT_Vector delta;
+            FT_UInt glyph_index = FT_Get_Char_Index(face, glyph->CharCode());
+            FT_UInt glyph_index_prev = FT_Get_Char_Index(face, prevSym);
+            FT_Get_Kerning(face, glyph_index_prev, glyph_index, FT_KERNING_DEFAULT, &delta);
+            kerning = delta.x / 64;
+            glyph->SetKerningCache(prevSym, kerning);
         }
     }
+    return kerning;
+}
 
-    FT_UInt glyph_index = FT_Get_Char_Index(face, charCode);
+uint64_t cOglFont::RunHash(const unsigned int *symbols, GLint limit, GLint clip) {
+    uint64_t hash = 14695981039346656037ULL;
 
-    FT_Int32 loadFlags = FT_LOAD_NO_BITMAP;
-    // Load glyph image into the slot (erase previous one):
-    int error = FT_Load_Glyph(face, glyph_index, loadFlags);
-    if (error) {
-        esyslog("[softhddev]FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
-        return NULL;
+    for (int i = 0; symbols[i]; i++)
+        hash = (hash ^ symbols[i]) * 1099511628211ULL;
+    hash = (hash ^ (uint32_t)limit) * 1099511628211ULL;
+    hash = (hash ^ (uint32_t)clip) * 1099511628211ULL;
+    return hash;
+}
+
+const sOglTextRun *cOglFont::FindRun(uint64_t hash, const unsigned int *symbols, GLint limit, GLint clip) {
+    auto it = runIndex.find(hash);
+    if (it != runIndex.end()) {
+        sOglTextRun &run = *it->second;
+        size_t n = run.symbols.size();
+        // glyphs of an evicted atlas page have moved
+        if (run.generation == atlas->Generation() && run.limit == limit && run.clip == clip &&
+            !memcmp(run.symbols.data(), symbols, n * sizeof(unsigned int)) && !symbols[n]) {
+            runs.splice(runs.begin(), runs, it->second);
+            runHits++;
+            return &run;
+        }
+        runs.erase(it->second);
+        runIndex.erase(it);
     }
+    runMisses++;
+    return NULL;
+}
 
-    FT_Glyph ftGlyph;
-    FT_Stroker stroker;
-    error = FT_Stroker_New( ftLib, &stroker );
-    if (error) {
-        esyslog("[softhddev]FT_Stroker_New FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
+const sOglTextRun *cOglFont::AddRun(uint64_t hash, const unsigned int *symbols, GLint limit, GLint clip, std::vector<GLfloat> *quads,
+                                    std::vector<cOglAtlasGlyph *> &glyphs) {
+    if (runIndex.find(hash) != runIndex.end())
         return NULL;
+
+    if (runs.size() >= OGL_TEXT_RUNS) {
+        runIndex.erase(runs.back().hash);
+        runs.pop_back();
     }
-    float outlineWidth = 0.25f;
-    FT_Stroker_Set(stroker,
-                    (int)(outlineWidth * 64),
-                    FT_STROKER_LINECAP_ROUND,
-                    FT_STROKER_LINEJOIN_ROUND,
-                    0);
 
+    runs.push_front(sOglTextRun());
+    sOglTextRun &run = runs.front();
+    run.hash = hash;
+    for (int i = 0; symbols[i]; i++)
+        run.symbols.push_back(symbols[i]);
+    run.limit = limit;
+    run.clip = clip;
+    run.generation = atlas->Generation();
+    for (int i = 0; i < OGL_ATLAS_PAGES; i++)
+        run.quads[i].swap(quads[i]);
+    run.glyphs.swap(glyphs);
+    runIndex[hash] = runs.begin();
+    return &run;
+}
 
-    error = FT_Get_Glyph(face->glyph, &ftGlyph);
-    if (error) {
-        esyslog("[softhddev]FT_Get_Glyph FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
-        return NULL;
-    }
+cString cOglFont::GetRunCacheStats(void) {
+    cMutexLock lock(&fontsMutex);
+    cString stats("");
 
-    error = FT_Glyph_StrokeBorder( &ftGlyph, stroker, 0, 1 );
-    if ( error ) {
-        esyslog("[softhddev]FT_Glyph_StrokeBorder FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
-        return NULL;
-    }
-    FT_Stroker_Done(stroker);
+    if (!fonts)
+        return stats;
+    for (cOglFont *font = fonts->First(); font; font = fonts->Next(font)) {
+        int lookups = font->runHits + font->runMisses;
+        const char *name = strrchr(font->Name(), '/');
 
-    error = FT_Glyph_To_Bitmap( &ftGlyph, FT_RENDER_MODE_NORMAL, 0, 1);
-    if (error) {
-        esyslog("[softhddev]FT_Glyph_To_Bitmap FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
-        return NULL;
+        stats = cString::sprintf("%s\ntext cache %s %d: hits %d misses %d (%d%%)", *stats,
+                                 name ? name + 1 : font->Name(), font->Size(),
+                                 font->runHits, font->runMisses, lookups ? font->runHits * 100 / lookups : 0);
     }
+    return stats;
+}
 
-    cOglGlyph *Glyph = new cOglGlyph(charCode, (FT_BitmapGlyph)ftGlyph);
-    glyphCache.Add(Glyph);
-    FT_Done_Glyph(ftGlyph);
+/****************************************************************************************
+* cOglFbPool
+****************************************************************************************/
+static cOglFbPool FbPool;
 
-    return Glyph;
+cOglFbPool::cOglFbPool(void) {
+    pooled = 0;
+    hits = 0;
+    misses = 0;
 }
 
-int cOglFont::Kerning(cOglGlyph *glyph, FT_ULong prevSym) const {
-    int kerning = 0;
-    if (glyph && prevSym) {
-        kerning = glyph->GetKerningCache(prevSym);
-        if (kerning == KERNING_UNKNOWN) {
-            FT_Vector delta;
-            FT_UInt glyph_index = FT_Get_Char_Index(face, glyph->CharCode());
-            FT_UInt glyph_index_prev = FT_Get_Char_Index(face, prevSym);
-            FT_Get_Kerning(face, glyph_index_prev, glyph_index, FT_KERNING_DEFAULT, &delta);
-            kerning = delta.x / 64;
-            glyph->SetKerningCache(prevSym, kerning);
+void cOglFbPool::Delete(const sEntry &entry) {
+    GL_CHECK(glDeleteTextures(1, &entry.texture));
+    GL_CHECK(glDeleteFramebuffers(1, &entry.fb));
+}
+
+bool cOglFbPool::Get(GLint width, GLint height, GLuint &fb, GLuint &texture) {
+    cMutexLock MutexLock(&mutex);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->width == width && it->height == height) {
+            fb = it->fb;
+            texture = it->texture;
+            pooled -= width * height * 4;
+            entries.erase(it);
+            hits++;
+            return true;
         }
     }
-    return kerning;
+    misses++;
+    return false;
 }
 
-int cOglFont::AtlasKerning(cOglAtlasGlyph *glyph, FT_ULong prevSym) const {
-    int kerning = 0;
-    if (glyph && prevSym) {
-        kerning = glyph->GetKerningCache(prevSym);
-        if (kerning == KERNING_UNKNOWN) {
-            FT_Vector delta;
-            FT_UInt glyph_index = FT_Get_Char_Index(face, glyph->CharCode());
-            FT_UInt glyph_index_prev = FT_Get_Char_Index(face, prevSym);
-            FT_Get_Kerning(face, glyph_index_prev, glyph_index, FT_KERNING_DEFAULT, &delta);
-            kerning = delta.x / 64;
-            glyph->SetKerningCache(prevSym, kerning);
-        }
+void cOglFbPool::Put(GLint width, GLint height, GLuint fb, GLuint texture) {
+    cMutexLock MutexLock(&mutex);
+    sEntry entry = { fb, texture, width, height };
+    long size = width * height * 4;
+
+    if (size > OGL_FB_POOL_SIZE) {
+        Delete(entry);
+        return;
     }
-    return kerning;
+    // drop the longest unused first
+    while (!entries.empty() && pooled + size > OGL_FB_POOL_SIZE) {
+        const sEntry &last = entries.back();
+        pooled -= last.width * last.height * 4;
+        Delete(last);
+        entries.pop_back();
+    }
+    entries.push_front(entry);
+    pooled += size;
+}
+
+void cOglFbPool::Clear(void) {
+    cMutexLock MutexLock(&mutex);
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+        Delete(*it);
+    entries.clear();
+    pooled = 0;
+}
+
+void cOglFbPool::GetStats(int *hits, int *misses, long *pooled) {
+    cMutexLock MutexLock(&mutex);
+    *hits = this->hits;
+    *misses = this->misses;
+    *pooled = this->pooled;
 }
 
 /****************************************************************************************
@@ -866,6 +1453,10 @@ cOglFb::cOglFb(GLint width, GLint height, GLint viewPortWidth, GLint viewPortHei
 }
 
 cOglFb::~cOglFb(void) {
+    if (texture && fb) {
+        FbPool.Put(width, height, fb, texture);
+        return;
+    }
     if (texture)
         GL_CHECK(glDeleteTextures(1, &texture));
     if (fb)
@@ -874,6 +1465,20 @@ cOglFb::~cOglFb(void) {
 
 bool cOglFb::Init(void) {
     initiated = true;
+    if (FbPool.Get(width, height, fb, texture)) {
+        // pooled framebuffers still hold the old pixmap, cleared when taken
+        GLboolean scissor;
+        GL_CHECK(scissor = glIsEnabled(GL_SCISSOR_TEST));
+        GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+        if (scissor)
+            GL_CHECK(glDisable(GL_SCISSOR_TEST));
+        GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+        if (scissor)
+            GL_CHECK(glEnable(GL_SCISSOR_TEST));
+        return true;
+    }
+
     GL_CHECK(glGenTextures(1, &texture));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
     GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
@@ -890,6 +1495,9 @@ bool cOglFb::Init(void) {
     GL_CHECK(fbstatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
     if(fbstatus != GL_FRAMEBUFFER_COMPLETE) {
         esyslog("[softhddev]ERROR: Framebuffer is not complete!\n");
+        // never pooled
+        GL_CHECK(glDeleteFramebuffers(1, &fb));
+        fb = 0;
         return false;
     }
     return true;
@@ -922,6 +1530,10 @@ bool cOglFb::BindTexture(void) {
     return true;
 }
 
+void cOglFb::GetPoolStats(int *hits, int *misses, long *pooled) {
+    FbPool.GetStats(hits, misses, pooled);
+}
+
 
 /****************************************************************************************
 * cOglOutputFb
@@ -939,6 +1551,9 @@ cOglOutputFb::~cOglOutputFb(void) {
         GL_CHECK(glDeleteTextures(1, &texture));
     if (fb)
         GL_CHECK(glDeleteFramebuffers(1, &fb));
+    // deleted, keep ~cOglFb from pooling them
+    texture = 0;
+    fb = 0;
 }
 
 bool cOglOutputFb::Init(void) {
@@ -965,6 +1580,25 @@ bool cOglOutputFb::Init(void) {
     return true;
 }
 
+/*
+ * Remember the damage of the frame about to be swapped and return the area
+ * which has to be redrawn into a back buffer age frames old. Age 0 means
+ * unknown buffer content, everything is redrawn.
+ */
+cRect cOglOutputFb::Damage(const cRect &rect, int age) {
+    cRect area = rect;
+    if (age <= 0 || age > OGL_DAMAGE_HISTORY)
+        area = cRect(0, 0, width, height);
+    else
+        for (int i = 0; i < age - 1; i++)
+            area.Combine(damageHistory[i]);
+
+    for (int i = OGL_DAMAGE_HISTORY - 1; i > 0; i--)
+        damageHistory[i] = damageHistory[i - 1];
+    damageHistory[0] = rect;
+    return area;
+}
+
 void cOglOutputFb::BindWrite(void) {
     if (!initiated)
         Init();
@@ -978,6 +1612,28 @@ void cOglOutputFb::Unbind(void) {
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 }
 
+/****************************************************************************************
+* Scratch framebuffer
+* Ping-pong buffer for copies inside one framebuffer, grows as needed
+****************************************************************************************/
+static cOglFb *scratchFb = NULL;
+
+static cOglFb *ScratchFb(GLint width, GLint height) {
+    if (scratchFb && scratchFb->Width() >= width && scratchFb->Height() >= height)
+        return scratchFb;
+    if (scratchFb) {
+        width = std::max(width, scratchFb->Width());
+        height = std::max(height, scratchFb->Height());
+        delete scratchFb;
+    }
+    scratchFb = new cOglFb(width, height, width, height);
+    if (!scratchFb->Init()) {
+        delete scratchFb;
+        scratchFb = NULL;
+    }
+    return scratchFb;
+}
+
 /****************************************************************************************
 * cOglVb
 ****************************************************************************************/
@@ -1013,34 +1669,6 @@ bool cOglVb::Init(void) {
         numVertices = 6;
         drawMode = GL_TRIANGLES;
         shader = stTextureSwapBR;
-    } else if (type == vbRect) {
-        //Rectangle VBO definition
-        sizeVertex1 = 2;
-        sizeVertex2 = 0;
-        numVertices = 4;
-        drawMode = GL_TRIANGLE_FAN;
-        shader = stRect;
-    } else if (type == vbEllipse) {
-        //Ellipse VBO definition
-        sizeVertex1 = 2;
-        sizeVertex2 = 0;
-        numVertices = 182;
-        drawMode = GL_TRIANGLE_FAN;
-        shader = stRect;
-    } else if (type == vbSlope) {
-        //Slope VBO definition
-        sizeVertex1 = 2;
-        sizeVertex2 = 0;
-        numVertices = 102;
-        drawMode = GL_TRIANGLE_FAN;
-        shader = stRect;
-    } else if (type == vbText) {
-        //Text VBO definition
-        sizeVertex1 = 2;
-        sizeVertex2 = 2;
-        numVertices = 6;
-        drawMode = GL_TRIANGLES;
-        shader = stText;
     }
 
     GL_CHECK(glGenBuffers(1, &vbo));
@@ -1087,12 +1715,6 @@ void cOglVb::DisableBlending(void) {
     GL_CHECK(glDisable(GL_BLEND));
 }
 
-void cOglVb::SetShaderColor(GLint color) {
-    glm::vec4 col;
-    ConvertColor(color, col);
-    Shaders[shader]->SetVector4f("inColor", col.r, col.g, col.b, col.a);
-}
-
 void cOglVb::SetShaderBorderColor(GLint color) {
     glm::vec4 col;
     ConvertColor(color, col);
@@ -1108,8 +1730,7 @@ void cOglVb::SetShaderAlpha(GLint alpha) {
 }
 
 void cOglVb::SetShaderProjectionMatrix(GLint width, GLint height) {
-    glm::mat4 projection = glm::ortho(0.0f, (GLfloat)width, (GLfloat)height, 0.0f, -1.0f, 1.0f);
-    Shaders[shader]->SetMatrix4("projection", projection);
+    Shaders[shader]->SetProjectionMatrix(width, height);
 }
 
 void cOglVb::SetVertexSubData(GLfloat *vertices, int count) {
@@ -1134,6 +1755,138 @@ void cOglVb::DrawArrays(int count) {
     GL_CHECK(glDrawArrays(drawMode, 0, count));
 }
 
+/****************************************************************************************
+* cOglBatch
+****************************************************************************************/
+cOglBatch::cOglBatch(void) {
+    vbo = 0;
+    capacity = 0;
+    shader = stRect;
+    fb = NULL;
+    texture = 0;
+}
+
+cOglBatch::~cOglBatch(void) {
+    if (vbo)
+        GL_CHECK(glDeleteBuffers(1, &vbo));
+}
+
+bool cOglBatch::Init(void) {
+    GL_CHECK(glGenBuffers(1, &vbo));
+    capacity = OGL_BATCH_VERTICES;
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(sOglVertex) * capacity, NULL, GL_STREAM_DRAW));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    vertices.reserve(OGL_BATCH_VERTICES);
+    return true;
+}
+
+sOglVertex *cOglBatch::Reserve(eShaderType shader, cOglFb *fb, GLuint texture, int count) {
+    if (!vertices.empty() &&
+        (shader != this->shader || fb != this->fb || texture != this->texture ||
+         vertices.size() + count > OGL_BATCH_VERTICES))
+        Flush();
+
+    this->shader = shader;
+    this->fb = fb;
+    this->texture = texture;
+    size_t n = vertices.size();
+    vertices.resize(n + count);
+    return &vertices[n];
+}
+
+void cOglBatch::AddTriangleFan(cOglFb *fb, GLint color, const GLfloat *xy, int count,
+                               GLfloat x, GLfloat y, GLfloat scaleX, GLfloat scaleY) {
+    if (count < 3)
+        return;
+
+    GLubyte a = (color >> 24) & 0xFF;
+    GLubyte r = (color >> 16) & 0xFF;
+    GLubyte g = (color >> 8) & 0xFF;
+    GLubyte b = color & 0xFF;
+
+    // fans can't be merged, split them into a triangle list
+    sOglVertex *v = Reserve(stRect, fb, 0, (count - 2) * 3);
+    for (int i = 1; i < count - 1; i++) {
+        const GLfloat *p[3] = { xy, xy + 2 * i, xy + 2 * (i + 1) };
+        for (int j = 0; j < 3; j++, v++) {
+            v->x = x + p[j][0] * scaleX;
+            v->y = y + p[j][1] * scaleY;
+            v->u = 0.0f;
+            v->v = 0.0f;
+            v->r = r;
+            v->g = g;
+            v->b = b;
+            v->a = a;
+        }
+    }
+}
+
+void cOglBatch::AddTriangles(cOglFb *fb, GLuint texture, GLint color, const GLfloat *xyuv, int count, GLfloat x, GLfloat y) {
+    if (count < 3)
+        return;
+
+    GLubyte a = (color >> 24) & 0xFF;
+    GLubyte r = (color >> 16) & 0xFF;
+    GLubyte g = (color >> 8) & 0xFF;
+    GLubyte b = color & 0xFF;
+
+    sOglVertex *v = Reserve(stText, fb, texture, count);
+    for (int i = 0; i < count; i++, v++, xyuv += 4) {
+        v->x = x + xyuv[0];
+        v->y = y + xyuv[1];
+        v->u = xyuv[2];
+        v->v = xyuv[3];
+        v->r = r;
+        v->g = g;
+        v->b = b;
+        v->a = a;
+    }
+}
+
+void cOglBatch::Flush(void) {
+    if (vertices.empty())
+        return;
+
+    int count = vertices.size();
+
+    Shaders[shader]->Use();
+    Shaders[shader]->SetProjectionMatrix(fb->Width(), fb->Height());
+    fb->Bind();
+
+    // rectangles, ellipses and slopes are not antialiased
+    if (shader == stRect)
+        GL_CHECK(glDisable(GL_BLEND));
+
+    // orphan the buffer, the driver needn't wait for the previous draw
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+    if (count > capacity)
+        capacity = count;
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(sOglVertex) * capacity, NULL, GL_STREAM_DRAW));
+    GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(sOglVertex) * count, &vertices[0]));
+
+    GL_CHECK(glEnableVertexAttribArray(0));
+    GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(sOglVertex), (GLvoid*)offsetof(sOglVertex, x)));
+    GL_CHECK(glEnableVertexAttribArray(1));
+    GL_CHECK(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(sOglVertex), (GLvoid*)offsetof(sOglVertex, u)));
+    GL_CHECK(glEnableVertexAttribArray(2));
+    GL_CHECK(glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(sOglVertex), (GLvoid*)offsetof(sOglVertex, r)));
+
+    if (texture)
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+    GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, count));
+    if (texture)
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+
+    GL_CHECK(glDisableVertexAttribArray(2));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    if (shader == stRect)
+        GL_CHECK(glEnable(GL_BLEND));
+    fb->Unbind();
+
+    vertices.clear();
+}
+
 
 /****************************************************************************************
 * cOpenGLCmd
@@ -1162,6 +1915,16 @@ bool cOglCmdInitFb::Execute(void) {
     return ok;
 }
 
+//------------------ cOglCmdSync --------------------
+cOglCmdSync::cOglCmdSync(cCondWait *wait) : cOglCmd(NULL) {
+    this->wait = wait;
+}
+
+bool cOglCmdSync::Execute(void) {
+    wait->Signal();
+    return true;
+}
+
 //------------------ cOglCmdDeleteFb --------------------
 cOglCmdDeleteFb::cOglCmdDeleteFb(cOglFb *fb) : cOglCmd(fb) {
 }
@@ -1173,8 +1936,9 @@ bool cOglCmdDeleteFb::Execute(void) {
 }
 
 //------------------ cOglCmdRenderFbToBufferFb --------------------
-cOglCmdRenderFbToBufferFb::cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer, GLint x, GLint y, GLint transparency, GLint drawPortX, GLint drawPortY) : cOglCmd(fb) {
+cOglCmdRenderFbToBufferFb::cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer, GLint x, GLint y, GLint transparency, GLint drawPortX, GLint drawPortY, const cRect &clip) : cOglCmd(fb) {
     this->buffer = buffer;
+    this->clip = clip;
     this->x = (GLfloat)x;
     this->y = (GLfloat)y;
     this->drawPortX = (GLfloat)drawPortX;
@@ -1183,7 +1947,9 @@ cOglCmdRenderFbToBufferFb::cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer,
     this->bcolor = BORDERCOLOR;
 }
 
-bool cOglCmdRenderFbToBufferFb::Execute(void) {
+// draw the visible part of a pixmap framebuffer to the bound target of the given size
+static bool DrawFbTexture(cOglFb *fb, GLint width, GLint height, GLfloat x, GLfloat y, GLint transparency,
+                          GLfloat drawPortX, GLfloat drawPortY, GLint bcolor) {
     GLfloat x2 = x + fb->ViewportWidth();  //right
     GLfloat y2 = y + fb->ViewportHeight(); //bottom
 
@@ -1213,24 +1979,70 @@ bool cOglCmdRenderFbToBufferFb::Execute(void) {
 
     VertexBuffers[vbTexture]->ActivateShader();
     VertexBuffers[vbTexture]->SetShaderAlpha(transparency);
-    VertexBuffers[vbTexture]->SetShaderProjectionMatrix(buffer->Width(), buffer->Height());
+    VertexBuffers[vbTexture]->SetShaderProjectionMatrix(width, height);
     VertexBuffers[vbTexture]->SetShaderBorderColor(bcolor);
 
-    buffer->Bind();
     if (!fb->BindTexture())
         return false;
     VertexBuffers[vbTexture]->Bind();
     VertexBuffers[vbTexture]->SetVertexSubData(quadVertices);
     VertexBuffers[vbTexture]->DrawArrays();
     VertexBuffers[vbTexture]->Unbind();
-    buffer->Unbind();
 
     return true;
 }
 
+bool cOglCmdRenderFbToBufferFb::Execute(void) {
+    buffer->Bind();
+    if (!clip.IsEmpty())
+        EnableScissor(clip, buffer->Height());
+    bool ok = DrawFbTexture(fb, buffer->Width(), buffer->Height(), x, y, transparency, drawPortX, drawPortY, bcolor);
+    if (!clip.IsEmpty())
+        DisableScissor();
+    buffer->Unbind();
+
+    return ok;
+}
+
+// area of the output back buffer to redraw for the damage, all without damage
+static cRect OutputArea(cOglOutputFb *oFb, const cRect &damage) {
+    // the back buffer misses the damage of the frames since it was shown
+    cRect area(0, 0, oFb->Width(), oFb->Height());
+    if (!damage.IsEmpty())
+        area = oFb->Damage(damage.Intersected(area), GlContext->BufferAge());
+    else
+        oFb->Damage(area, 0);
+    return area;
+}
+
+// swap the output framebuffer to the osd plane or close the osd
+static void PresentOutputFb(cOglOutputFb *oFb, int active) {
+    GlContext->Present(oFb->Width(), oFb->Height(), active);
+
+    // Read back framebuffer
+#ifdef WRITE_PNG
+    GL_CHECK(glFinish());
+    GLubyte result[oFb->Width() * oFb->Height() * 4];
+    static int scr_nr = 0;
+    char filename[18];
+
+    GLenum fbstatus;
+    GL_CHECK(fbstatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    if(fbstatus != GL_FRAMEBUFFER_COMPLETE)
+        esyslog("[softhddev]ERROR: Framebuffer is not complete! %d\n", fbstatus);
+
+    GL_CHECK(glReadPixels(0, 0, oFb->Width(), oFb->Height(), GL_RGBA, GL_UNSIGNED_BYTE, &result));
+    if (result) {
+        snprintf(filename, sizeof(filename), "texture%03d.png", scr_nr++);
+        writeImage(filename, oFb->Width(), oFb->Height(), &result, "osd");
+    }
+#endif
+}
+
 //------------------ cOglCmdCopyBufferToOutputFb --------------------
-cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active) : cOglCmd(fb) {
+cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active, const cRect &damage) : cOglCmd(fb) {
     this->oFb = oFb;
+    this->damage = damage;
     this->x = (GLfloat)x;
     this->y = (GLfloat)y;
     this->bcolor = BORDERCOLOR;
@@ -1238,12 +2050,6 @@ cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputF
 }
 
 bool cOglCmdCopyBufferToOutputFb::Execute(void) {
-    VideoRender *render = (VideoRender *)GetVideoRender();
-    if (!render) {
-        fprintf(stderr, "failed to get VideoRender\n");
-        abort();
-    }
-
     GLfloat x2 = x + (GLfloat)fb->Width();
     GLfloat y2 = y + (GLfloat)fb->Height();
 
@@ -1272,50 +2078,90 @@ bool cOglCmdCopyBufferToOutputFb::Execute(void) {
     if (!fb->BindTexture())
         return false;
 
+    // without damage the output is cleared and redrawn completely,
+    // otherwise only the damage plus what the back buffer is missing
+    cRect area = OutputArea(oFb, damage.IsEmpty() ? cRect::Null : damage.Shifted(x, y));
+
+    // the buffer holds premultiplied colors already, same output as direct composition
+    EnableScissor(area, oFb->Height());
+    GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+    GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+    VertexBuffers[vbTexture]->DisableBlending();
     VertexBuffers[vbTexture]->Bind();
     VertexBuffers[vbTexture]->SetVertexSubData(quadVertices);
     VertexBuffers[vbTexture]->DrawArrays();
     VertexBuffers[vbTexture]->Unbind();
+    VertexBuffers[vbTexture]->EnableBlending();
+    DisableScissor();
 
-    GL_CHECK(glFinish());
-    // eglSwapBuffers and gbm_surface_lock_front_buffer in OsdDrawARGB()
-    if (active)
-        OsdDrawARGB(0, 0, oFb->Width(), oFb->Height(), 0, 0, 0, 0);
-    else
-        OsdClose();
+    PresentOutputFb(oFb, active);
+    return true;
+}
 
-    // Read back framebuffer
-#ifdef WRITE_PNG
-    GL_CHECK(glFinish());
-    GLubyte result[oFb->Width() * oFb->Height() * 4];
-    static int scr_nr = 0;
-    char filename[18];
+//------------------ cOglCmdCompositeToOutputFb --------------------
+cOglCmdCompositeToOutputFb::cOglCmdCompositeToOutputFb(cOglOutputFb *oFb, sOglLayer *layers, int numLayers, cRect *damage, int numDamage, int active) : cOglCmd(NULL) {
+    this->oFb = oFb;
+    this->layers = layers;
+    this->numLayers = numLayers;
+    this->damage = damage;
+    this->numDamage = numDamage;
+    this->active = active;
+}
 
-    GLenum fbstatus;
-    GL_CHECK(fbstatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-    if(fbstatus != GL_FRAMEBUFFER_COMPLETE)
-        esyslog("[softhddev]ERROR: Framebuffer is not complete! %d\n", fbstatus);
+cOglCmdCompositeToOutputFb::~cOglCmdCompositeToOutputFb(void) {
+    delete[] layers;
+    delete[] damage;
+}
 
-    GL_CHECK(glReadPixels(0, 0, oFb->Width(), oFb->Height(), GL_RGBA, GL_UNSIGNED_BYTE, &result));
-    if (result) {
-        snprintf(filename, sizeof(filename), "texture%03d.png", scr_nr++);
-        writeImage(filename, oFb->Width(), oFb->Height(), &result, "osd");
+bool cOglCmdCompositeToOutputFb::Execute(void) {
+    cRect bounds;
+    for (int d = 0; d < numDamage; d++)
+        bounds.Combine(damage[d]);
+
+    // if the back buffer misses older damage, redraw the whole area at once
+    cRect area = OutputArea(oFb, bounds);
+    const cRect *rects = damage;
+    int n = numDamage;
+    if (!n || area != bounds) {
+        rects = &area;
+        n = 1;
     }
-#endif
+
+    GL_CHECK(glViewport(0, 0, oFb->Width(), oFb->Height()));
+    GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+    for (int d = 0; d < n; d++) {
+        EnableScissor(rects[d], oFb->Height());
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+        //only the layers inside the cleared rectangle, the others are intact
+        for (int i = 0; i < numLayers; i++) {
+            sOglLayer &l = layers[i];
+            if (!rects[d].Intersects(cRect(l.x, l.y, l.fb->ViewportWidth(), l.fb->ViewportHeight())))
+                continue;
+            DrawFbTexture(l.fb, oFb->Width(), oFb->Height(), l.x, l.y, l.alpha, l.drawPortX, l.drawPortY, BORDERCOLOR);
+        }
+    }
+    DisableScissor();
+
+    PresentOutputFb(oFb, active);
     return true;
 }
 
 //------------------ cOglCmdFill --------------------
-cOglCmdFill::cOglCmdFill(cOglFb *fb, GLint color) : cOglCmd(fb) {
+cOglCmdFill::cOglCmdFill(cOglFb *fb, GLint color, const cRect &clip) : cOglCmd(fb) {
     this->color = color;
+    this->clip = clip;
 }
 
 bool cOglCmdFill::Execute(void) {
     glm::vec4 col;
     ConvertColor(color, col);
     fb->Bind();
+    if (!clip.IsEmpty())
+        EnableScissor(clip, fb->Height());
     GL_CHECK(glClearColor(col.r, col.g, col.b, col.a));
     GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+    if (!clip.IsEmpty())
+        DisableScissor();
     fb->Unbind();
     return true;
 }
@@ -1355,18 +2201,7 @@ bool cOglCmdDrawRectangle::Execute(void) {
         x1, y2     //left bottom
     };
 
-    VertexBuffers[vbRect]->ActivateShader();
-    VertexBuffers[vbRect]->SetShaderColor(color);
-    VertexBuffers[vbRect]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
-
-    fb->Bind();
-    VertexBuffers[vbRect]->DisableBlending();
-    VertexBuffers[vbRect]->Bind();
-    VertexBuffers[vbRect]->SetVertexSubData(vertices);
-    VertexBuffers[vbRect]->DrawArrays();
-    VertexBuffers[vbRect]->Unbind();
-    VertexBuffers[vbRect]->EnableBlending();
-    fb->Unbind();
+    Batch->AddTriangleFan(fb, color, vertices, 4);
 
     return true;
 }
@@ -1386,175 +2221,101 @@ cOglCmdDrawEllipse::cOglCmdDrawEllipse( cOglFb *fb, GLint x, GLint y, GLint widt
     this->quadrants = quadrants;
 }
 
-bool cOglCmdDrawEllipse::Execute(void) {
-    int numVertices = 0;
-    GLfloat *vertices = NULL;
-
-    switch (quadrants) {
-        case 0:
-            vertices = CreateVerticesFull(numVertices);
-            break;
-        case 1: case 2: case 3: case 4: case -1: case -2: case -3: case -4:
-            vertices = CreateVerticesQuadrant(numVertices);
-            break;
-        case 5: case 6: case 7: case 8:
-            vertices = CreateVerticesHalf(numVertices);
-            break;
-        default:
-            break;
-    }
+// Ellipses and slopes are tessellated once in a unit box and scaled to the target
+// rectangle while they are added to the batch.
+#define OGL_ELLIPSE_TYPES 13        // quadrants -4..8
+#define OGL_SLOPE_TYPES 16          // types 0..7 with 25 or 100 steps
 
-    VertexBuffers[vbEllipse]->ActivateShader();
-    VertexBuffers[vbEllipse]->SetShaderColor(color);
-    VertexBuffers[vbEllipse]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+static std::vector<GLfloat> ellipseTessellation[OGL_ELLIPSE_TYPES];
+static std::vector<GLfloat> slopeTessellation[OGL_SLOPE_TYPES];
 
-    //not antialiased
-    fb->Bind();
-    VertexBuffers[vbEllipse]->DisableBlending();
-    VertexBuffers[vbEllipse]->Bind();
-    VertexBuffers[vbEllipse]->SetVertexSubData(vertices, numVertices);
-    VertexBuffers[vbEllipse]->DrawArrays(numVertices);
-    VertexBuffers[vbEllipse]->Unbind();
-    VertexBuffers[vbEllipse]->EnableBlending();
-    fb->Unbind();
+static const std::vector<GLfloat> &EllipseTessellation(int quadrants) {
+    std::vector<GLfloat> &v = ellipseTessellation[quadrants + 4];
+    if (!v.empty())
+        return v;
 
-    delete[] vertices;
-    return true;
-}
+    // start vertex, center, radius and start angle of the arc
+    GLfloat x0 = 0.5f, y0 = 0.5f;
+    GLfloat cx = 0.5f, cy = 0.5f;
+    GLfloat rx = 1.0f, ry = 1.0f;
+    int startAngle = 0;
+    int steps = 0;
 
-GLfloat *cOglCmdDrawEllipse::CreateVerticesFull(int &numVertices) {
-    int size = 364;
-    numVertices = size/2;
-    GLfloat radiusX = (GLfloat)width/2;
-    GLfloat radiusY = (GLfloat)height/2;
-    GLfloat *vertices = new GLfloat[size];
-    vertices[0] = x + radiusX;
-    vertices[1] = y + radiusY;
-    for (int i=0; i <= 180; i++) {
-        vertices[2*i+2] = x + radiusX + (GLfloat)cos(2*i * M_PI / 180.0f)*radiusX;
-        vertices[2*i+3] = y + radiusY - (GLfloat)sin(2*i * M_PI / 180.0f)*radiusY;
-    }
-    return vertices;
-}
-
-GLfloat *cOglCmdDrawEllipse::CreateVerticesQuadrant(int &numVertices) {
-    int size = 94;
-    numVertices = size/2;
-    GLfloat radiusX = (GLfloat)width;
-    GLfloat radiusY = (GLfloat)height;
-    GLint transX = 0;
-    GLint transY = 0;
-    GLint startAngle = 0;
-    GLfloat *vertices = new GLfloat[size];
     switch (quadrants) {
-        case 1:
-            vertices[0] = x;
-            vertices[1] = y + height;
-            transY = radiusY;
-            break;
-        case 2:
-            vertices[0] = x + width;
-            vertices[1] = y + height;
-            transX = radiusX;
-            transY = radiusY;
-            startAngle = 90;
-            break;
-        case 3:
-            vertices[0] = x + width;
-            vertices[1] = y;
-            transX = radiusX;
-            startAngle = 180;
-            break;
-        case 4:
-            vertices[0] = x;
-            vertices[1] = y;
-            startAngle = 270;
-            break;
-        case -1:
-            vertices[0] = x + width;
-            vertices[1] = y;
-            transY = radiusY;
-            break;
-        case -2:
-            vertices[0] = x;
-            vertices[1] = y;
-            transX = radiusX;
-            transY = radiusY;
-            startAngle = 90;
-            break;
-        case -3:
-            vertices[0] = x;
-            vertices[1] = y + height;
-            transX = radiusX;
-            startAngle = 180;
-            break;
-        case -4:
-            vertices[0] = x + width;
-            vertices[1] = y + height;
-            startAngle = 270;
-            break;            
-        default:
-            break;
-    }
-    for (int i=0; i <= 45; i++) {
-        vertices[2*i+2] = x + transX + (GLfloat)cos((2*i + startAngle) * M_PI / 180.0f)*radiusX;
-        vertices[2*i+3] = y + transY - (GLfloat)sin((2*i + startAngle) * M_PI / 180.0f)*radiusY;
+        case 0:  rx = 0.5f; ry = 0.5f; steps = 180; break;
+        case 1:  x0 = 0; y0 = 1; cx = 0; cy = 1; startAngle = 0;   steps = 45; break;
+        case 2:  x0 = 1; y0 = 1; cx = 1; cy = 1; startAngle = 90;  steps = 45; break;
+        case 3:  x0 = 1; y0 = 0; cx = 1; cy = 0; startAngle = 180; steps = 45; break;
+        case 4:  x0 = 0; y0 = 0; cx = 0; cy = 0; startAngle = 270; steps = 45; break;
+        case -1: x0 = 1; y0 = 0; cx = 0; cy = 1; startAngle = 0;   steps = 45; break;
+        case -2: x0 = 0; y0 = 0; cx = 1; cy = 1; startAngle = 90;  steps = 45; break;
+        case -3: x0 = 0; y0 = 1; cx = 1; cy = 0; startAngle = 180; steps = 45; break;
+        case -4: x0 = 1; y0 = 1; cx = 0; cy = 0; startAngle = 270; steps = 45; break;
+        case 5:  x0 = 0;    y0 = 0.5f; cx = 0;    cy = 0.5f; ry = 0.5f; startAngle = 270; steps = 90; break;
+        case 6:  x0 = 0.5f; y0 = 1;    cx = 0.5f; cy = 1;    rx = 0.5f; startAngle = 0;   steps = 90; break;
+        case 7:  x0 = 1;    y0 = 0.5f; cx = 1;    cy = 0.5f; ry = 0.5f; startAngle = 90;  steps = 90; break;
+        case 8:  x0 = 0.5f; y0 = 0;    cx = 0.5f; cy = 0;    rx = 0.5f; startAngle = 180; steps = 90; break;
+        default: break;
+    }
+
+    v.reserve(2 * (steps + 2));
+    v.push_back(x0);
+    v.push_back(y0);
+    for (int i = 0; i <= steps; i++) {
+        v.push_back(cx + (GLfloat)cos((2*i + startAngle) * M_PI / 180.0f) * rx);
+        v.push_back(cy - (GLfloat)sin((2*i + startAngle) * M_PI / 180.0f) * ry);
     }
-    return vertices;
+    return v;
 }
 
-GLfloat *cOglCmdDrawEllipse::CreateVerticesHalf(int &numVertices) {
-    int size = 184;
-    numVertices = size/2;
-    GLfloat radiusX = 0.0f;
-    GLfloat radiusY = 0.0f;
-    GLint transX = 0;
-    GLint transY = 0;
-    GLint startAngle = 0;    
-    GLfloat *vertices = new GLfloat[size];
-    switch (quadrants) {
-        case 5:
-            radiusX = (GLfloat)width;
-            radiusY = (GLfloat)height/2;
-            vertices[0] = x;
-            vertices[1] = y + radiusY;
-            startAngle = 270;
-            transY = radiusY;
-            break;
-        case 6:
-            radiusX = (GLfloat)width/2;
-            radiusY = (GLfloat)height;
-            vertices[0] = x + radiusX;
-            vertices[1] = y + radiusY;
-            startAngle = 0;
-            transX = radiusX;
-            transY = radiusY;
+static const std::vector<GLfloat> &SlopeTessellation(int type, int steps) {
+    std::vector<GLfloat> &v = slopeTessellation[type + (steps == 100 ? 8 : 0)];
+    if (!v.empty())
+        return v;
+
+    bool falling  = type & 0x02;
+    bool vertical = type & 0x04;
+
+    v.reserve(2 * (steps + 2));
+    switch (type) {
+        case 0: case 4:
+            v.push_back(1.0f); v.push_back(1.0f);
             break;
-        case 7:
-            radiusX = (GLfloat)width;
-            radiusY = (GLfloat)height/2;
-            vertices[0] = x + radiusX;
-            vertices[1] = y + radiusY;
-            startAngle = 90;
-            transX = radiusX;
-            transY = radiusY;
+        case 2: case 6:
+            v.push_back(0.0f); v.push_back(1.0f);
             break;
-        case 8:
-            radiusX = (GLfloat)width/2;
-            radiusY = (GLfloat)height;
-            vertices[0] = x + radiusX;
-            vertices[1] = y;
-            startAngle = 180;
-            transX = radiusX;
+        case 3: case 7:
+            v.push_back(1.0f); v.push_back(0.0f);
             break;
         default:
+            v.push_back(0.0f); v.push_back(0.0f);
             break;
     }
-    for (int i=0; i <= 90; i++) {
-        vertices[2*i+2] = x + transX + (GLfloat)cos((2*i + startAngle) * M_PI / 180.0f)*radiusX;
-        vertices[2*i+3] = y + transY - (GLfloat)sin((2*i + startAngle) * M_PI / 180.0f)*radiusY;
+
+    for (int i = 0; i <= steps; i++) {
+        GLfloat c = cos(i * M_PI / steps);
+        if (falling)
+            c = -c;
+        if (vertical) {
+            v.push_back(0.5f + c / 2.0f);
+            v.push_back((GLfloat)i / steps);
+        } else {
+            v.push_back((GLfloat)i / steps);
+            v.push_back(0.5f + c / 2.0f);
+        }
     }
-    return vertices;
+    return v;
+}
+
+bool cOglCmdDrawEllipse::Execute(void) {
+    if (quadrants < -4 || quadrants > 8)
+        return false;
+
+    const std::vector<GLfloat> &v = EllipseTessellation(quadrants);
+
+    //not antialiased
+    Batch->AddTriangleFan(fb, color, &v[0], v.size() / 2, x, y, width, height);
+    return true;
 }
 
 //------------------ cOglCmdDrawSlope --------------------
@@ -1577,66 +2338,13 @@ cOglCmdDrawSlope::cOglCmdDrawSlope( cOglFb *fb, GLint x, GLint y, GLint width, G
 }
 
 bool cOglCmdDrawSlope::Execute(void) {
-    bool falling  = type & 0x02;
-    bool vertical = type & 0x04;
-
-    int steps = 100;
-    if (width < 100)
-        steps = 25;
-    int numVertices = steps + 2;
-    GLfloat *vertices = new GLfloat[numVertices*2];
-
-    switch (type) {
-        case 0: case 4:
-            vertices[0] = (GLfloat)(x + width);
-            vertices[1] = (GLfloat)(y + height);
-            break;
-        case 1: case 5:
-            vertices[0] = (GLfloat)x;
-            vertices[1] = (GLfloat)y;
-            break;
-        case 2: case 6:
-            vertices[0] = (GLfloat)x;
-            vertices[1] = (GLfloat)(y + height);
-            break;
-        case 3: case 7:
-            vertices[0] = (GLfloat)(x + width);
-            vertices[1] = (GLfloat)y;
-            break;
-        default:
-            vertices[0] = (GLfloat)(x);
-            vertices[1] = (GLfloat)(y);
-            break;
-    }
-
-    for (int i = 0; i <= steps; i++) {
-        GLfloat c = cos(i * M_PI / steps);
-        if (falling)
-            c = -c;
-        if (vertical) {
-            vertices[2*i+2] = (GLfloat)x + (GLfloat)width / 2.0f + (GLfloat)width * c / 2.0f;
-            vertices[2*i+3] = (GLfloat)y + (GLfloat)i * ((GLfloat)height) / steps ;
-        } else {
-            vertices[2*i+2] = (GLfloat)x + (GLfloat)i * ((GLfloat)width) / steps ;
-            vertices[2*i+3] = (GLfloat)y + (GLfloat)height / 2.0f + (GLfloat)height * c / 2.0f;
-        }
-    }
+    if (type < 0 || type > 7)
+        return false;
 
-    VertexBuffers[vbSlope]->ActivateShader();
-    VertexBuffers[vbSlope]->SetShaderColor(color);
-    VertexBuffers[vbSlope]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+    const std::vector<GLfloat> &v = SlopeTessellation(type, width < 100 ? 25 : 100);
 
     //not antialiased
-    fb->Bind();
-    VertexBuffers[vbSlope]->DisableBlending();
-    VertexBuffers[vbSlope]->Bind();
-    VertexBuffers[vbSlope]->SetVertexSubData(vertices, numVertices);
-    VertexBuffers[vbSlope]->DrawArrays(numVertices);
-    VertexBuffers[vbSlope]->Unbind();
-    VertexBuffers[vbSlope]->EnableBlending();
-    fb->Unbind();
-
-    delete[] vertices;
+    Batch->AddTriangleFan(fb, color, &v[0], v.size() / 2, x, y, width, height);
     return true;
 }
 
@@ -1657,154 +2365,108 @@ cOglCmdDrawText::~cOglCmdDrawText(void) {
     free(symbols);
 }
 
+static void DrawTextQuads(cOglFb *fb, cOglFontAtlas *fa, GLint color, const std::vector<GLfloat> *quads, GLint x, GLint y) {
+    for (int i = 0; i < OGL_ATLAS_PAGES; i++) {
+        if (quads[i].empty())
+            continue;
+        fa->Touch(i);
+        Batch->AddTriangles(fb, fa->Texture(i), color, &quads[i][0], quads[i].size() / 4, x, y);
+    }
+}
+
 bool cOglCmdDrawText::Execute(void) {
     cOglFont *f = cOglFont::Get(*fontName, fontSize);
     if (!f)
         return false;
 
-    VertexBuffers[vbText]->ActivateShader();
-    VertexBuffers[vbText]->SetShaderColor(colorText);
-    VertexBuffers[vbText]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+    cOglFontAtlas *fa = f->Atlas();
+    fa->Begin();
 
-    fb->Bind();
-    VertexBuffers[vbText]->Bind();
+    // runs are positioned relative to the text origin
+    GLint limit = limitX ? limitX - x : INT_MAX;
+    GLint clip = fb->Width() - x;
+    uint64_t hash = cOglFont::RunHash(symbols, limit, clip);
+    const sOglTextRun *run = f->FindRun(hash, symbols, limit, clip);
+    if (run) {
+        fa->Touch(run->glyphs);
+        DrawTextQuads(fb, fa, colorText, run->quads, x, y);
+        return true;
+    }
 
-    int xGlyph = x;
-    int yGlyph = y;
+    int xGlyph = 0;
     int fontHeight = f->Height();
     int bottom = f->Bottom();
     FT_ULong sym = 0;
-    FT_ULong prevSym = 0;
-    int kerning = 0;
-
-    // Check, if we only have symbols, which are in our atlas
-    int unknown_char = 0;
-    for (int i = 0; symbols[i]; i++) {
-        if ((symbols[i] < MIN_CHARCODE) || (symbols[i] > MAX_CHARCODE)) {
-            if (symbols[i]) {
-                unknown_char = symbols[i];
-                break;
-            }
-        }
-    }
-
-    if (!unknown_char) {
-        cOglFontAtlas *fa = f->Atlas();
-        int n = 0;
-        GLfloat *vertices = new GLfloat[4 * 6 * length];
-
-        for (int i = 0; symbols[i]; i++) {
-            sym = symbols[i];
-
-            cOglAtlasGlyph *g;
-            // Get the glyph from the font atlas for ASCII code MIN_CHARCODE-MAX_CHARCODE
-            g = fa->GetGlyph(sym);
-
-            if (!g) {
-                esyslog("[softhddev]ERROR: could not load glyph %lx", sym);
-                continue;
-            }
-
-            if ( limitX && xGlyph + g->AdvanceX() > limitX )
-                break;
-
-            kerning = f->AtlasKerning(g, prevSym);
-            prevSym = sym;
-
-            GLfloat x2 = xGlyph + kerning + g->BearingLeft();
-            GLfloat y2 = y + (fontHeight - bottom - g->BearingTop());  //top
-            GLfloat w = g->Width();
-            GLfloat h = g->Height();
-
-            vertices[n++] = x2;
-            vertices[n++] = y2;
-            vertices[n++] = g->XOffset();
-            vertices[n++] = g->YOffset();
-
-            vertices[n++] = x2 + w;
-            vertices[n++] = y2;
-            vertices[n++] = g->XOffset() + g->Width() / (float)fa->Width();
-            vertices[n++] = g->YOffset();
-
-            vertices[n++] = x2;
-            vertices[n++] = y2 + h;
-            vertices[n++] = g->XOffset();
-            vertices[n++] = g->YOffset() + g->Height() / (float)fa->Height();
-
-            vertices[n++] = x2 + w;
-            vertices[n++] = y2;
-            vertices[n++] = g->XOffset() + g->Width() / (float)fa->Width();
-            vertices[n++] = g->YOffset();
-
-            vertices[n++] = x2;
-            vertices[n++] = y2 + h;
-            vertices[n++] = g->XOffset();
-            vertices[n++] = g->YOffset() + g->Height() / (float)fa->Height();
-
-            vertices[n++] = x2 + w;
-            vertices[n++] = y2 + h;
-            vertices[n++] = g->XOffset() + g->Width() / (float)fa->Width();
-            vertices[n++] = g->YOffset() + g->Height() / (float)fa->Height();
-
-            xGlyph += kerning + g->AdvanceX();
-            yGlyph += kerning + g->AdvanceY();
+    FT_ULong prevSym = 0;
+    int kerning = 0;
+    bool complete = true;
 
+    // one batch per atlas page, usually all glyphs are on one page
+    std::vector<GLfloat> quads[OGL_ATLAS_PAGES];
+    std::vector<cOglAtlasGlyph *> used;
 
-            if ( xGlyph > fb->Width() - 1 )
-                break;
+    for (int i = 0; symbols[i]; i++) {
+        sym = symbols[i];
+
+        cOglAtlasGlyph *g = fa->GetGlyph(sym);
+        if (!g && fa->Exhausted()) {
+            // text needs more glyphs than fit into the atlas, draw what we have
+            DrawTextQuads(fb, fa, colorText, quads, x, y);
+            for (int j = 0; j < OGL_ATLAS_PAGES; j++)
+                quads[j].clear();
+            complete = false;
+            fa->Begin();
+            g = fa->GetGlyph(sym);
         }
 
-        fa->BindTexture();
-        VertexBuffers[vbText]->SetVertexData(vertices, (n / 4));
-        VertexBuffers[vbText]->DrawArrays(n / 4);
-    } else {
-#ifdef GL_DEBUG
-        fprintf(stderr, "cOglCmdDrawText: char %d is not on the texture atlas, use single draw\n", unknown_char);
-        esyslog("[softhddev]WARNING: cOglCmdDrawText: char %d is not on the texture atlas, use single draw", unknown_char);
-#endif
-        for (int i = 0; symbols[i]; i++) {
-            sym = symbols[i];
-            cOglGlyph *g = f->Glyph(sym);
-            if (!g) {
-                esyslog("[softhddev]ERROR: could not load glyph %lx", sym);
-                continue;
-            }
+        if (!g) {
+            esyslog("[softhddev]ERROR: could not load glyph %lx", sym);
+            continue;
+        }
 
-            if ( limitX && xGlyph + g->AdvanceX() > limitX )
-                break;
+        if ( xGlyph + g->AdvanceX() > limit )
+            break;
 
-            kerning = f->Kerning(g, prevSym);
-            prevSym = sym;
+        kerning = f->AtlasKerning(g, prevSym);
+        prevSym = sym;
 
+        if (g->Page() >= 0) {
             GLfloat x1 = xGlyph + kerning + g->BearingLeft();          //left
-            GLfloat y1 = y + (fontHeight - bottom - g->BearingTop());  //top
+            GLfloat y1 = fontHeight - bottom - g->BearingTop();        //top
             GLfloat x2 = x1 + g->Width();                              //right
             GLfloat y2 = y1 + g->Height();                             //bottom
+            GLfloat u1 = g->XOffset();
+            GLfloat v1 = g->YOffset();
+            GLfloat u2 = u1 + g->Width() / (float)fa->Width();
+            GLfloat v2 = v1 + g->Height() / (float)fa->Height();
 
             GLfloat vertices[] = {
-                x1, y2,   0.0, 1.0,     // left bottom
-                x1, y1,   0.0, 0.0,     // left top
-                x2, y1,   1.0, 0.0,     // right top
+                x1, y1,   u1, v1,     // left top
+                x2, y1,   u2, v1,     // right top
+                x1, y2,   u1, v2,     // left bottom
 
-                x1, y2,   0.0, 1.0,     // left bottom
-                x2, y1,   1.0, 0.0,     // right top
-                x2, y2,   1.0, 1.0      // right bottom
+                x2, y1,   u2, v1,     // right top
+                x1, y2,   u1, v2,     // left bottom
+                x2, y2,   u2, v2      // right bottom
             };
+            std::vector<GLfloat> &batch = quads[g->Page()];
+            if (batch.empty())
+                batch.reserve(4 * 6 * length);
+            batch.insert(batch.end(), vertices, vertices + 4 * 6);
+            used.push_back(g);
+        }
 
-            g->BindTexture();
-            VertexBuffers[vbText]->SetVertexData(vertices);
-            VertexBuffers[vbText]->DrawArrays();
-
-            xGlyph += kerning + g->AdvanceX();
+        xGlyph += kerning + g->AdvanceX();
 
-            if ( xGlyph > fb->Width() - 1 )
-                break;
-        }
+        if ( xGlyph > clip - 1 )
+            break;
     }
 
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
-    VertexBuffers[vbText]->Unbind();
-    fb->Unbind();
+    if (complete && (run = f->AddRun(hash, symbols, limit, clip, quads, used))) {
+        DrawTextQuads(fb, fa, colorText, run->quads, x, y);
+        return true;
+    }
+    DrawTextQuads(fb, fa, colorText, quads, x, y);
     return true;
 }
 
@@ -1892,6 +2554,9 @@ cOglCmdDrawTexture::cOglCmdDrawTexture(cOglFb *fb, sOglImage *imageRef, GLint x,
 }
 
 bool cOglCmdDrawTexture::Execute(void) {
+    if (imageRef->texture == GL_NONE)
+        return false;
+
     GLfloat x1 = x;                    //top
     GLfloat y1 = y;                    //left
     GLfloat x2 = x + imageRef->width;  //right
@@ -1924,21 +2589,119 @@ bool cOglCmdDrawTexture::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdCopyFb --------------------
+cOglCmdCopyFb::cOglCmdCopyFb(cOglFb *fb, cOglFb *source, const cRect &rect, const cPoint &dest) : cOglCmd(fb) {
+    this->source = source;
+    this->rect = rect;
+    this->dest = dest;
+}
 
-//------------------ cOglCmdStoreImage --------------------
-cOglCmdStoreImage::cOglCmdStoreImage(sOglImage *imageRef, tColor *argb) : cOglCmd(NULL) {
-    this->imageRef = imageRef;
-    data = argb;
+bool cOglCmdCopyFb::Execute(void) {
+    if (!source->Initiated())
+        return false;
+    if (!fb->Initiated() && !fb->Init())
+        return false;
+
+    // framebuffers are top-down, GL coordinates bottom-up
+    GLint srcY = source->Height() - rect.Y() - rect.Height();
+    GLint destY = fb->Height() - dest.Y() - rect.Height();
+
+    if (source == fb && rect.Intersects(cRect(dest, rect.Size()))) {
+        // overlapping regions, go through the scratch framebuffer
+        cOglFb *scratch = ScratchFb(rect.Width(), rect.Height());
+        if (!scratch)
+            return false;
+        source->BindRead();
+        scratch->BindTexture();
+        GL_CHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, rect.X(), srcY, rect.Width(), rect.Height()));
+        scratch->BindRead();
+        fb->BindTexture();
+        GL_CHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, dest.X(), destY, 0, 0, rect.Width(), rect.Height()));
+    } else {
+        source->BindRead();
+        fb->BindTexture();
+        GL_CHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, dest.X(), destY, rect.X(), srcY, rect.Width(), rect.Height()));
+    }
+    fb->Unbind();
+
+    return true;
+}
+
+//------------------ cOglCmdRenderFb --------------------
+cOglCmdRenderFb::cOglCmdRenderFb(cOglFb *fb, cOglFb *source, const cRect &rect, const cPoint &dest, GLint transparency) : cOglCmd(fb) {
+    this->source = source;
+    this->rect = rect;
+    this->dest = dest;
+    this->transparency = transparency;
+    this->bcolor = BORDERCOLOR;
+}
+
+bool cOglCmdRenderFb::Execute(void) {
+    if (!source->Initiated())
+        return false;
+
+    cOglFb *src = source;
+    cRect r = rect;
+    if (source == fb) {
+        // no feedback loop, render from a copy in the scratch framebuffer
+        src = ScratchFb(rect.Width(), rect.Height());
+        if (!src)
+            return false;
+        source->BindRead();
+        src->BindTexture();
+        GL_CHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, src->Height() - rect.Height(),
+                                     rect.X(), source->Height() - rect.Y() - rect.Height(), rect.Width(), rect.Height()));
+        r = cRect(0, 0, rect.Width(), rect.Height());
+    }
+
+    GLfloat x1 = dest.X();                  //left
+    GLfloat y1 = dest.Y();                  //top
+    GLfloat x2 = dest.X() + r.Width();      //right
+    GLfloat y2 = dest.Y() + r.Height();     //bottom
+
+    GLfloat texX1 = r.Left() / (GLfloat)src->Width();
+    GLfloat texX2 = (r.Right() + 1) / (GLfloat)src->Width();
+    GLfloat texY1 = 1.0f - (r.Bottom() + 1) / (GLfloat)src->Height();
+    GLfloat texY2 = 1.0f - r.Top() / (GLfloat)src->Height();
+
+    GLfloat quadVertices[] = {
+        // Pos    // TexCoords
+        x1,  y1,  texX1, texY2,          //left top
+        x1,  y2,  texX1, texY1,          //left bottom
+        x2,  y2,  texX2, texY1,          //right bottom
+
+        x1,  y1,  texX1, texY2,          //left top
+        x2,  y2,  texX2, texY1,          //right bottom
+        x2,  y1,  texX2, texY2           //right top
+    };
+
+    VertexBuffers[vbTexture]->ActivateShader();
+    VertexBuffers[vbTexture]->SetShaderAlpha(transparency);
+    VertexBuffers[vbTexture]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+    VertexBuffers[vbTexture]->SetShaderBorderColor(bcolor);
+
+    fb->Bind();
+    src->BindTexture();
+    VertexBuffers[vbTexture]->Bind();
+    VertexBuffers[vbTexture]->SetVertexSubData(quadVertices);
+    VertexBuffers[vbTexture]->DrawArrays();
+    VertexBuffers[vbTexture]->Unbind();
+    fb->Unbind();
+
+    return true;
 }
 
-cOglCmdStoreImage::~cOglCmdStoreImage(void) {
-    free(data);
+//------------------ cOglCmdStoreImage --------------------
+cOglCmdStoreImage::cOglCmdStoreImage(sOglImage *imageRef) : cOglCmd(NULL) {
+    this->imageRef = imageRef;
 }
 
 bool cOglCmdStoreImage::Execute(void) {
-    GL_CHECK(glGenTextures(1, &imageRef->texture));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, imageRef->texture));
-    GL_CHECK(glTexImage2D(
+    GLuint texture;
+    GL_CHECK(glGenTextures(1, &texture));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+    glGetError();
+    glTexImage2D(
         GL_TEXTURE_2D,
         0,
         GL_RGBA,
@@ -1947,8 +2710,17 @@ bool cOglCmdStoreImage::Execute(void) {
         0,
         GL_RGBA,
         GL_UNSIGNED_BYTE,
-        data
-    ));
+        imageRef->data
+    );
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        // the handle stays valid, draws of it are skipped
+        esyslog("[softhddev]failed to store OSD image texture %dx%d (0x%04x)", imageRef->width, imageRef->height, err);
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+        GL_CHECK(glDeleteTextures(1, &texture));
+        return false;
+    }
+    imageRef->texture = texture;
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
@@ -1957,71 +2729,220 @@ bool cOglCmdStoreImage::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdEvictImage --------------------
+cOglCmdEvictImage::cOglCmdEvictImage(sOglImage *imageRef) : cOglCmd(NULL) {
+    this->imageRef = imageRef;
+}
+
+bool cOglCmdEvictImage::Execute(void) {
+    // the pixels stay in memory, the image is uploaded again when drawn
+    if (imageRef->texture != GL_NONE)
+        GL_CHECK(glDeleteTextures(1, &imageRef->texture));
+    imageRef->texture = GL_NONE;
+    return true;
+}
+
 //------------------ cOglCmdDropImage --------------------
-cOglCmdDropImage::cOglCmdDropImage(sOglImage *imageRef, cCondWait *wait) : cOglCmd(NULL) {
+cOglCmdDropImage::cOglCmdDropImage(sOglImage *imageRef) : cOglCmd(NULL) {
     this->imageRef = imageRef;
-    this->wait = wait;
+}
+
+// the image is freed even if the command isn't executed at thread end
+cOglCmdDropImage::~cOglCmdDropImage(void) {
+    free(imageRef->data);
+    delete imageRef;
 }
 
 bool cOglCmdDropImage::Execute(void) {
+    // all commands drawing the image are done
     if (imageRef->texture != GL_NONE)
         GL_CHECK(glDeleteTextures(1, &imageRef->texture));
-    wait->Signal();
+    imageRef->texture = GL_NONE;
+    return true;
+}
+
+/******************************************************************************
+* cOglCmdQueue
+******************************************************************************/
+cOglCmdQueue::cOglCmdQueue(void) {
+    for (int i = 0; i < OGL_CMDQUEUE_SIZE; i++)
+        records[i].ready = false;
+    head = 0;
+    tail = 0;
+    producersWaiting = 0;
+    consumerWaiting = false;
+    closed = false;
+}
+
+cOglCmdQueue::~cOglCmdQueue(void) {
+    Clear();
+}
+
+/*
+ * Get a record for a command, false if the consumer is gone.
+ */
+bool cOglCmdQueue::Reserve(unsigned int *ticket) {
+    if (closed)
+        return false;
+    *ticket = head.fetch_add(1);
+
+    // ring full, block until the consumer frees our record
+    if (*ticket - tail >= OGL_CMDQUEUE_SIZE) {
+        mutex.Lock();
+        producersWaiting++;
+        while (*ticket - tail >= OGL_CMDQUEUE_SIZE && !closed)
+            notFull.Wait(mutex);
+        producersWaiting--;
+        mutex.Unlock();
+        if (closed)
+            return false;
+    }
     return true;
 }
 
+void cOglCmdQueue::Publish(unsigned int ticket) {
+    records[ticket % OGL_CMDQUEUE_SIZE].ready = true;
+    if (consumerWaiting) {
+        mutex.Lock();
+        notEmpty.Broadcast();
+        mutex.Unlock();
+    }
+}
+
+cOglCmd *cOglCmdQueue::Front(int timeoutMs) {
+    tRecord *record = &records[tail % OGL_CMDQUEUE_SIZE];
+
+    if (!record->ready) {
+        mutex.Lock();
+        consumerWaiting = true;
+        if (!record->ready)
+            notEmpty.TimedWait(mutex, timeoutMs);
+        consumerWaiting = false;
+        mutex.Unlock();
+        if (!record->ready)
+            return NULL;
+    }
+    return reinterpret_cast<cOglCmd *>(record->data);
+}
+
+void cOglCmdQueue::Pop(void) {
+    tRecord *record = &records[tail % OGL_CMDQUEUE_SIZE];
+
+    reinterpret_cast<cOglCmd *>(record->data)->~cOglCmd();
+    record->ready = false;
+    tail++;
+    if (producersWaiting) {
+        mutex.Lock();
+        notFull.Broadcast();
+        mutex.Unlock();
+    }
+}
+
+void cOglCmdQueue::Clear(void) {
+    while (records[tail % OGL_CMDQUEUE_SIZE].ready)
+        Pop();
+}
+
+/*
+ * The consumer stops, fail all waiting and further producers.
+ */
+void cOglCmdQueue::Close(void) {
+    mutex.Lock();
+    closed = true;
+    notFull.Broadcast();
+    mutex.Unlock();
+}
+
 /******************************************************************************
 * cOglThread
 ******************************************************************************/
-cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize) : cThread("oglThread") {
-    stalled = false;
+cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize, cOglContext *context) : cThread("oglThread") {
+    this->context = context ? context : new cOglRenderContext();
     memCached = 0;
     this->maxCacheSize = maxCacheSize * 1024 * 1024;
     this->startWait = startWait;
-    wait = new cCondWait();
     maxTextureSize = 0;
-    for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
-        imageCache[i].used = false;
-        imageCache[i].texture = GL_NONE;        
-        imageCache[i].width = 0;
-        imageCache[i].height = 0;
-    }
+    nextHandle = -1;
+    cacheHits = 0;
+    cacheMisses = 0;
+    cacheEvictions = 0;
+    executed = 0;
 
     Start();
 }
 
 cOglThread::~cOglThread() {
-    delete wait;
-    wait = NULL;
+    // textures are gone with the GL thread, free the pixels
+    for (auto it = images.begin(); it != images.end(); ++it) {
+        if (--it->second->refs == 0) {
+            free(it->second->data);
+            delete it->second;
+        }
+    }
+    delete context;
 }
 
 void cOglThread::Stop(void) {
-    for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
-        if (imageCache[i].used) {
-            DropImageData(i);
-        }
-    }
     Cancel(2);
-    stalled = false;
 }
 
-void cOglThread::DoCmd(cOglCmd* cmd) {
-    while (stalled)
-        cCondWait::SleepMs(10);
-
-    bool doSignal = false;
-    Lock();
-    if (commands.size() == 0)
-        doSignal = true;
-    commands.push(cmd);
-    Unlock();
-
-    if (commands.size() > OGL_CMDQUEUE_SIZE) {
-        stalled = true;
-    }
-
-    if (doSignal || stalled)
-        wait->Signal();
+/*
+ * Wait until all commands queued so far are executed.
+ */
+void cOglThread::Sync(void) {
+    if (!Active())
+        return;
+    cCondWait done;
+    if (DoCmd<cOglCmdSync>(&done))
+        done.Wait();
+}
+
+// hash of image size and pixels for the deduplication index
+static uint64_t HashImage(const tColor *data, int width, int height) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash = (hash ^ (uint64_t)width) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)height) * 1099511628211ULL;
+    for (int i = 0; i < width * height; i++)
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    return hash;
+}
+
+/*
+ * The image cache is changed under the thread lock, the commands are queued
+ * after it is released: a full queue blocks and Cleanup() of the GL thread
+ * takes the lock. imageCmdMutex is held from the change until the commands
+ * are queued, so they reach the GL thread in the order of the changes.
+ */
+
+/*
+ * Count the image in the cache, least recently drawn images are evicted
+ * until it fits. Called with thread lock held.
+ */
+void cOglThread::MakeResident(sOglImage *image, std::vector<sOglImage *> &evicted) {
+    long size = image->width * image->height * sizeof(tColor);
+
+    while (memCached + size > maxCacheSize && !imagesLru.empty()) {
+        sOglImage *old = imagesLru.back();
+        imagesLru.pop_back();
+        old->resident = false;
+        memCached -= old->width * old->height * sizeof(tColor);
+        cacheEvictions++;
+        evicted.push_back(old);
+    }
+    image->resident = true;
+    image->lru = imagesLru.insert(imagesLru.begin(), image);
+    memCached += size;
+}
+
+/*
+ * Queue the evictions and the upload of MakeResident().
+ */
+void cOglThread::QueueUpload(sOglImage *image, const std::vector<sOglImage *> &evicted) {
+    for (auto it = evicted.begin(); it != evicted.end(); ++it)
+        DoCmd<cOglCmdEvictImage>(*it);
+    // commands drawing the image are queued behind the upload and
+    // executed in order by the GL thread, no need to wait
+    DoCmd<cOglCmdStoreImage>(image);
 }
 
 int cOglThread::StoreImage(const cImage &image) {
@@ -2040,91 +2961,125 @@ int cOglThread::StoreImage(const cImage &image) {
     }
 
     int imgSize = image.Width() * image.Height();
-    int newMemUsed = imgSize * sizeof(tColor) + memCached;
-    if (newMemUsed > maxCacheSize) {
-        float cachedMB = memCached / 1024.0f / 1024.0f;
+    if (imgSize * (long)sizeof(tColor) > maxCacheSize) {
         float maxMB = maxCacheSize / 1024.0f / 1024.0f;
-        esyslog("[softhddev]Maximum size for GPU cache reached. Used: %.2fMB Max: %.2fMB", cachedMB, maxMB);
+        esyslog("[softhddev]OSD image of %dpx x %dpx exceeds GPU cache size %.2fMB", image.Width(), image.Height(), maxMB);
         return 0;
     }
 
-    int slot = GetFreeSlot();
-    if (!slot)
-        return 0;
+    uint64_t hash = HashImage(image.Data(), image.Width(), image.Height());
+
+    cMutexLock cmdLock(&imageCmdMutex);
+    Lock();
+    int handle = nextHandle;
+    while (images.count(handle))
+        handle = handle > INT_MIN ? handle - 1 : -1;
+    nextHandle = handle > INT_MIN ? handle - 1 : -1;
+
+    // identical image already stored, share it
+    auto it = imagesByHash.find(hash);
+    if (it != imagesByHash.end() && it->second->width == image.Width() && it->second->height == image.Height() &&
+        !memcmp(it->second->data, image.Data(), sizeof(tColor) * imgSize)) {
+        it->second->refs++;
+        images[handle] = it->second;
+        cacheHits++;
+        Unlock();
+        return handle;
+    }
 
     tColor *argb = MALLOC(tColor, imgSize);
     if (!argb) {
         esyslog("[softhddev]memory allocation of %d kb for OSD image failed", (int)(imgSize  * sizeof(tColor) / 1024));
-        ClearSlot(slot);
-        slot = 0;
+        Unlock();
         return 0;
     }
-
     memcpy(argb, image.Data(), sizeof(tColor) * imgSize);
 
-    sOglImage *imageRef = GetImageRef(slot);
+    sOglImage *imageRef = new sOglImage;
+    imageRef->texture = GL_NONE;
     imageRef->width = image.Width();
     imageRef->height = image.Height();
-    DoCmd(new cOglCmdStoreImage(imageRef, argb));
-
-    cTimeMs timer(5000);
-    while (imageRef->used && imageRef->texture == 0 && !timer.TimedOut())
-        cCondWait::SleepMs(2);
-
-    if (imageRef->texture == GL_NONE) {
-        esyslog("[softhddev]failed to store OSD image texture! (%s)", timer.TimedOut() ? "timed out" : "allocation failed");
-        DropImageData(slot);
-        slot = 0;
-    }
+    imageRef->data = argb;
+    imageRef->hash = hash;
+    imageRef->refs = 1;
+    imageRef->resident = false;
+    images[handle] = imageRef;
+    if (it == imagesByHash.end())
+        imagesByHash[hash] = imageRef;
+    cacheMisses++;
+    std::vector<sOglImage *> evicted;
+    MakeResident(imageRef, evicted);
+    Unlock();
+    QueueUpload(imageRef, evicted);
 
-    memCached += imgSize  * sizeof(tColor);
-    return slot;
+    return handle;
 }
 
-int cOglThread::GetFreeSlot(void) {
-    Lock();
-    int slot = 0;
-    for (int i = 0; i < OGL_MAX_OSDIMAGES && !slot; i++) {
-        if (!imageCache[i].used) {
-            imageCache[i].used = true;
-            slot = -i - 1;
-        }
-    }
-    Unlock();
-    return slot;
-}
+/*
+ * Draw the image of a handle into fb. Marks the image as most recently
+ * drawn and uploads it again if it was evicted. A concurrent drop waits
+ * for imageCmdMutex, so it is always queued behind the draw.
+ */
+bool cOglThread::DrawImage(cOglFb *fb, int imageHandle, GLint x, GLint y) {
+    cMutexLock cmdLock(&imageCmdMutex);
+    std::vector<sOglImage *> evicted;
+    bool upload = false;
 
-void cOglThread::ClearSlot(int slot) {
-    int i = -slot - 1;
-    if (i >= 0 && i < OGL_MAX_OSDIMAGES) {
-        Lock();
-        imageCache[i].used = false;    
-        imageCache[i].texture = GL_NONE;
-        imageCache[i].width = 0;
-        imageCache[i].height = 0;
+    Lock();
+    auto it = images.find(imageHandle);
+    if (it == images.end()) {
         Unlock();
+        return false;
     }
-}
+    sOglImage *imageRef = it->second;
+    if (imageRef->resident)
+        imagesLru.splice(imagesLru.begin(), imagesLru, imageRef->lru);
+    else {
+        MakeResident(imageRef, evicted);
+        upload = true;
+    }
+    Unlock();
 
-sOglImage *cOglThread::GetImageRef(int slot) {
-    int i = -slot - 1;
-    if (0 <= i && i < OGL_MAX_OSDIMAGES)
-        return &imageCache[i];
-    return 0;
+    if (upload)
+        QueueUpload(imageRef, evicted);
+    DoCmd<cOglCmdDrawTexture>(fb, imageRef, x, y);
+    return true;
 }
 
 void cOglThread::DropImageData(int imageHandle) {
-    sOglImage *imageRef = GetImageRef(imageHandle);
-    if (!imageRef)
+    cMutexLock cmdLock(&imageCmdMutex);
+    Lock();
+    auto it = images.find(imageHandle);
+    if (it == images.end()) {
+        Unlock();
+        return;
+    }
+    sOglImage *imageRef = it->second;
+    images.erase(it);
+    if (--imageRef->refs == 0) {
+        auto h = imagesByHash.find(imageRef->hash);
+        if (h != imagesByHash.end() && h->second == imageRef)
+            imagesByHash.erase(h);
+        if (imageRef->resident) {
+            imagesLru.erase(imageRef->lru);
+            memCached -= imageRef->width * imageRef->height * sizeof(tColor);
+        }
+        Unlock();
+        // deleted by the GL thread after pending draws of the image
+        DoCmd<cOglCmdDropImage>(imageRef);
         return;
-    int imgSize = imageRef->width * imageRef->height * sizeof(tColor);
-    memCached -= imgSize;
-    cCondWait dropWait;
-    DoCmd(new cOglCmdDropImage(imageRef, &dropWait));
-    dropWait.Wait();
-    ClearSlot(imageHandle);
+    }
+    Unlock();
 }
 
+void cOglThread::GetImageCacheStats(int *hits, int *misses, int *evictions, long *resident) {
+    Lock();
+    *hits = cacheHits;
+    *misses = cacheMisses;
+    *evictions = cacheEvictions;
+    *resident = memCached;
+    Unlock();
+}
 
 void cOglThread::Action(void) {
     if (!InitOpenGL()) {
@@ -2156,7 +3111,6 @@ void cOglThread::Action(void) {
 
     //now Thread is ready to do his job
     startWait->Signal();
-    stalled = false;
 
 #ifdef GL_DEBUG
     uint64_t start_flush = 0;
@@ -2165,15 +3119,11 @@ void cOglThread::Action(void) {
 #endif
     while(Running()) {
 
-        if (commands.empty()) {
-            wait->Wait(20);
+        cOglCmd* cmd = commands.Front(20);
+        if (!cmd) {
+            Batch->Flush();
             continue;
         }
-
-        Lock();
-        cOglCmd* cmd = commands.front();
-        commands.pop();
-        Unlock();
 #ifdef GL_DEBUG
         uint64_t start = cTimeMs::Now();
         if (strcmp(cmd->Description(), "InitFramebuffer") == 0 || time_reset) {
@@ -2181,20 +3131,25 @@ void cOglThread::Action(void) {
             time_reset = 0;
         }
 #endif
+        // anything else may read or change what the pending primitives draw to
+        if (!cmd->Batched())
+            Batch->Flush();
         cmd->Execute();
+        executed++;
 #ifdef GL_DEBUG
-        esyslog("[softhddev]\"%-*s\", %dms, %d commands left, time %" PRIu64 "", 15, cmd->Description(), (int)(cTimeMs::Now() - start), (int)(commands.size()), cTimeMs::Now());
+        esyslog("[softhddev]\"%-*s\", %dms, %d commands left, time %" PRIu64 "", 15, cmd->Description(), (int)(cTimeMs::Now() - start), commands.Size() - 1, cTimeMs::Now());
 
-        if (strcmp(cmd->Description(), "Copy buffer to OutputFramebuffer") == 0) {
+        if (strcmp(cmd->Description(), "Copy buffer to OutputFramebuffer") == 0 ||
+            strcmp(cmd->Description(), "Composite to OutputFramebuffer") == 0) {
             end_flush = cTimeMs::Now();
             time_reset = 1;
             esyslog("[softhddev] OSD Flush %dms, time %" PRIu64 "", (int)(end_flush - start_flush), cTimeMs::Now());
         }
 #endif
-        delete cmd;
-        if (stalled && commands.size() < OGL_CMDQUEUE_SIZE / 2)
-            stalled = false;
+        commands.Pop();
     }
+    commands.Close();
+    commands.Clear();
 
     dsyslog("[softhddev]Cleaning up OpenGL stuff");
     Cleanup();
@@ -2202,39 +3157,32 @@ void cOglThread::Action(void) {
 }
 
 bool cOglThread::InitOpenGL(void) {
-    VideoRender *render = (VideoRender *)GetVideoRender();
-    if (!render) {
-        fprintf(stderr, "failed to get VideoRender\n");
-        abort();
-    }
-
 #ifdef GL_DEBUG
     fprintf(stderr, "cOglThread: InitOpenGL\n");
 #endif
-    // Wait for the EGL context to be created
-    while(!render->GlInit) {
-        fprintf(stderr, "wait for EGL context\n");
-        usleep(20000);
-    }
-
-    eglAcquireContext(); /* eglMakeCurrent with new eglSurface */
+    GlContext = context;
+    if (!context->Init())
+        return false;
 
-    EGL_CHECK(dsyslog("[softhddev]EGL Version: \"%s\"", eglQueryString(render->eglDisplay, EGL_VERSION)));
-    EGL_CHECK(dsyslog("[softhddev]EGL Vendor: \"%s\"", eglQueryString(render->eglDisplay, EGL_VENDOR)));
-    EGL_CHECK(dsyslog("[softhddev]EGL Extensions: \"%s\"", eglQueryString(render->eglDisplay, EGL_EXTENSIONS)));
-    EGL_CHECK(dsyslog("[softhddev]EGL APIs: \"%s\"", eglQueryString(render->eglDisplay, EGL_CLIENT_APIS)));
+    EGLDisplay display = context->Display();
+    EGL_CHECK(dsyslog("[softhddev]EGL Version: \"%s\"", eglQueryString(display, EGL_VERSION)));
+    EGL_CHECK(dsyslog("[softhddev]EGL Vendor: \"%s\"", eglQueryString(display, EGL_VENDOR)));
+    EGL_CHECK(dsyslog("[softhddev]EGL Extensions: \"%s\"", eglQueryString(display, EGL_EXTENSIONS)));
+    EGL_CHECK(dsyslog("[softhddev]EGL APIs: \"%s\"", eglQueryString(display, EGL_CLIENT_APIS)));
 
     GL_CHECK(dsyslog("[softhddev]GL Version: \"%s\"", glGetString(GL_VERSION)));
     GL_CHECK(dsyslog("[softhddev]GL Vendor: \"%s\"", glGetString(GL_VENDOR)));
     GL_CHECK(dsyslog("[softhddev]GL Extensions: \"%s\"", glGetString(GL_EXTENSIONS)));
     GL_CHECK(dsyslog("[softhddev]GL Renderer: \"%s\"", glGetString(GL_RENDERER)));
 
-    VertexBuffers[vbText]->EnableBlending();
+    GL_CHECK(glEnable(GL_BLEND));
+    GL_CHECK(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
     GL_CHECK(glDisable(GL_DEPTH_TEST));
     return true;
 }
 
 bool cOglThread::InitShaders(void) {
+    cShader::InitBinaryCache();
     for (int i=0; i < stCount; i++) {
         cShader *shader = new cShader();
         if (!shader->Load((eShaderType)i))
@@ -2256,21 +3204,37 @@ bool cOglThread::InitVertexBuffers(void) {
             return false;
         VertexBuffers[i] = vb;
     }
-    return true;
+    Batch = new cOglBatch();
+    return Batch->Init();
 }
 
 void cOglThread::DeleteVertexBuffers(void) {
     for (int i=0; i < vbCount; i++) {
         delete VertexBuffers[i];
     }
+    delete Batch;
+    Batch = NULL;
 }
 
 void cOglThread::Cleanup(void) {
+    // nothing is executed anymore, don't let producers wait for it
+    commands.Close();
+    Lock();
+    for (auto it = imagesLru.begin(); it != imagesLru.end(); ++it) {
+        if ((*it)->texture != GL_NONE)
+            GL_CHECK(glDeleteTextures(1, &(*it)->texture));
+        (*it)->texture = GL_NONE;
+    }
+    Unlock();
     DeleteVertexBuffers();
+    delete scratchFb;
+    scratchFb = NULL;
     delete cOglOsd::oFb;
     cOglOsd::oFb = NULL;
+    FbPool.Clear();
     DeleteShaders();
     cOglFont::Cleanup();
+    context->Exit();
 }
 
 /****************************************************************************************
@@ -2291,18 +3255,24 @@ cOglPixmap::cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const c
 
     fb = new cOglFb(width, height, ViewPort.Width(), ViewPort.Height());
     dirty = true; 
+    shown = false;
+    damage = ViewPort;
 }
 
 cOglPixmap::~cOglPixmap(void) {
     if (!oglThread->Active())
         return;
-    oglThread->DoCmd(new cOglCmdDeleteFb(fb));
+    oglThread->DoCmd<cOglCmdDeleteFb>(fb);
 }
 
 void cOglPixmap::SetLayer(int Layer) {
 #ifdef GL_DEBUG
     esyslog("[softhddev] SetLayer %d", Layer);
 #endif
+    if (Layer != cPixmap::Layer()) {
+        damage.Combine(ViewPort());
+        SetDirty();
+    }
     cPixmap::SetLayer(Layer);
 }
 
@@ -2310,32 +3280,59 @@ void cOglPixmap::SetAlpha(int Alpha) {
     Alpha = constrain(Alpha, ALPHA_TRANSPARENT, ALPHA_OPAQUE);
     if (Alpha != cPixmap::Alpha()) {
         cPixmap::SetAlpha(Alpha);
+        damage.Combine(ViewPort());
         SetDirty();
     }
 }
 
 void cOglPixmap::SetTile(bool Tile) {
     cPixmap::SetTile(Tile);
+    damage.Combine(ViewPort());
     SetDirty();
 }
 
 void cOglPixmap::SetViewPort(const cRect &Rect) {
+    damage.Combine(ViewPort());
     cPixmap::SetViewPort(Rect);
+    damage.Combine(ViewPort());
     SetDirty();
 }
 
 void cOglPixmap::SetDrawPortPoint(const cPoint &Point, bool Dirty) {
     cPixmap::SetDrawPortPoint(Point, Dirty);
-    if (Dirty)
+    if (Dirty) {
+        damage.Combine(ViewPort());
         SetDirty();
+    }
+}
+
+/*
+ * Area of the osd which has to be recomposited for this pixmap. Draw
+ * operations are tracked by cPixmap in DirtyViewPort(), changes of the
+ * pixmap itself in damage.
+ */
+cRect cOglPixmap::Damage(void) {
+    cRect r = damage;
+    r.Combine(DirtyViewPort());
+    if (r.IsEmpty())
+        r = ViewPort();
+    return r;
+}
+
+void cOglPixmap::SetComposited(void) {
+    dirty = false;
+    shown = Layer() >= 0;
+    damage = cRect::Null;
+    SetClean();
 }
 
 void cOglPixmap::Clear(void) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
-    oglThread->DoCmd(new cOglCmdFill(fb, clrTransparent));
+    oglThread->DoCmd<cOglCmdFill>(fb, clrTransparent);
     SetDirty();
+    damage.Combine(ViewPort());
     MarkDrawPortDirty(DrawPort());
 }
 
@@ -2343,8 +3340,9 @@ void cOglPixmap::Fill(tColor Color) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
-    oglThread->DoCmd(new cOglCmdFill(fb, Color));
+    oglThread->DoCmd<cOglCmdFill>(fb, Color);
     SetDirty();
+    damage.Combine(ViewPort());
     MarkDrawPortDirty(DrawPort());
 }
 
@@ -2356,7 +3354,7 @@ void cOglPixmap::DrawImage(const cPoint &Point, const cImage &Image) {
         return;
     memcpy(argb, Image.Data(), sizeof(tColor) * Image.Width() * Image.Height());
 
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Image.Width(), Image.Height(), Point.X(), Point.Y()));
+    oglThread->DoCmd<cOglCmdDrawImage>(fb, argb, Image.Width(), Image.Height(), Point.X(), Point.Y());
 
     SetDirty();
     MarkDrawPortDirty(cRect(Point, cSize(Image.Width(), Image.Height())).Intersected(DrawPort().Size()));
@@ -2365,10 +3363,8 @@ void cOglPixmap::DrawImage(const cPoint &Point, const cImage &Image) {
 void cOglPixmap::DrawImage(const cPoint &Point, int ImageHandle) {
     if (!oglThread->Active())
         return;
-    if (ImageHandle < 0 && oglThread->GetImageRef(ImageHandle)) {
-            sOglImage *img = oglThread->GetImageRef(ImageHandle);
-            oglThread->DoCmd(new cOglCmdDrawTexture(fb, img, Point.X(), Point.Y()));
-    }
+    if (ImageHandle < 0)
+        oglThread->DrawImage(fb, ImageHandle, Point.X(), Point.Y());
     /*
     Fallback to VDR implementation, needs to separate cSoftOsdProvider from softhddevice.cpp 
     else {
@@ -2377,12 +3373,13 @@ void cOglPixmap::DrawImage(const cPoint &Point, int ImageHandle) {
     }
     */
     SetDirty();
+    damage.Combine(ViewPort());
     MarkDrawPortDirty(DrawPort());
 }
 
 void cOglPixmap::DrawPixel(const cPoint &Point, tColor Color) {
     cRect r(Point.X(), Point.Y(), 1, 1);
-    oglThread->DoCmd(new cOglCmdDrawRectangle(fb, r.X(), r.Y(), r.Width(), r.Height(), Color));
+    oglThread->DoCmd<cOglCmdDrawRectangle>(fb, r.X(), r.Y(), r.Width(), r.Height(), Color);
 
     SetDirty();
     MarkDrawPortDirty(r);
@@ -2416,7 +3413,7 @@ void cOglPixmap::DrawBitmap(const cPoint &Point, const cBitmap &Bitmap, tColor C
     }
 */
 
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Bitmap.Width(), Bitmap.Height(), xNew, yNew, true));
+    oglThread->DoCmd<cOglCmdDrawImage>(fb, argb, Bitmap.Width(), Bitmap.Height(), xNew, yNew, true);
     SetDirty();
     MarkDrawPortDirty(cRect(cPoint(xNew, yNew), cSize(Bitmap.Width(), Bitmap.Height())).Intersected(DrawPort().Size()));
 }
@@ -2451,7 +3448,7 @@ void cOglPixmap::DrawText(const cPoint &Point, const char *s, tColor ColorFg, tC
     cRect r(x, y, cw, ch);
 
     if (ColorBg != clrTransparent)
-        oglThread->DoCmd(new cOglCmdDrawRectangle(fb, r.X(), r.Y(), r.Width(), r.Height(), ColorBg));
+        oglThread->DoCmd<cOglCmdDrawRectangle>(fb, r.X(), r.Y(), r.Width(), r.Height(), ColorBg);
 
     if (Width || Height) {
         limitX = x + cw;
@@ -2482,7 +3479,7 @@ void cOglPixmap::DrawText(const cPoint &Point, const char *s, tColor ColorFg, tC
             }
         }
     }
-    oglThread->DoCmd(new cOglCmdDrawText(fb, x, y, symbols, limitX, Font->FontName(), Font->Size(), ColorFg, len));
+    oglThread->DoCmd<cOglCmdDrawText>(fb, x, y, symbols, limitX, Font->FontName(), Font->Size(), ColorFg, len);
 
     SetDirty();
     MarkDrawPortDirty(r);
@@ -2509,7 +3506,7 @@ void cOglPixmap::DrawRectangle(const cRect &Rect, tColor Color) {
 */
 
     LOCK_PIXMAPS;
-    oglThread->DoCmd(new cOglCmdDrawRectangle(fb, xNew, yNew, wNew, hNew, Color));
+    oglThread->DoCmd<cOglCmdDrawRectangle>(fb, xNew, yNew, wNew, hNew, Color);
     SetDirty();
     MarkDrawPortDirty(Rect);
 }
@@ -2535,7 +3532,7 @@ void cOglPixmap::DrawEllipse(const cRect &Rect, tColor Color, int Quadrants) {
 */
 
     LOCK_PIXMAPS;
-    oglThread->DoCmd(new cOglCmdDrawEllipse(fb, xNew, yNew, wNew, hNew, Color, Quadrants));
+    oglThread->DoCmd<cOglCmdDrawEllipse>(fb, xNew, yNew, wNew, hNew, Color, Quadrants);
     SetDirty();
     MarkDrawPortDirty(Rect);
 }
@@ -2561,50 +3558,126 @@ void cOglPixmap::DrawSlope(const cRect &Rect, tColor Color, int Type) {
 */
 
     LOCK_PIXMAPS;
-    oglThread->DoCmd(new cOglCmdDrawSlope(fb, xNew, yNew, wNew, hNew, Color, Type));
+    oglThread->DoCmd<cOglCmdDrawSlope>(fb, xNew, yNew, wNew, hNew, Color, Type);
     SetDirty();
     MarkDrawPortDirty(Rect);
 }
 
+/*
+ * Clip a copy of source (in the source draw port) to dest (in the
+ * destination draw port) against both framebuffers, false if nothing is left.
+ */
+static bool ClipCopy(cRect &source, cPoint &dest, cOglFb *sourceFb, cOglFb *destFb) {
+    cRect s = source.Intersected(cRect(0, 0, sourceFb->Width(), sourceFb->Height()));
+    cPoint d = dest + (s.Point() - source.Point());
+    cRect r = cRect(d, s.Size()).Intersected(cRect(0, 0, destFb->Width(), destFb->Height()));
+    if (r.IsEmpty())
+        return false;
+    source = cRect(s.Point() + (r.Point() - d), r.Size());
+    dest = r.Point();
+    return true;
+}
+
 void cOglPixmap::Render(const cPixmap *Pixmap, const cRect &Source, const cPoint &Dest) {
-    esyslog("[softhddev] Render %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    const cOglPixmap *pixmap = dynamic_cast<const cOglPixmap *>(Pixmap);
+    if (!pixmap) {
+        esyslog("[softhddev] Render: pixmap is no OpenGl pixmap");
+        return;
+    }
+    cRect s = Source;
+    cPoint d = Dest;
+    if (!ClipCopy(s, d, pixmap->Fb(), fb))
+        return;
+
+    LOCK_PIXMAPS;
+    oglThread->DoCmd<cOglCmdRenderFb>(fb, pixmap->Fb(), s, d, Pixmap->Alpha());
+    SetDirty();
+    MarkDrawPortDirty(cRect(d, s.Size()));
 }
 
 void cOglPixmap::Copy(const cPixmap *Pixmap, const cRect &Source, const cPoint &Dest) {
-    esyslog("[softhddev] Copy %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    const cOglPixmap *pixmap = dynamic_cast<const cOglPixmap *>(Pixmap);
+    if (!pixmap) {
+        esyslog("[softhddev] Copy: pixmap is no OpenGl pixmap");
+        return;
+    }
+    cRect s = Source;
+    cPoint d = Dest;
+    if (!ClipCopy(s, d, pixmap->Fb(), fb))
+        return;
+
+    LOCK_PIXMAPS;
+    oglThread->DoCmd<cOglCmdCopyFb>(fb, pixmap->Fb(), s, d);
+    SetDirty();
+    MarkDrawPortDirty(cRect(d, s.Size()));
 }
 
 void cOglPixmap::Scroll(const cPoint &Dest, const cRect &Source) {
-    esyslog("[softhddev] Scroll %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    cRect s = (&Source == &cRect::Null) ? DrawPort().Shifted(-DrawPort().Point()) : Source;
+    cPoint d = Dest;
+    if (!ClipCopy(s, d, fb, fb) || s.Point() == d)
+        return;
+
+    LOCK_PIXMAPS;
+    oglThread->DoCmd<cOglCmdCopyFb>(fb, fb, s, d);
+    SetDirty();
+    MarkDrawPortDirty(cRect(d, s.Size()));
 }
 
 void cOglPixmap::Pan(const cPoint &Dest, const cRect &Source) {
-    esyslog("[softhddev] Pan %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    cRect s = (&Source == &cRect::Null) ? DrawPort().Shifted(-DrawPort().Point()) : Source;
+    cPoint d = Dest;
+    if (!ClipCopy(s, d, fb, fb) || s.Point() == d)
+        return;
+
+    LOCK_PIXMAPS;
+    oglThread->DoCmd<cOglCmdCopyFb>(fb, fb, s, d);
+    // move the draw port along, the view port shows the same content
+    cPixmap::SetDrawPortPoint(DrawPort().Point() - (d - s.Point()), false);
+    cRect visible(-DrawPort().X(), -DrawPort().Y(), ViewPort().Width(), ViewPort().Height());
+    if (!cRect(d, s.Size()).Contains(visible)) {
+        damage.Combine(ViewPort());
+        SetDirty();
+    }
 }
 
 /******************************************************************************
 * cOglOsd
 ******************************************************************************/
 cOglOutputFb *cOglOsd::oFb = NULL;
+int cOglOsd::flushes = 0;
+int cOglOsd::pixelsLast = 0;
+long long cOglOsd::pixelsTotal = 0;
 
 cOglOsd::cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglThread) : cOsd(Left, Top, Level) {
     this->oglThread = oglThread;
     bFb = NULL;
     isSubtitleOsd = false;
+    direct = false;
+    numDamage = 0;
+    fullDamage = true;
     int osdWidth = 0;
     int osdHeight = 0;
     double pixel_aspect;
 
-    GetScreenSize(&osdWidth, &osdHeight, &pixel_aspect);
-    dsyslog("[softhddev]cOglOsd osdLeft %d osdTop %d screenWidth %d screenHeight %d", Left, Top, osdWidth, osdHeight);
+    GetOsdSize(&osdWidth, &osdHeight, &pixel_aspect);
+    dsyslog("[softhddev]cOglOsd osdLeft %d osdTop %d osdWidth %d osdHeight %d", Left, Top, osdWidth, osdHeight);
 
     cSize maxPixmapSize(oglThread->MaxTextureSize(), oglThread->MaxTextureSize());
 
     if (!oFb) {
         oFb = new cOglOutputFb(osdWidth, osdHeight);
-        oglThread->DoCmd(new cOglCmdInitOutputFb(oFb));
+        oglThread->DoCmd<cOglCmdInitOutputFb>(oFb);
 /* fix from ua0lnj
-        oglThread->DoCmd(new cOglCmdFill(oFb, clrTransparent));
+        oglThread->DoCmd<cOglCmdFill>(oFb, clrTransparent);
 */
     }
 }
@@ -2612,17 +3685,22 @@ cOglOsd::cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglT
 cOglOsd::~cOglOsd() {
     if (!oglThread->Active())
         return;
-    oglThread->DoCmd(new cOglCmdFill(bFb, clrTransparent));
-    oglThread->DoCmd(new cOglCmdBufferFill(oFb, clrTransparent));
+    if (direct) {
+        oglThread->DoCmd<cOglCmdCompositeToOutputFb>(oFb, (sOglLayer *)NULL, 0, (cRect *)NULL, 0, 0);
+        oglThread->DoCmd<cOglCmdDeleteFb>(bFb);
+        return;
+    }
+    oglThread->DoCmd<cOglCmdFill>(bFb, clrTransparent);
+    oglThread->DoCmd<cOglCmdBufferFill>(oFb, clrTransparent);
 /* fix from ua0lnj
-    oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb,
+    oglThread->DoCmd<cOglCmdCopyBufferToOutputFb>(bFb, oFb,
                                                      Left() + (isSubtitleOsd ? oglPixMaps[0]->ViewPort().X() : 0),
                                                      Top() + (isSubtitleOsd ? oglPixMaps[0]->ViewPort().Y() : 0), 0);
 */
-    oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb, Left(), Top(), 0));
+    oglThread->DoCmd<cOglCmdCopyBufferToOutputFb>(bFb, oFb, Left(), Top(), 0);
 //    SetActive(false);
 //    OsdClose();
-    oglThread->DoCmd(new cOglCmdDeleteFb(bFb));
+    oglThread->DoCmd<cOglCmdDeleteFb>(bFb);
 }
 
 const cSize &cOglOsd::MaxPixmapSize(void) const {
@@ -2644,13 +3722,22 @@ eOsdError cOglOsd::SetAreas(const tArea *Areas, int NumAreas) {
 
     //now we know the actuaL osd size, create double buffer frame buffer
     if (bFb) {
-        oglThread->DoCmd(new cOglCmdDeleteFb(bFb));
+        oglThread->DoCmd<cOglCmdDeleteFb>(bFb);
         DestroyPixmap(oglPixmaps[0]);
     }
     bFb = new cOglFb(r.Width(), r.Height(), r.Width(), r.Height());
-    cCondWait initiated;
-    oglThread->DoCmd(new cOglCmdInitFb(bFb, &initiated));
-    initiated.Wait();
+
+    // an osd covering the output 1:1 is composited right into it, the
+    // buffer framebuffer only gives the size then and is never allocated
+    direct = !isSubtitleOsd && !Left() && !Top() &&
+             r.Width() == oFb->Width() && r.Height() == oFb->Height();
+    if (!direct) {
+        cCondWait initiated;
+        if (oglThread->DoCmd<cOglCmdInitFb>(bFb, &initiated))
+            initiated.Wait();
+    }
+    numDamage = 0;
+    fullDamage = true;
 
     return cOsd::SetAreas(&area, 1);
 }
@@ -2686,8 +3773,12 @@ void cOglOsd::DestroyPixmap(cPixmap *Pixmap) {
         start = 0;
     for (int i = start; i < oglPixmaps.Size(); i++) {
         if (oglPixmaps[i] == Pixmap) {
-            if (Pixmap->Layer() >= 0)
-                oglPixmaps[0]->SetDirty();
+            if (Pixmap->Layer() >= 0 || oglPixmaps[i]->Shown()) {
+                if (isSubtitleOsd)
+                    fullDamage = true;
+                else
+                    AddDamage(Pixmap->ViewPort());
+            }
             oglPixmaps[i] = NULL;
             cOsd::DestroyPixmap(Pixmap);
             return;
@@ -2695,48 +3786,167 @@ void cOglOsd::DestroyPixmap(cPixmap *Pixmap) {
     }
 }
 
+/*
+ * Add a rectangle in buffer coordinates to the damage of the next flush.
+ * The rectangle is snapped to tiles and merged with overlapping damage, if
+ * all slots are used it is merged with the rectangle growing least.
+ */
+void cOglOsd::AddDamage(const cRect &rect) {
+    if (!bFb)
+        return;
+    cRect r = rect.Intersected(cRect(0, 0, bFb->Width(), bFb->Height()));
+    if (r.IsEmpty())
+        return;
+
+    int x1 = r.Left() / OGL_DAMAGE_TILE * OGL_DAMAGE_TILE;
+    int y1 = r.Top() / OGL_DAMAGE_TILE * OGL_DAMAGE_TILE;
+    int x2 = std::min((r.Right() / OGL_DAMAGE_TILE + 1) * OGL_DAMAGE_TILE, bFb->Width());
+    int y2 = std::min((r.Bottom() / OGL_DAMAGE_TILE + 1) * OGL_DAMAGE_TILE, bFb->Height());
+    r.Set(x1, y1, x2 - x1, y2 - y1);
+
+    for (;;) {
+        int i;
+        for (i = 0; i < numDamage && !damage[i].Intersects(r); i++)
+            ;
+        if (i == numDamage) {
+            if (numDamage < OGL_DAMAGE_RECTS)
+                break;
+            long best = -1;
+            for (int j = 0; j < numDamage; j++) {
+                cRect c = damage[j].Combined(r);
+                long growth = (long)c.Width() * c.Height() - (long)damage[j].Width() * damage[j].Height();
+                if (best < 0 || growth < best) {
+                    best = growth;
+                    i = j;
+                }
+            }
+        }
+        r.Combine(damage[i]);
+        damage[i] = damage[--numDamage];
+    }
+    damage[numDamage++] = r;
+}
+
 void cOglOsd::Flush(void) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
-    //check if any pixmap is dirty
-    bool dirty = false;
-    for (int i = 0; i < oglPixmaps.Size() && !dirty; i++)
-        if (oglPixmaps[i] && oglPixmaps[i]->Layer() >= 0 && oglPixmaps[i]->IsDirty())
-            dirty = true;
-    if (!dirty)
+    //collect damage of dirty pixmaps, hidden ones only if they were shown before
+    for (int i = 0; i < oglPixmaps.Size(); i++) {
+        cOglPixmap *p = oglPixmaps[i];
+        if (p && p->IsDirty() && (p->Layer() >= 0 || p->Shown())) {
+            if (isSubtitleOsd)
+                fullDamage = true;
+            else
+                AddDamage(p->Damage());
+        }
+    }
+    if (fullDamage) {
+        damage[0] = cRect(0, 0, bFb->Width(), bFb->Height());
+        numDamage = 1;
+    }
+    if (!numDamage)
         return;
-    //clear buffer
-    oglThread->DoCmd(new cOglCmdFill(bFb, clrTransparent));
-
-    //render pixmap textures blended to buffer
-    for (int layer = 0; layer < MAXPIXMAPLAYERS; layer++) {
-        for (int i = 0; i < oglPixmaps.Size(); i++) {
-            if (oglPixmaps[i]) {
-                if (oglPixmaps[i]->Layer() == layer) {
-                    oglThread->DoCmd(new cOglCmdRenderFbToBufferFb( oglPixmaps[i]->Fb(),
-                                                                    bFb,
-                                                                    oglPixmaps[i]->ViewPort().X(),
+
+    int pixels = 0;
+    if (direct) {
+        //blend the pixmaps of the damaged areas right into the output,
+        //all shown pixmaps are passed, the back buffer may miss older damage
+        //and then a larger area is cleared and redrawn than damaged here
+        sOglLayer *layers = new sOglLayer[oglPixmaps.Size() + 1];
+        int numLayers = 0;
+        for (int layer = 0; layer < MAXPIXMAPLAYERS; layer++) {
+            for (int i = 0; i < oglPixmaps.Size(); i++) {
+                cOglPixmap *p = oglPixmaps[i];
+                if (!p || p->Layer() != layer)
+                    continue;
+                for (int d = 0; d < numDamage; d++) {
+                    cRect r = p->ViewPort().Intersected(damage[d]);
+                    pixels += r.Width() * r.Height();
+                }
+                sOglLayer &l = layers[numLayers++];
+                l.fb = p->Fb();
+                l.x = p->ViewPort().X();
+                l.y = p->ViewPort().Y();
+                l.alpha = p->Alpha();
+                l.drawPortX = p->DrawPort().X();
+                l.drawPortY = p->DrawPort().Y();
+            }
+        }
+        cRect *rects = new cRect[numDamage];
+        for (int d = 0; d < numDamage; d++)
+            rects[d] = damage[d];
+        oglThread->DoCmd<cOglCmdCompositeToOutputFb>(oFb, layers, numLayers, rects, numDamage, 1);
+    }
+
+    //recomposite only the damaged areas of the buffer
+    cRect bounds;
+    for (int d = 0; !direct && d < numDamage; d++) {
+        bounds.Combine(damage[d]);
+        oglThread->DoCmd<cOglCmdFill>(bFb, clrTransparent, damage[d]);
+
+        //render pixmap textures blended to buffer
+        for (int layer = 0; layer < MAXPIXMAPLAYERS; layer++) {
+            for (int i = 0; i < oglPixmaps.Size(); i++) {
+                if (oglPixmaps[i]) {
+                    if (oglPixmaps[i]->Layer() == layer) {
+                        cRect r(oglPixmaps[i]->ViewPort().X(),
+                                (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().Y() : 0,
+                                oglPixmaps[i]->ViewPort().Width(),
+                                oglPixmaps[i]->ViewPort().Height());
+                        r = r.Intersected(damage[d]);
+                        if (r.IsEmpty())
+                            continue;
+                        oglThread->DoCmd<cOglCmdRenderFbToBufferFb>( oglPixmaps[i]->Fb(),
+                                                                        bFb,
+                                                                        oglPixmaps[i]->ViewPort().X(),
 /* fix from ua0lnj
-                                                                    (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().X() : 0,
+                                                                        (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().X() : 0,
 */
-                                                                    (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().Y() : 0,
-                                                                    oglPixmaps[i]->Alpha(),
-                                                                    oglPixmaps[i]->DrawPort().X(),
-                                                                    oglPixmaps[i]->DrawPort().Y()));
-                    oglPixmaps[i]->SetDirty(false);
+                                                                        (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().Y() : 0,
+                                                                        oglPixmaps[i]->Alpha(),
+                                                                        oglPixmaps[i]->DrawPort().X(),
+                                                                        oglPixmaps[i]->DrawPort().Y(),
+                                                                        damage[d]);
+                        pixels += r.Width() * r.Height();
+                    }
                 }
             }
         }
     }
-    //copy buffer to output framebuffer
-    oglThread->DoCmd(new cOglCmdBufferFill(oFb, clrTransparent));
+    for (int i = 0; i < oglPixmaps.Size(); i++)
+        if (oglPixmaps[i] && (oglPixmaps[i]->Layer() >= 0 || oglPixmaps[i]->Shown()))
+            oglPixmaps[i]->SetComposited();
+
+    //copy buffer to output framebuffer, the first flush clears the whole output
 /* fix from ua0lnj
-    oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb,
+    oglThread->DoCmd<cOglCmdCopyBufferToOutputFb>(bFb, oFb,
                                                      Left() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().X() : 0),
-                                                     Top() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().Y() : 0), 1));
+                                                     Top() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().Y() : 0), 1);
 */
-    oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb, Left(), Top(), 1));
+    if (!direct) {
+        oglThread->DoCmd<cOglCmdCopyBufferToOutputFb>(bFb, oFb, Left(), Top(), 1, fullDamage ? cRect::Null : bounds);
+        pixels += bounds.Width() * bounds.Height();
+    }
+
+    flushes++;
+    pixelsLast = pixels;
+    pixelsTotal += pixels;
+#ifdef GL_DEBUG
+    esyslog("[softhddev] OSD Flush %d damage rects, %d pixels composited", numDamage, pixels);
+#endif
+    numDamage = 0;
+    fullDamage = false;
+}
+
+/*
+ * Statistics of the osd composition: number of flushes, pixels blended and
+ * copied by the last flush and on average.
+ */
+void cOglOsd::GetStats(int *flushes, int *pixelsLast, int *pixelsAvg) {
+    *flushes = cOglOsd::flushes;
+    *pixelsLast = cOglOsd::pixelsLast;
+    *pixelsAvg = cOglOsd::flushes ? (int)(pixelsTotal / cOglOsd::flushes) : 0;
 }
 
 void cOglOsd::DrawScaledBitmap(int x, int y, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias) {
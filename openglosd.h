@@ -23,8 +23,14 @@ const struct {
 } FT_Errors[] =
 #include FT_ERRORS_H
 
+#include <atomic>
+#include <cstddef>
+#include <list>
 #include <memory>
-#include <queue>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <vdr/plugin.h>
 #include <vdr/osd.h>
@@ -45,7 +51,11 @@ struct sOglImage {
     GLuint texture;
     GLint width;
     GLint height;
-    bool used;
+    tColor *data;               // kept for deduplication and upload after eviction
+    uint64_t hash;
+    int refs;                   // handles sharing this image
+    bool resident;              // texture uploaded or queued, counted in cache
+    std::list<sOglImage *>::iterator lru;
 };
 
 /****************************************************************************************
@@ -65,17 +75,33 @@ enum eShaderType {
     stCount
 };
 
+#define OGL_SHADER_UNIFORMS 8
 class cShader {
 private:
+    struct sUniform {
+        const GLchar *name;
+        GLint location;
+    };
+    static GLuint current;          // program in use
     eShaderType type;
     GLuint id;
+    sUniform uniforms[OGL_SHADER_UNIFORMS];
+    int numUniforms;
+    GLint projectionWidth;
+    GLint projectionHeight;
+    static uint64_t binaryKey;      // driver identification, 0 without program binaries
     bool Compile(const char *vertexCode, const char *fragmentCode);
     bool CheckCompileErrors(GLuint object, bool program = false);
+    bool LoadBinary(const char *name, uint64_t key);
+    void SaveBinary(const char *name, uint64_t key);
+    GLint Location(const GLchar *name);
 public:
-    cShader(void) {};
-    virtual ~cShader(void) {};
+    static void InitBinaryCache(void);
+    cShader(void) { id = 0; numUniforms = 0; projectionWidth = 0; projectionHeight = 0; };
+    virtual ~cShader(void);
     bool Load(eShaderType type);
     void Use(void);
+    void SetProjectionMatrix(GLint width, GLint height);
     void SetFloat    (const GLchar *name, GLfloat value);
     void SetInteger  (const GLchar *name, GLint value);
     void SetVector2f (const GLchar *name, GLfloat x, GLfloat y);
@@ -84,43 +110,6 @@ public:
     void SetMatrix4  (const GLchar *name, const glm::mat4 &matrix);
 };
 
-/****************************************************************************************
-* cOglGlyph
-****************************************************************************************/
-class cOglGlyph : public cListObject {
-private:
-    struct tKerning {
-        public:
-            tKerning(FT_ULong prevSym, GLfloat kerning = 0.0f)  {
-                this->prevSym = prevSym;
-                this->kerning = kerning;
-            }
-            FT_ULong prevSym;
-            GLfloat kerning;
-    };
-    FT_ULong charCode;
-    int bearingLeft;
-    int bearingTop;
-    int width;
-    int height;
-    int advanceX;      
-    cVector<tKerning> kerningCache;
-    GLuint texture;
-    void LoadTexture(FT_BitmapGlyph ftGlyph);
-public:
-    cOglGlyph(FT_ULong charCode, FT_BitmapGlyph ftGlyph);
-    virtual ~cOglGlyph();
-    FT_ULong CharCode(void) { return charCode; }
-    int AdvanceX(void) { return advanceX; }
-    int BearingLeft(void) const { return bearingLeft; }
-    int BearingTop(void) const { return bearingTop; }
-    int Width(void) const { return width; }
-    int Height(void) const { return height; }
-    int GetKerningCache(FT_ULong prevSym);
-    void SetKerningCache(FT_ULong prevSym, int kerning);
-    void BindTexture(void);
-};
-
 /****************************************************************************************
 * cOglAtlasGlyph
 ****************************************************************************************/
@@ -142,11 +131,13 @@ private:
     int height;
     int advanceX;
     int advanceY;
+    int page;
     float xoffset;
     float yoffset;
+    unsigned int used;              // atlas stamp of the last text drawn with this glyph
     cVector<tKerning> kerningCache;
 public:
-    cOglAtlasGlyph(FT_ULong charCode, float advanceX, float advanceY, float width, float height, float bearingLeft, float bearingTop, float xoffset, float yoffset);
+    cOglAtlasGlyph(FT_ULong charCode, float advanceX, float advanceY, float width, float height, float bearingLeft, float bearingTop, int page, float xoffset, float yoffset);
     virtual ~cOglAtlasGlyph();
     FT_ULong CharCode(void) { return charCode; }
     int AdvanceX(void) { return advanceX; }
@@ -155,8 +146,12 @@ public:
     int BearingTop(void) const { return bearingTop; }
     int Width(void) const { return width; }
     int Height(void) const { return height; }
+    int Page(void) const { return page; }
     float XOffset(void) const { return xoffset; }
     float YOffset(void) const { return yoffset; }
+    unsigned int Used(void) const { return used; }
+    void Use(unsigned int stamp) { used = stamp; }
+    void Move(float xoffset, float yoffset) { this->xoffset = xoffset; this->yoffset = yoffset; }
     int GetKerningCache(FT_ULong prevSym);
     void SetKerningCache(FT_ULong prevSym, int kerning);
 };
@@ -164,32 +159,96 @@ public:
 /****************************************************************************************
 * cOglFontAtlas
 ****************************************************************************************/
-#define MAX_ATLAS_WIDTH 4096
-#define MIN_CHARCODE 32
-#define MAX_CHARCODE 255
+#define OGL_ATLAS_PAGES 4           // texture pages per font atlas
+#define OGL_ATLAS_MIN_SIZE 256
+#define OGL_ATLAS_MAX_SIZE 2048
+#define OGL_GLYPH_OUTLINE 16        // outline width of the glyphs in 1/64 pixel
+#define OGL_GLYPH_CACHE (4 << 20)   // bytes of rasterized glyphs per font atlas
 class cOglFontAtlas {
 private:
-    GLuint tex;
-    int w;
-    int h;
+    struct sShelf {
+        int x;
+        int y;
+        int height;
+    };
+    struct sPage {
+        GLuint tex;
+        std::vector<sShelf> shelves;
+        int bottom;                 // first free row below the last shelf
+        unsigned int used;          // stamp of the last text drawn with this page
+    };
+    struct sBitmap {
+        int advanceX;
+        int advanceY;
+        int left;
+        int top;
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+    FT_Face face;
+    cString fontFile;
+    FT_Stroker stroker;
     int fontheight;
-    cOglAtlasGlyph* Glyph[MAX_CHARCODE];
+    int size;                       // width and height of a page
+    sPage pages[OGL_ATLAS_PAGES];
+    int numPages;
+    unsigned int stamp;
+    bool exhausted;
+    unsigned int generation;        // counts page evictions
+    std::unordered_map<FT_ULong, cOglAtlasGlyph *> glyphs;
+    std::vector<unsigned char> scratch;
+    std::unordered_map<FT_ULong, sBitmap> bitmaps;  // rasterized glyphs, saved to disk
+    sBitmap spare;                  // rasterized glyph, if bitmaps is full
+    size_t bitmapsBytes;
+    bool bitmapsLoaded;
+    bool bitmapsDirty;
+    uint64_t bitmapsKey;
+    bool PackOnPage(int page, int width, int height, int &x, int &y);
+    int Pack(int width, int height, int &x, int &y);
+    void EvictPage(int page, bool keepHot);
+    void Upload(int page, int x, int y, const sBitmap *b);
+    const sBitmap *Bitmap(FT_ULong sym);
+    void LoadBitmaps(void);
+    void SaveBitmaps(void);
 public:
-    cOglFontAtlas(FT_Face face, int height);
+    cOglFontAtlas(FT_Face face, const char *fontFile, int height);
     virtual ~cOglFontAtlas(void);
-    cOglAtlasGlyph* GetGlyph(int sym) const;
+    void Begin(void) { stamp++; exhausted = false; }
+    cOglAtlasGlyph* GetGlyph(FT_ULong sym);
+    bool Exhausted(void) const { return exhausted; }
+    unsigned int Generation(void) const { return generation; }
+    void Touch(int page) { pages[page].used = stamp; }
+    void Touch(const std::vector<cOglAtlasGlyph *> &glyphs);
     int FontHeight(void) const { return fontheight; }
-    int Height(void) const { return h; }
-    int Width(void) const { return w; }
-    void BindTexture(void);
+    int Height(void) const { return size; }
+    int Width(void) const { return size; }
+    GLuint Texture(int page) const { return pages[page].tex; }
 };
 
 /****************************************************************************************
 * cOglFont
 ****************************************************************************************/
+#define OGL_TEXT_RUNS 128           // cached text runs per font
+
+struct sOglTextRun {
+    uint64_t hash;
+    std::vector<unsigned int> symbols;
+    GLint limit;                    // limitX relative to the text origin, INT_MAX for none
+    GLint clip;                     // framebuffer width relative to the text origin
+    unsigned int generation;        // atlas generation the quads were built for
+    std::vector<GLfloat> quads[OGL_ATLAS_PAGES];    // relative to the text origin
+    std::vector<cOglAtlasGlyph *> glyphs;           // glyphs on a page, touched on each draw
+};
+
 class cOglFont : public cListObject {
 private:
     static bool initiated;
+    static cMutex fontsMutex;       // fonts list is read by STAT
+    std::list<sOglTextRun> runs;    // most recently used first
+    std::unordered_map<uint64_t, std::list<sOglTextRun>::iterator> runIndex;
+    int runHits;
+    int runMisses;
     cString name;
     int size;
     int height;
@@ -197,7 +256,6 @@ private:
     static FT_Library ftLib;
     FT_Face face;
     static cList<cOglFont> *fonts;
-    mutable cList<cOglGlyph> glyphCache;
     cOglFont(const char *fontName, int charHeight);
     static void Init(void);
     cOglFontAtlas *atlas;
@@ -210,9 +268,40 @@ public:
     int Size(void) { return size; };
     int Bottom(void) {return bottom; };
     int Height(void) {return height; };
-    cOglGlyph* Glyph(FT_ULong charCode) const;
-    int Kerning(cOglGlyph *glyph, FT_ULong prevSym) const;
     int AtlasKerning(cOglAtlasGlyph *glyph, FT_ULong prevSym) const;
+    static uint64_t RunHash(const unsigned int *symbols, GLint limit, GLint clip);
+    const sOglTextRun *FindRun(uint64_t hash, const unsigned int *symbols, GLint limit, GLint clip);
+    const sOglTextRun *AddRun(uint64_t hash, const unsigned int *symbols, GLint limit, GLint clip, std::vector<GLfloat> *quads,
+                              std::vector<cOglAtlasGlyph *> &glyphs);
+    static cString GetRunCacheStats(void);
+};
+
+/****************************************************************************************
+* cOglFbPool
+* Texture and framebuffer objects of deleted framebuffers, taken again by new
+* framebuffers of the same size
+****************************************************************************************/
+#define OGL_FB_POOL_SIZE (32 << 20)     // max bytes of pooled textures
+
+class cOglFbPool {
+private:
+    struct sEntry {
+        GLuint fb;
+        GLuint texture;
+        GLint width, height;
+    };
+    cMutex mutex;                       // only for the statistics
+    std::list<sEntry> entries;          // most recently returned first
+    long pooled;
+    int hits;
+    int misses;
+    void Delete(const sEntry &entry);
+public:
+    cOglFbPool(void);
+    bool Get(GLint width, GLint height, GLuint &fb, GLuint &texture);
+    void Put(GLint width, GLint height, GLuint fb, GLuint texture);
+    void Clear(void);
+    void GetStats(int *hits, int *misses, long *pooled);
 };
 
 /****************************************************************************************
@@ -243,20 +332,25 @@ public:
     bool Scrollable(void) { return scrollable; };
     GLint ViewportWidth(void) { return viewPortWidth; };
     GLint ViewportHeight(void) { return viewPortHeight; };
+    static void GetPoolStats(int *hits, int *misses, long *pooled);
 };
 
 /****************************************************************************************
 * cOglOutputFb
 * Output Framebuffer Object - holds texture which is our "output framebuffer"
 ****************************************************************************************/
+#define OGL_DAMAGE_HISTORY 4  // frames of damage kept for EGL_EXT_buffer_age
+
 class cOglOutputFb : public cOglFb {
 private:
+    cRect damageHistory[OGL_DAMAGE_HISTORY];
 public:
     GLuint fb;
     GLuint texture;
     cOglOutputFb(GLint width, GLint height);
     virtual ~cOglOutputFb(void);
     virtual bool Init(void);
+    cRect Damage(const cRect &rect, int age);
     virtual void BindWrite(void);
     virtual void Unbind(void);
 };
@@ -266,12 +360,8 @@ public:
 * Vertex Buffer - OpenGl Vertices for the different drawing commands  
 ****************************************************************************************/
 enum eVertexBufferType {
-    vbRect,
-    vbEllipse,
-    vbSlope,
     vbTexture,
     vbTextureSwapBR,
-    vbText,
     vbCount
 };
 
@@ -296,7 +386,6 @@ public:
     void ActivateShader(void);
     void EnableBlending(void);
     void DisableBlending(void);
-    void SetShaderColor(GLint color);
     void SetShaderBorderColor(GLint bcolor);
     void SetShaderTexture(GLint value);
     void SetShaderAlpha(GLint alpha);
@@ -306,6 +395,40 @@ public:
     void DrawArrays(int count = 0);
 };
 
+/****************************************************************************************
+* cOglBatch
+* Consecutive primitives with the same shader, framebuffer and texture are collected
+* and drawn with one upload to a streaming vertex buffer and one draw call
+****************************************************************************************/
+#define OGL_BATCH_VERTICES 16384    // flush threshold
+
+struct sOglVertex {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte r, g, b, a;
+};
+
+class cOglBatch {
+private:
+    GLuint vbo;
+    int capacity;                   // vertices allocated in vbo
+    eShaderType shader;
+    cOglFb *fb;
+    GLuint texture;
+    std::vector<sOglVertex> vertices;
+    sOglVertex *Reserve(eShaderType shader, cOglFb *fb, GLuint texture, int count);
+public:
+    cOglBatch(void);
+    virtual ~cOglBatch(void);
+    bool Init(void);
+    void AddTriangleFan(cOglFb *fb, GLint color, const GLfloat *xy, int count,
+                        GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat scaleX = 1.0f, GLfloat scaleY = 1.0f);
+    void AddTriangles(cOglFb *fb, GLuint texture, GLint color, const GLfloat *xyuv, int count,
+                      GLfloat x = 0.0f, GLfloat y = 0.0f);
+    void Flush(void);
+    void Discard(void) { vertices.clear(); }
+};
+
 /****************************************************************************************
 * cOpenGLCmd
 ****************************************************************************************/
@@ -317,6 +440,7 @@ public:
     virtual ~cOglCmd(void) {};
     virtual const char* Description(void) = 0;
     virtual bool Execute(void) = 0;
+    virtual bool Batched(void) { return false; }    // only adds to the primitive batch
 };
 
 class cOglCmdInitOutputFb : public cOglCmd {
@@ -339,6 +463,16 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdSync : public cOglCmd {
+private:
+    cCondWait *wait;
+public:
+    cOglCmdSync(cCondWait *wait);
+    virtual ~cOglCmdSync(void) {};
+    virtual const char* Description(void) { return "Sync"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdDeleteFb : public cOglCmd {
 public:
     cOglCmdDeleteFb(cOglFb *fb);
@@ -354,8 +488,9 @@ private:
     GLfloat drawPortX, drawPortY;
     GLint transparency;
     GLint bcolor;
+    cRect clip;
 public:
-    cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer, GLint x, GLint y, GLint transparency, GLint drawPortX, GLint drawPortY);
+    cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer, GLint x, GLint y, GLint transparency, GLint drawPortX, GLint drawPortY, const cRect &clip = cRect::Null);
     virtual ~cOglCmdRenderFbToBufferFb(void) {};
     virtual const char* Description(void) { return "Render Framebuffer to Buffer"; }
     virtual bool Execute(void);
@@ -367,18 +502,42 @@ private:
     GLfloat x, y;
     GLint bcolor;
     int active;
+    cRect damage;
 public:
-    cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active);
+    cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active, const cRect &damage = cRect::Null);
     virtual ~cOglCmdCopyBufferToOutputFb(void) {};
     virtual const char* Description(void) { return "Copy buffer to OutputFramebuffer"; }
     virtual bool Execute(void);
 };
 
+struct sOglLayer {
+    cOglFb *fb;
+    GLint x, y;
+    GLint alpha;
+    GLint drawPortX, drawPortY;
+};
+
+class cOglCmdCompositeToOutputFb : public cOglCmd {
+private:
+    cOglOutputFb *oFb;
+    sOglLayer *layers;              // bottom layer first
+    int numLayers;
+    cRect *damage;
+    int numDamage;
+    int active;
+public:
+    cOglCmdCompositeToOutputFb(cOglOutputFb *oFb, sOglLayer *layers, int numLayers, cRect *damage, int numDamage, int active);
+    virtual ~cOglCmdCompositeToOutputFb(void);
+    virtual const char* Description(void) { return "Composite to OutputFramebuffer"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdFill : public cOglCmd {
 private:
     GLint color;
+    cRect clip;
 public:
-    cOglCmdFill(cOglFb *fb, GLint color);
+    cOglCmdFill(cOglFb *fb, GLint color, const cRect &clip = cRect::Null);
     virtual ~cOglCmdFill(void) {};
     virtual const char* Description(void) { return "Fill"; }
     virtual bool Execute(void);
@@ -404,6 +563,7 @@ public:
     virtual ~cOglCmdDrawRectangle(void) {};
     virtual const char* Description(void) { return "DrawRectangle"; }
     virtual bool Execute(void);
+    virtual bool Batched(void) { return true; }
 };
 
 class cOglCmdDrawEllipse : public cOglCmd {
@@ -412,14 +572,12 @@ private:
     GLint width, height;
     GLint color;
     GLint quadrants;
-    GLfloat *CreateVerticesFull(int &numVertices);
-    GLfloat *CreateVerticesQuadrant(int &numVertices);
-    GLfloat *CreateVerticesHalf(int &numVertices); 
 public:
     cOglCmdDrawEllipse(cOglFb *fb, GLint x, GLint y, GLint width, GLint height, GLint color, GLint quadrants);
     virtual ~cOglCmdDrawEllipse(void) {};
     virtual const char* Description(void) { return "DrawEllipse  "; }
     virtual bool Execute(void);
+    virtual bool Batched(void) { return true; }
 };
 
 class cOglCmdDrawSlope : public cOglCmd {
@@ -433,6 +591,7 @@ public:
     virtual ~cOglCmdDrawSlope(void) {};
     virtual const char* Description(void) { return "DrawSlope    "; }
     virtual bool Execute(void);
+    virtual bool Batched(void) { return true; }
 };
 
 class cOglCmdDrawText : public cOglCmd {
@@ -449,6 +608,7 @@ public:
     virtual ~cOglCmdDrawText(void);
     virtual const char* Description(void) { return "DrawText     "; }
     virtual bool Execute(void);
+    virtual bool Batched(void) { return true; }
 };
 
 class cOglCmdDrawImage : public cOglCmd {
@@ -477,63 +637,199 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdCopyFb : public cOglCmd {
+private:
+    cOglFb *source;
+    cRect rect;
+    cPoint dest;
+public:
+    cOglCmdCopyFb(cOglFb *fb, cOglFb *source, const cRect &rect, const cPoint &dest);
+    virtual ~cOglCmdCopyFb(void) {};
+    virtual const char* Description(void) { return "Copy Framebuffer"; }
+    virtual bool Execute(void);
+};
+
+class cOglCmdRenderFb : public cOglCmd {
+private:
+    cOglFb *source;
+    cRect rect;
+    cPoint dest;
+    GLint transparency;
+    GLint bcolor;
+public:
+    cOglCmdRenderFb(cOglFb *fb, cOglFb *source, const cRect &rect, const cPoint &dest, GLint transparency);
+    virtual ~cOglCmdRenderFb(void) {};
+    virtual const char* Description(void) { return "Render Framebuffer"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdStoreImage : public cOglCmd {
 private:
     sOglImage *imageRef;
-    tColor *data;
 public:
-    cOglCmdStoreImage(sOglImage *imageRef, tColor *argb);
-    virtual ~cOglCmdStoreImage(void);
+    cOglCmdStoreImage(sOglImage *imageRef);
+    virtual ~cOglCmdStoreImage(void) {};
     virtual const char* Description(void) { return "Store Image"; }
     virtual bool Execute(void);
 };
 
+class cOglCmdEvictImage : public cOglCmd {
+private:
+    sOglImage *imageRef;
+public:
+    cOglCmdEvictImage(sOglImage *imageRef);
+    virtual ~cOglCmdEvictImage(void) {};
+    virtual const char* Description(void) { return "Evict Image"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdDropImage : public cOglCmd {
 private:
     sOglImage *imageRef;
-    cCondWait *wait;
 public:
-    cOglCmdDropImage(sOglImage *imageRef, cCondWait *wait);
-    virtual ~cOglCmdDropImage(void) {};
+    cOglCmdDropImage(sOglImage *imageRef);
+    virtual ~cOglCmdDropImage(void);
     virtual const char* Description(void) { return "Drop Image"; }
     virtual bool Execute(void);
 };
 
 /******************************************************************************
-* cOglThread
+* cOglCmdQueue
+* Multi producer, single consumer ring of command records. The records are
+* the arena the commands are constructed in, no heap allocation per command.
 ******************************************************************************/
-#define OGL_MAX_OSDIMAGES 512
-#define OGL_CMDQUEUE_SIZE 200
+#define OGL_CMDQUEUE_SIZE 1024  // records, power of 2
+#define OGL_CMD_SIZE 96         // max size of a command object
+
+class cOglCmdQueue {
+private:
+    struct tRecord {
+        std::atomic<bool> ready;
+        alignas(std::max_align_t) unsigned char data[OGL_CMD_SIZE];
+    };
+    tRecord records[OGL_CMDQUEUE_SIZE];
+    std::atomic<unsigned int> head;         // next ticket of producers
+    std::atomic<unsigned int> tail;         // next record of consumer
+    std::atomic<int> producersWaiting;
+    std::atomic<bool> consumerWaiting;
+    std::atomic<bool> closed;               // consumer is gone
+    cMutex mutex;
+    cCondVar notFull;
+    cCondVar notEmpty;
+    bool Reserve(unsigned int *ticket);
+    void Publish(unsigned int ticket);
+public:
+    cOglCmdQueue(void);
+    virtual ~cOglCmdQueue(void);
+    template<class T, class... Args> bool Push(Args&&... args) {
+        static_assert(sizeof(T) <= OGL_CMD_SIZE, "increase OGL_CMD_SIZE");
+        unsigned int ticket;
+        if (!Reserve(&ticket))
+            return false;
+        new (records[ticket % OGL_CMDQUEUE_SIZE].data) T(std::forward<Args>(args)...);
+        Publish(ticket);
+        return true;
+    }
+    cOglCmd *Front(int timeoutMs);
+    void Pop(void);
+    void Clear(void);
+    void Close(void);
+    int Size(void) { return (int)(head - tail); }
+};
+
+/******************************************************************************
+* cOglContext
+* EGL display, surface and context of the GL thread, created and used by it
+******************************************************************************/
+class cOglContext {
+public:
+    virtual ~cOglContext(void) {};
+    virtual bool Init(void) = 0;            // create and make current
+    virtual void Exit(void) {};             // release and destroy
+    virtual EGLDisplay Display(void) = 0;
+    virtual EGLint BufferAge(void) = 0;     // frames since the back buffer was drawn, 0 unknown
+    virtual void Present(int width, int height, int active) = 0;    // show the rendered output or close it
+};
 
+// window surface of the video render, shown on the osd plane
+class cOglRenderContext : public cOglContext {
+private:
+    bool bufferAge;
+public:
+    cOglRenderContext(void);
+    virtual bool Init(void);
+    virtual EGLDisplay Display(void);
+    virtual EGLint BufferAge(void);
+    virtual void Present(int width, int height, int active);
+};
+
+// offscreen pbuffer, on EGL_MESA_platform_surfaceless no display is needed
+class cOglPbufferContext : public cOglContext {
+private:
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+    EGLint width;
+    EGLint height;
+public:
+    cOglPbufferContext(int width, int height);
+    virtual bool Init(void);
+    virtual void Exit(void);
+    virtual EGLDisplay Display(void) { return display; };
+    virtual EGLint BufferAge(void) { return 1; };
+    virtual void Present(int width, int height, int active);
+};
+
+/******************************************************************************
+* cOglThread
+******************************************************************************/
 class cOglThread : public cThread {
 private:
     cCondWait *startWait;
-    cCondWait *wait;
-    bool stalled;
-    std::queue<cOglCmd*> commands;
+    cOglContext *context;
+    cOglCmdQueue commands;
     GLint maxTextureSize;
-    sOglImage imageCache[OGL_MAX_OSDIMAGES];
+    std::unordered_map<int, sOglImage *> images;            // by handle
+    std::unordered_map<uint64_t, sOglImage *> imagesByHash;
+    std::list<sOglImage *> imagesLru;                       // resident, most recently drawn first
+    int nextHandle;
     long memCached;
     long maxCacheSize;
+    int cacheHits;
+    int cacheMisses;
+    int cacheEvictions;
+    std::atomic<long> executed;     // commands executed, for benchmarks
+    cMutex imageCmdMutex;           // image commands queued in cache order
     bool InitOpenGL(void);
     bool InitShaders(void);
     void DeleteShaders(void);
     bool InitVertexBuffers(void);
     void DeleteVertexBuffers(void);
     void Cleanup(void);
-    int GetFreeSlot(void);
-    void ClearSlot(int slot);
+    void MakeResident(sOglImage *image, std::vector<sOglImage *> &evicted);
+    void QueueUpload(sOglImage *image, const std::vector<sOglImage *> &evicted);
 protected:
     virtual void Action(void);
 public:
-    cOglThread(cCondWait *startWait, int maxCacheSize);
+    // takes the context, NULL renders to the video render
+    cOglThread(cCondWait *startWait, int maxCacheSize, cOglContext *context = NULL);
     virtual ~cOglThread();
     void Stop(void);
-    void DoCmd(cOglCmd* cmd);
+    // false if the GL thread is gone, the command is destroyed unexecuted
+    // like the commands left in the queue at thread end
+    template<class T, class... Args> bool DoCmd(Args&&... args) {
+        if (commands.Push<T>(std::forward<Args>(args)...))
+            return true;
+        T cmd(std::forward<Args>(args)...);
+        return false;
+    }
     int StoreImage(const cImage &image);
     void DropImageData(int imageHandle);
-    sOglImage *GetImageRef(int slot);
+    bool DrawImage(cOglFb *fb, int imageHandle, GLint x, GLint y);
+    void GetImageCacheStats(int *hits, int *misses, int *evictions, long *resident);
     int MaxTextureSize(void) { return maxTextureSize; };
+    void Sync(void);
+    long Executed(void) { return executed; };
 };
 
 /****************************************************************************************
@@ -544,14 +840,19 @@ private:
     cOglFb *fb;
     std::shared_ptr<cOglThread> oglThread;
     bool dirty;
+    bool shown;
+    cRect damage;
 public:
     cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const cRect &ViewPort, const cRect &DrawPort = cRect::Null);
     virtual ~cOglPixmap(void);
-    cOglFb *Fb(void) { return fb; };
+    cOglFb *Fb(void) const { return fb; };
     int X(void) { return ViewPort().X(); };
     int Y(void) { return ViewPort().Y(); };
     virtual bool IsDirty(void) { return dirty; }
     virtual void SetDirty(bool dirty = true) { this->dirty = dirty; }
+    bool Shown(void) { return shown; }
+    cRect Damage(void);
+    void SetComposited(void);
     virtual void SetLayer(int Layer);
     virtual void SetAlpha(int Alpha);
     virtual void SetTile(bool Tile);
@@ -576,13 +877,24 @@ public:
 /******************************************************************************
 * cOglOsd
 ******************************************************************************/
+#define OGL_DAMAGE_RECTS 8     // max separate damage rectangles per flush
+#define OGL_DAMAGE_TILE 32     // damage is snapped to tiles of this size
+
 class cOglOsd : public cOsd {
 private:
     cOglFb *bFb;
     std::shared_ptr<cOglThread> oglThread;
     cVector<cOglPixmap *> oglPixmaps;
     bool isSubtitleOsd;
+    bool direct;                    // composite into the output, no buffer framebuffer
     cSize maxPixmapSize;
+    cRect damage[OGL_DAMAGE_RECTS];
+    int numDamage;
+    bool fullDamage;
+    static int flushes;
+    static int pixelsLast;
+    static long long pixelsTotal;
+    void AddDamage(const cRect &rect);
 protected:
 public:
     cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglThread);
@@ -594,6 +906,7 @@ public:
     virtual const cSize &MaxPixmapSize(void) const;
     virtual void DrawScaledBitmap(int x, int y, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias = false);
     static cOglOutputFb *oFb;
+    static void GetStats(int *flushes, int *pixelsLast, int *pixelsAvg);
 };
 
 #endif //__SOFTHDDEVICE_OPENGLOSD_H
\ No newline at end of file
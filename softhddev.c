@@ -28,6 +28,7 @@
 #endif
 
 #include <assert.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include <libintl.h>
@@ -38,6 +39,11 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#ifdef USE_JPEG
+#include <stdio.h>
+#include <jpeglib.h>
+#endif
+
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/timestamp.h>
@@ -48,6 +54,7 @@
 #include "audio.h"
 #include "video.h"
 #include "codec.h"
+#include "history.h"
 
 //////////////////////////////////////////////////////////////////////////////
 //	Variables
@@ -63,6 +70,7 @@ static volatile char StreamFreezed;	///< stream freezed
 
 #define VIDEO_BUFFER_SIZE (512 * 1024)	///< video PES buffer default size
 #define VIDEO_PACKET_MAX 192		///< max number of video packets
+#define VIDEO_PARSE_PACKETS 25		///< max packets to wait for SPS/PPS
 
 /**
 **	Video output stream device structure.	Parser, decoder, display.
@@ -75,6 +83,7 @@ struct __video_stream__
     enum AVCodecID CodecID;		///< current codec id
     AVCodecParameters * Par;
     struct AVRational timebase;
+    VideoStreamInfo Info;		///< parsed SPS/VPS of current stream
 
     volatile char NewStream;		///< flag new video stream
     volatile char ClosingStream;	///< flag closing video stream
@@ -84,11 +93,21 @@ struct __video_stream__
     int PacketWrite;			///< ring buffer write pointer
     int PacketRead;			///< ring buffer read pointer
     atomic_t PacketsFilled;		///< how many of the ring buffer is used
+
+    History *History;			///< compressed access unit history
+    volatile char HistoryMode;		///< 1 replay, -1 reverse, -2 oldest GOP
+    volatile char HistoryWaitKey;	///< drop packets until next key
+    unsigned HistorySeq;		///< next history access unit to decode
+    unsigned HistoryEnd;		///< last access unit of the replay
+    AVPacket HistoryLive;		///< live PES packet during replay
 };
 
 static VideoStream MyVideoStream[1];	///< normal video stream
 
 static pthread_mutex_t PktsLockMutex;	///< video packets lock mutex
+static pthread_mutex_t PacketsWaitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PacketsWaitCond = PTHREAD_COND_INITIALIZER;	///< packet queued
+static pthread_mutex_t HistoryLockMutex;	///< video history pointer mutex
 
 //////////////////////////////////////////////////////////////////////////////
 //	Audio
@@ -765,183 +784,481 @@ void PrintStreamData(const uint8_t *data, int size)
 		data[27], data[28], data[29], data[30], data[31], data[32], data[33], data[34], size);
 }
 
-// helper functions to parse resolution from stream
-const unsigned char * m_pStart;
-unsigned short m_nLength;
-int m_nCurrentBit;
+#define BIT_READER_SIZE 512		///< max parsed bytes of a parameter set
 
-unsigned int ReadBit()
+/**
+**	Bit reader for NAL payload, emulation prevention bytes removed.
+*/
+typedef struct _bit_reader_
 {
-	assert(m_nCurrentBit <= m_nLength * 8);
-	int nIndex = m_nCurrentBit / 8;
-	int nOffset = m_nCurrentBit % 8 + 1;
+    uint8_t Data[BIT_READER_SIZE];	///< unescaped NAL payload
+    int Size;				///< bytes in data
+    int Bit;				///< current bit position
+} BitReader;
 
-	m_nCurrentBit++;
-	return (m_pStart[nIndex] >> (8-nOffset)) & 0x01;
+/**
+**	Prepare bit reader with one NAL unit.
+**
+**	@param br	bit reader
+**	@param data	NAL payload after the NAL header
+**	@param size	bytes available in data
+**
+**	@returns 1 if the NAL unit is complete inside data.
+*/
+static int BitReaderInit(BitReader * br, const uint8_t * data, int size)
+{
+	int zeros = 0;
+
+	br->Size = 0;
+	br->Bit = 0;
+	for (int i = 0; i < size; i++) {
+		if (zeros >= 2 && data[i] <= 0x01) {	// next start code
+			br->Size -= 2;
+			return 1;
+		}
+		if (zeros >= 2 && data[i] == 0x03) {	// emulation prevention
+			zeros = 0;
+			continue;
+		}
+		if (br->Size == BIT_READER_SIZE)	// enough for the header
+			return 1;
+		br->Data[br->Size++] = data[i];
+		zeros = data[i] ? 0 : zeros + 1;
+	}
+	return 0;
+}
+
+static unsigned int ReadBit(BitReader * br)
+{
+	unsigned int bit;
+
+	if (br->Bit >= br->Size * 8) {
+		br->Bit++;
+		return 0;
+	}
+	bit = (br->Data[br->Bit / 8] >> (7 - br->Bit % 8)) & 0x01;
+	br->Bit++;
+	return bit;
 }
 
-unsigned int ReadBits(int n)
+static uint32_t ReadBits(BitReader * br, int n)
 {
-	int r = 0;
+	uint32_t r = 0;
 
 	for (int i = 0; i < n; i++) {
-		r |= ( ReadBit() << ( n - i - 1 ) );
+		r = (r << 1) | ReadBit(br);
 	}
 	return r;
 }
 
-unsigned int ReadExponentialGolombCode()
+static void SkipBits(BitReader * br, int n)
+{
+	br->Bit += n;
+}
+
+static unsigned int ReadUE(BitReader * br)
 {
-	int r = 0;
 	int i = 0;
 
-	while((ReadBit() == 0) && (i < 32)) {
+	while (!ReadBit(br) && i < 32) {
 		i++;
 	}
-
-	r = ReadBits(i);
-	r += (1 << i) - 1;
-	return r;
+	return ReadBits(br, i) + (1 << i) - 1;
 }
 
-unsigned int ReadSE()
+static int ReadSE(BitReader * br)
 {
-	int r = ReadExponentialGolombCode();
+	unsigned int r = ReadUE(br);
 
 	if (r & 0x01) {
-		r = (r+1)/2;
-	} else {
-		r = -(r/2);
+		return (r + 1) / 2;
 	}
-	return r;
+	return -(int)(r / 2);
 }
 
-void ParseResolutionH264(int *width, int *height)
+/**
+**	Check if the bit reader ran out of data.
+*/
+static int BitReaderOverrun(const BitReader * br)
 {
-	AVPacket *avpkt;
-	m_pStart = NULL;
-	int i;
-
-	while (!VideoGetPackets()) {
-		usleep(10000);
-	}
-
-	avpkt = &MyVideoStream->PacketRb[MyVideoStream->PacketRead];
+	return br->Bit > br->Size * 8;
+}
 
-	for (i = 0; i < avpkt->size; i++) {
-		if (!avpkt->data[i] && !avpkt->data[i + 1] && avpkt->data[i + 2] == 0x01 && 
-			(avpkt->data[i + 3] == 0x67 || avpkt->data[i + 3] == 0x27)) {
+/**
+**	Skip H264 scaling list.
+*/
+static void SkipScalingListH264(BitReader * br, int size)
+{
+	int last = 8;
+	int next = 8;
 
-			m_pStart = &avpkt->data[i + 4];
-			m_nLength = avpkt->size - i - 4;
-			break;
+	for (int j = 0; j < size; j++) {
+		if (next) {
+			next = (last + ReadSE(br) + 256) % 256;
 		}
+		last = next ? next : last;
 	}
-	if (!m_pStart) {
-		fprintf(stderr, "ParseResolutionH264: No m_pStart %p Pkt %p Packets %d i %d\n",
-			m_pStart, avpkt, VideoGetPackets(), i);
-		PrintStreamData(avpkt->data, avpkt->size);
-		return;
-	}
+}
 
-	m_nCurrentBit = 0;
-	int frame_crop_left_offset = 0;
-	int frame_crop_right_offset = 0;
-	int frame_crop_top_offset = 0;
-	int frame_crop_bottom_offset = 0;
-	int chroma_format_idc = 0;
+/**
+**	Parse H264 sequence parameter set.
+**
+**	@param br	bit reader positioned after the NAL header
+**	@param info	stream info to fill
+**
+**	@returns 0 on success, -1 on broken SPS.
+*/
+static int ParseSpsH264(BitReader * br, VideoStreamInfo * info)
+{
+	int profile_idc;
+	int level_idc;
+	int chroma_format_idc = 1;
 	int separate_colour_plane_flag = 0;
-
-	int profile_idc = ReadBits(8);
-	ReadBits(16);
-	ReadExponentialGolombCode();
-
+	int bit_depth = 8;
+	int pic_order_cnt_type;
+	int num_ref_frames;
+	int width_mbs;
+	int height_map_units;
+	int frame_mbs_only_flag;
+	int crop_left = 0;
+	int crop_right = 0;
+	int crop_top = 0;
+	int crop_bottom = 0;
+	int sub_width_c;
+	int sub_height_c;
+	AVRational frame_rate = { 0, 0 };
+
+	profile_idc = ReadBits(br, 8);
+	SkipBits(br, 8);			// constraint flags
+	level_idc = ReadBits(br, 8);
+	ReadUE(br);				// seq_parameter_set_id
 
 	if (profile_idc == 100 || profile_idc == 110 ||
 		profile_idc == 122 || profile_idc == 244 ||
 		profile_idc == 44 || profile_idc == 83 ||
-		profile_idc == 86 || profile_idc == 118) {
+		profile_idc == 86 || profile_idc == 118 ||
+		profile_idc == 128 || profile_idc == 138 ||
+		profile_idc == 139 || profile_idc == 134 ||
+		profile_idc == 135) {
 
-		chroma_format_idc = ReadExponentialGolombCode();
+		chroma_format_idc = ReadUE(br);
 		if (chroma_format_idc == 3) {
-			separate_colour_plane_flag = ReadBit();
+			separate_colour_plane_flag = ReadBit(br);
 		}
-		ReadExponentialGolombCode();
-		ReadExponentialGolombCode();
-		ReadBit();
-		int seq_scaling_matrix_present_flag = ReadBit();
-		if (seq_scaling_matrix_present_flag) {
-			for (int i = 0; i < 8; i++) {
-				int seq_scaling_list_present_flag = ReadBit();
-				if (seq_scaling_list_present_flag) {
-					int sizeOfScalingList = (i < 6) ? 16 : 64;
-					int lastScale = 8;
-					int nextScale = 8;
-					for (int j = 0; j < sizeOfScalingList; j++) {
-						if (nextScale != 0) {
-							int delta_scale = ReadSE();
-							nextScale = (lastScale + delta_scale + 256) % 256;
-						}
-						lastScale = (nextScale == 0) ? lastScale : nextScale;
-					}
+		bit_depth = ReadUE(br) + 8;
+		ReadUE(br);			// bit_depth_chroma_minus8
+		SkipBits(br, 1);		// qpprime_y_zero_transform_bypass_flag
+		if (ReadBit(br)) {		// seq_scaling_matrix_present_flag
+			for (int i = 0; i < (chroma_format_idc != 3 ? 8 : 12); i++) {
+				if (ReadBit(br)) {
+					SkipScalingListH264(br, i < 6 ? 16 : 64);
 				}
 			}
 		}
 	}
-	ReadExponentialGolombCode();
-	int pic_order_cnt_type = ReadExponentialGolombCode();
+	ReadUE(br);				// log2_max_frame_num_minus4
+	pic_order_cnt_type = ReadUE(br);
 	if (pic_order_cnt_type == 0) {
-		ReadExponentialGolombCode();
+		ReadUE(br);			// log2_max_pic_order_cnt_lsb_minus4
 	} else if (pic_order_cnt_type == 1) {
-		ReadBit();
-		ReadSE();
-		ReadSE();
-		int num_ref_frames_in_pic_order_cnt_cycle = ReadExponentialGolombCode();
-		for (int i = 0; i < num_ref_frames_in_pic_order_cnt_cycle; i++ ) {
-			ReadSE();
+		int cycle;
+
+		SkipBits(br, 1);
+		ReadSE(br);
+		ReadSE(br);
+		cycle = ReadUE(br);
+		for (int i = 0; i < cycle && !BitReaderOverrun(br); i++) {
+			ReadSE(br);
 		}
 	}
-	ReadExponentialGolombCode();
-	ReadBit();
-	int pic_width_in_mbs_minus1 = ReadExponentialGolombCode();
-	int pic_height_in_map_units_minus1 = ReadExponentialGolombCode();
-	int frame_mbs_only_flag = ReadBit();
+	num_ref_frames = ReadUE(br);
+	SkipBits(br, 1);			// gaps_in_frame_num_value_allowed_flag
+	width_mbs = ReadUE(br) + 1;
+	height_map_units = ReadUE(br) + 1;
+	frame_mbs_only_flag = ReadBit(br);
 	if (!frame_mbs_only_flag) {
-		ReadBit();
-	}
-	ReadBit();
-	int frame_cropping_flag = ReadBit();
-	if (frame_cropping_flag) {
-		frame_crop_left_offset = ReadExponentialGolombCode();
-		frame_crop_right_offset = ReadExponentialGolombCode();
-		frame_crop_top_offset = ReadExponentialGolombCode();
-		frame_crop_bottom_offset = ReadExponentialGolombCode();
-	}
-
-	int SubWidthC = 0;
-	int SubHeightC = 0;
-
-	if (chroma_format_idc == 0 && separate_colour_plane_flag == 0) { //monochrome
-		SubWidthC = SubHeightC = 2;
-	} else if (chroma_format_idc == 1 && separate_colour_plane_flag == 0) { //4:2:0 
-		SubWidthC = SubHeightC = 2;
-	} else if (chroma_format_idc == 2 && separate_colour_plane_flag == 0) { //4:2:2 
-		SubWidthC = 2;
-		SubHeightC = 1;
-	} else if (chroma_format_idc == 3) { //4:4:4
-		if (separate_colour_plane_flag == 0) {
-		SubWidthC = SubHeightC = 1;
-		} else if (separate_colour_plane_flag == 1) {
-			SubWidthC = SubHeightC = 0;
+		SkipBits(br, 1);		// mb_adaptive_frame_field_flag
+	}
+	SkipBits(br, 1);			// direct_8x8_inference_flag
+	if (ReadBit(br)) {			// frame_cropping_flag
+		crop_left = ReadUE(br);
+		crop_right = ReadUE(br);
+		crop_top = ReadUE(br);
+		crop_bottom = ReadUE(br);
+	}
+
+	if (ReadBit(br)) {			// vui_parameters_present_flag
+		if (ReadBit(br)) {		// aspect_ratio_info_present_flag
+			if (ReadBits(br, 8) == 255) {	// Extended_SAR
+				SkipBits(br, 32);
+			}
+		}
+		if (ReadBit(br)) {		// overscan_info_present_flag
+			SkipBits(br, 1);
+		}
+		if (ReadBit(br)) {		// video_signal_type_present_flag
+			SkipBits(br, 4);
+			if (ReadBit(br)) {	// colour_description_present_flag
+				SkipBits(br, 24);
+			}
+		}
+		if (ReadBit(br)) {		// chroma_loc_info_present_flag
+			ReadUE(br);
+			ReadUE(br);
+		}
+		if (ReadBit(br)) {		// timing_info_present_flag
+			uint32_t num_units_in_tick = ReadBits(br, 32);
+			uint32_t time_scale = ReadBits(br, 32);
+
+			if (num_units_in_tick && time_scale && time_scale <= INT_MAX) {
+				frame_rate.num = time_scale;
+				frame_rate.den = 2 * num_units_in_tick;
+			}
+		}
+	}
+
+	if (BitReaderOverrun(br) || chroma_format_idc > 3 || bit_depth > 14) {
+		return -1;
+	}
+
+	if (separate_colour_plane_flag || !chroma_format_idc) {
+		sub_width_c = 1;
+		sub_height_c = 1;
+	} else {
+		sub_width_c = chroma_format_idc == 3 ? 1 : 2;
+		sub_height_c = chroma_format_idc == 1 ? 2 : 1;
+	}
+
+	info->CodedWidth = width_mbs * 16;
+	info->CodedHeight = (2 - frame_mbs_only_flag) * height_map_units * 16;
+	info->Width = info->CodedWidth - sub_width_c * (crop_left + crop_right);
+	info->Height = info->CodedHeight - sub_height_c *
+		(2 - frame_mbs_only_flag) * (crop_top + crop_bottom);
+	info->BitDepth = bit_depth;
+	info->ChromaFormat = chroma_format_idc;
+	info->Interlaced = !frame_mbs_only_flag;
+	info->DpbSize = num_ref_frames + 1;
+	info->FrameRate = frame_rate;
+	info->Profile = profile_idc;
+	info->Level = level_idc;
+
+	return 0;
+}
+
+/**
+**	Parse HEVC profile_tier_level().
+**
+**	@param br		bit reader
+**	@param sub_layers	sps/vps_max_sub_layers_minus1
+**	@param info		stream info for profile, level and interlace flag
+*/
+static void ParseProfileTierLevelHevc(BitReader * br, int sub_layers,
+		VideoStreamInfo * info)
+{
+	int profile_present[8];
+	int level_present[8];
+
+	info->Profile = ReadBits(br, 8) & 0x1f;	// space, tier, profile_idc
+	SkipBits(br, 32);			// profile_compatibility_flags
+	SkipBits(br, 1);			// progressive_source_flag
+	info->Interlaced = ReadBit(br);		// interlaced_source_flag
+	SkipBits(br, 46);			// constraint flags
+	info->Level = ReadBits(br, 8);
+
+	for (int i = 0; i < sub_layers; i++) {
+		profile_present[i] = ReadBit(br);
+		level_present[i] = ReadBit(br);
+	}
+	if (sub_layers > 0) {
+		SkipBits(br, 2 * (8 - sub_layers));
+	}
+	for (int i = 0; i < sub_layers; i++) {
+		if (profile_present[i])
+			SkipBits(br, 88);
+		if (level_present[i])
+			SkipBits(br, 8);
+	}
+}
+
+/**
+**	Parse HEVC video parameter set, only timing info is used.
+**
+**	@param br	bit reader positioned after the NAL header
+**	@param info	stream info to fill
+*/
+static void ParseVpsHevc(BitReader * br, VideoStreamInfo * info)
+{
+	VideoStreamInfo tmp;
+	int sub_layers;
+	int max_layer_id;
+	int num_layer_sets;
+
+	SkipBits(br, 4 + 1 + 1 + 6);		// id, base layer flags, max_layers
+	sub_layers = ReadBits(br, 3);
+	SkipBits(br, 1 + 16);			// temporal_id_nesting, reserved
+	ParseProfileTierLevelHevc(br, sub_layers, &tmp);
+	for (int i = ReadBit(br) ? 0 : sub_layers; i <= sub_layers; i++) {
+		ReadUE(br);
+		ReadUE(br);
+		ReadUE(br);
+	}
+	max_layer_id = ReadBits(br, 6);
+	num_layer_sets = ReadUE(br) + 1;
+	if (num_layer_sets > 1024) {
+		return;
+	}
+	SkipBits(br, (num_layer_sets - 1) * (max_layer_id + 1));
+	if (ReadBit(br)) {			// vps_timing_info_present_flag
+		uint32_t num_units_in_tick = ReadBits(br, 32);
+		uint32_t time_scale = ReadBits(br, 32);
+
+		if (!BitReaderOverrun(br) && num_units_in_tick && time_scale
+			&& time_scale <= INT_MAX) {
+			info->FrameRate.num = time_scale;
+			info->FrameRate.den = num_units_in_tick;
 		}
 	}
+}
+
+/**
+**	Parse HEVC sequence parameter set.
+**
+**	@param br	bit reader positioned after the NAL header
+**	@param info	stream info to fill
+**
+**	@returns 0 on success, -1 on broken SPS.
+*/
+static int ParseSpsHevc(BitReader * br, VideoStreamInfo * info)
+{
+	VideoStreamInfo tmp;
+	int sub_layers;
+	int chroma_format_idc;
+	int separate_colour_plane_flag = 0;
+	int width;
+	int height;
+	int crop_left = 0;
+	int crop_right = 0;
+	int crop_top = 0;
+	int crop_bottom = 0;
+	int bit_depth;
+	int dpb_size = 0;
+	int sub_width_c;
+	int sub_height_c;
+
+	memset(&tmp, 0, sizeof(tmp));
+	SkipBits(br, 4);			// sps_video_parameter_set_id
+	sub_layers = ReadBits(br, 3);
+	SkipBits(br, 1);			// temporal_id_nesting_flag
+	ParseProfileTierLevelHevc(br, sub_layers, &tmp);
+	ReadUE(br);				// sps_seq_parameter_set_id
+	chroma_format_idc = ReadUE(br);
+	if (chroma_format_idc == 3) {
+		separate_colour_plane_flag = ReadBit(br);
+	}
+	width = ReadUE(br);
+	height = ReadUE(br);
+	if (ReadBit(br)) {			// conformance_window_flag
+		crop_left = ReadUE(br);
+		crop_right = ReadUE(br);
+		crop_top = ReadUE(br);
+		crop_bottom = ReadUE(br);
+	}
+	bit_depth = ReadUE(br) + 8;
+	ReadUE(br);				// bit_depth_chroma_minus8
+	ReadUE(br);				// log2_max_pic_order_cnt_lsb_minus4
+	for (int i = ReadBit(br) ? 0 : sub_layers; i <= sub_layers; i++) {
+		dpb_size = ReadUE(br) + 1;	// max_dec_pic_buffering_minus1
+		ReadUE(br);			// max_num_reorder_pics
+		ReadUE(br);			// max_latency_increase_plus1
+	}
+
+	if (BitReaderOverrun(br) || chroma_format_idc > 3 || bit_depth > 16
+		|| !width || !height) {
+		return -1;
+	}
+
+	if (separate_colour_plane_flag || !chroma_format_idc) {
+		sub_width_c = 1;
+		sub_height_c = 1;
+	} else {
+		sub_width_c = chroma_format_idc == 3 ? 1 : 2;
+		sub_height_c = chroma_format_idc == 1 ? 2 : 1;
+	}
 
-	*width = ((pic_width_in_mbs_minus1 + 1) * 16) -
-		SubWidthC * (frame_crop_right_offset + frame_crop_left_offset);
+	info->CodedWidth = width;
+	info->CodedHeight = height;
+	info->Width = width - sub_width_c * (crop_left + crop_right);
+	info->Height = height - sub_height_c * (crop_top + crop_bottom);
+	info->BitDepth = bit_depth;
+	info->ChromaFormat = chroma_format_idc;
+	info->Interlaced = tmp.Interlaced;
+	info->DpbSize = dpb_size;
+	info->Profile = tmp.Profile;
+	info->Level = tmp.Level;
 
-	*height = ((2 - frame_mbs_only_flag)* (pic_height_in_map_units_minus1 +1) * 16) -
-		SubHeightC * ((frame_crop_bottom_offset * 2) + (frame_crop_top_offset * 2));
+	return 0;
+}
+
+/**
+**	Parse parameter sets at the start of an access unit.
+**
+**	The scan stops at the first slice, so only the access unit head is
+**	looked at.
+**
+**	@param info	stream info to fill
+**	@param codec_id	codec of the video stream
+**	@param data	elementary stream data
+**	@param size	size of data
+*/
+static void VideoParseStreamInfo(VideoStreamInfo * info,
+		enum AVCodecID codec_id, const uint8_t * data, int size)
+{
+	BitReader br;
+	int nal;
 
+	for (int i = 0; i + 5 < size; i++) {
+		if (data[i] || data[i + 1] || data[i + 2] != 0x01)
+			continue;
+		i += 3;
+
+		if (codec_id == AV_CODEC_ID_H264) {
+			nal = data[i] & 0x1f;
+			if (nal >= 1 && nal <= 5)	// slice
+				return;
+			if (nal == 7) {
+				VideoStreamInfo sps = *info;
+
+				if (BitReaderInit(&br, data + i + 1, size - i - 1)
+					&& !ParseSpsH264(&br, &sps)) {
+					*info = sps;
+					info->HaveSps = 1;
+				}
+			} else if (nal == 8 && info->HaveSps) {
+				info->HavePps = 1;
+			}
+		} else if (codec_id == AV_CODEC_ID_HEVC) {
+			nal = (data[i] >> 1) & 0x3f;
+			if (nal < 32)			// slice
+				return;
+			if (nal == 32) {
+				if (BitReaderInit(&br, data + i + 2, size - i - 2)) {
+					ParseVpsHevc(&br, info);
+				}
+			} else if (nal == 33) {
+				VideoStreamInfo sps = *info;
+
+				if (BitReaderInit(&br, data + i + 2, size - i - 2)
+					&& !ParseSpsHevc(&br, &sps)) {
+					*info = sps;
+					info->HaveSps = 1;
+				}
+			} else if (nal == 34 && info->HaveSps) {
+				info->HavePps = 1;
+			}
+		} else {
+			return;
+		}
+	}
 }
 
 /**
@@ -960,6 +1277,10 @@ static void VideoPacketInit(VideoStream * stream)
 		}
 		avpkt->size = 0;
 	}
+	if (av_new_packet(&stream->HistoryLive, VIDEO_BUFFER_SIZE)) {
+		Fatal(_("[softhddev] out of memory\n"));
+	}
+	stream->HistoryLive.size = 0;
 
 	atomic_set(&stream->PacketsFilled, 0);
 	stream->PacketRead = 0;
@@ -978,6 +1299,130 @@ static void VideoPacketExit(VideoStream * stream)
 	for (int i = 0; i < VIDEO_PACKET_MAX; ++i) {
 		av_packet_unref(&stream->PacketRb[i]);
 	}
+	av_packet_unref(&stream->HistoryLive);
+}
+
+/**
+**	Check if an access unit starts a GOP.
+**
+**	MPEG2 needs a sequence header, H264 an IDR slice or a SPS,
+**	HEVC an IRAP picture or a VPS.
+**
+**	@param codec_id	codec of the video stream
+**	@param data	access unit data
+**	@param size	size of access unit
+**
+**	@returns 1 if decoding can start with this access unit.
+*/
+static int VideoIsKeyPacket(enum AVCodecID codec_id, const uint8_t * data,
+		int size)
+{
+	int nal;
+
+	for (int i = 0; i + 3 < size; i++) {
+		if (data[i] || data[i + 1] || data[i + 2] != 0x01)
+			continue;
+
+		switch (codec_id) {
+		case AV_CODEC_ID_MPEG2VIDEO:
+			if (data[i + 3] == 0xb3)
+				return 1;
+			if (!data[i + 3])	// picture start code
+				return 0;
+			break;
+		case AV_CODEC_ID_H264:
+			nal = data[i + 3] & 0x1f;
+			if (nal == 5 || nal == 7)
+				return 1;
+			if (nal == 1)		// non IDR slice
+				return 0;
+			break;
+		case AV_CODEC_ID_HEVC:
+			nal = (data[i + 3] >> 1) & 0x3f;
+			if (nal == 32 || (nal >= 16 && nal <= 21))
+				return 1;
+			if (nal < 16)		// non IRAP slice
+				return 0;
+			break;
+		default:
+			return 0;
+		}
+		i += 2;
+	}
+	return 0;
+}
+
+/**
+**	Wakeup the decode thread, a packet was queued.
+*/
+static void VideoPacketQueued(void)
+{
+	pthread_mutex_lock(&PacketsWaitMutex);
+	pthread_cond_signal(&PacketsWaitCond);
+	pthread_mutex_unlock(&PacketsWaitMutex);
+}
+
+/**
+**	Wait for video input.
+**
+**	Called by the decode thread, if the decoder had nothing to do.
+**	Returns when a packet is queued, at the latest after 10ms.
+*/
+void VideoWaitInput(void)
+{
+	struct timespec abstime;
+
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_nsec += 10 * 1000 * 1000;
+	if (abstime.tv_nsec >= 1000 * 1000 * 1000) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000 * 1000 * 1000;
+	}
+	pthread_mutex_lock(&PacketsWaitMutex);
+	pthread_cond_timedwait(&PacketsWaitCond, &PacketsWaitMutex, &abstime);
+	pthread_mutex_unlock(&PacketsWaitMutex);
+}
+
+/**
+**	Place live video data in the history during replay.
+**
+**	The replay ends where it started and continues with the live
+**	stream, the history stays complete meanwhile.
+**
+**	@param stream	video stream
+**	@param pts	presentation timestamp of pes packet
+**	@param data	data of pes packet
+**	@param size	size of pes packet
+*/
+static void VideoHistoryEnqueue(VideoStream * stream, int64_t pts,
+		const void *data, int size)
+{
+	AVPacket *avpkt;
+
+	avpkt = &stream->HistoryLive;
+	if (pts != AV_NOPTS_VALUE) {
+		if (avpkt->size && avpkt->pts != AV_NOPTS_VALUE) {
+			pthread_mutex_lock(&HistoryLockMutex);
+			if (stream->History) {
+				HistoryAdd(stream->History, avpkt->pts, avpkt->data,
+					avpkt->size, VideoIsKeyPacket(stream->CodecID,
+					avpkt->data, avpkt->size));
+			}
+			pthread_mutex_unlock(&HistoryLockMutex);
+		}
+		avpkt->size = 0;
+		avpkt->pts = pts;
+		VideoParseStreamInfo(&stream->Info, stream->CodecID, data, size);
+	}
+
+	if (avpkt->size + size >= avpkt->buf->size) {
+		int pkt_size = avpkt->size;
+
+		av_grow_packet(avpkt, size);
+		avpkt->size = pkt_size;
+	}
+	memcpy(avpkt->data + avpkt->size, data, size);
+	avpkt->size += size;
 }
 
 /**
@@ -993,6 +1438,11 @@ static void VideoEnqueue(VideoStream * stream, int64_t pts, const void *data,
 {
 	AVPacket *avpkt;
 
+	if (stream->HistoryMode > 0) {
+		VideoHistoryEnqueue(stream, pts, data, size);
+		return;
+	}
+
 //	PrintStreamData(data, size);
 //	fprintf(stderr, "VideoEnqueue: pts %s size %d\n",
 //		PtsTimestamp2String(pts), size);
@@ -1001,13 +1451,33 @@ static void VideoEnqueue(VideoStream * stream, int64_t pts, const void *data,
 
 	if (pts != AV_NOPTS_VALUE) {
 		if (avpkt->size) {
-			stream->PacketWrite = (stream->PacketWrite + 1) % VIDEO_PACKET_MAX;
-			atomic_inc(&stream->PacketsFilled);
+			int key;
+
+			key = VideoIsKeyPacket(stream->CodecID, avpkt->data, avpkt->size);
+			if (!stream->TrickSpeed) {
+				pthread_mutex_lock(&HistoryLockMutex);
+				if (stream->History) {
+					HistoryAdd(stream->History, avpkt->pts, avpkt->data,
+						avpkt->size, key);
+				}
+				pthread_mutex_unlock(&HistoryLockMutex);
+			}
+			// back from history, wait for a clean start
+			if (stream->HistoryWaitKey && key)
+				stream->HistoryWaitKey = 0;
+			if (!stream->HistoryWaitKey) {
+				stream->PacketWrite = (stream->PacketWrite + 1) % VIDEO_PACKET_MAX;
+				atomic_inc(&stream->PacketsFilled);
+				VideoPacketQueued();
+			}
 		}
 		avpkt = &stream->PacketRb[stream->PacketWrite];
 		avpkt->size = 0;
 		avpkt->pts = pts;
 		avpkt->dts = AV_NOPTS_VALUE;
+
+		// parameter sets come in front of the first slice
+		VideoParseStreamInfo(&stream->Info, stream->CodecID, data, size);
 	}
 
 	if (avpkt->size + size >= avpkt->buf->size) {
@@ -1063,6 +1533,229 @@ void ClearVideo(VideoStream * stream)
 	avpkt->pts = AV_NOPTS_VALUE;
 
 	CodecVideoFlushBuffers(stream->Decoder);
+
+	// history is kept, reverse trick play starts with a clear
+	stream->HistoryMode = 0;
+	stream->HistoryWaitKey = 0;
+	pthread_mutex_unlock(&PktsLockMutex);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Video history
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Start decoding from video history.
+**
+**	Drops all queued packets and flushes the decoder.  New PES data
+**	goes to the history during a forward replay and is ignored during
+**	reverse trick play.
+**
+**	@param stream	video stream
+**	@param seq	first history access unit to decode
+**	@param mode	1 replay forward, -1 reverse trick play
+*/
+static void VideoHistoryStart(VideoStream * stream, unsigned seq, int mode)
+{
+	AVPacket *avpkt;
+
+	pthread_mutex_lock(&PktsLockMutex);
+	stream->HistoryMode = mode;
+	stream->HistorySeq = seq;
+	stream->HistoryWaitKey = 0;
+	stream->HistoryLive.size = 0;
+	stream->HistoryLive.pts = AV_NOPTS_VALUE;
+
+	atomic_set(&stream->PacketsFilled, 0);
+	stream->PacketRead = stream->PacketWrite = 0;
+	avpkt = &stream->PacketRb[stream->PacketWrite];
+	avpkt->size = 0;
+	avpkt->pts = AV_NOPTS_VALUE;
+
+	CodecVideoFlushBuffers(stream->Decoder);
+	pthread_mutex_unlock(&PktsLockMutex);
+}
+
+/**
+**	Leave video history and continue with the PES stream.
+**
+**	@param stream	video stream
+*/
+static void VideoHistoryLeave(VideoStream * stream)
+{
+	AVPacket *avpkt;
+
+	pthread_mutex_lock(&PktsLockMutex);
+	if (stream->HistoryMode) {
+		stream->HistoryMode = 0;
+		stream->HistoryWaitKey = 1;
+
+		atomic_set(&stream->PacketsFilled, 0);
+		stream->PacketRead = stream->PacketWrite = 0;
+		avpkt = &stream->PacketRb[stream->PacketWrite];
+		avpkt->size = 0;
+		avpkt->pts = AV_NOPTS_VALUE;
+
+		CodecVideoFlushBuffers(stream->Decoder);
+	}
+	pthread_mutex_unlock(&PktsLockMutex);
+}
+
+/**
+**	Hand reverse trick play back to the PES stream.
+**
+**	Called when the oldest GOP of the history is decoded, the reverse
+**	stream of VDR continues from there.  The decoder is not flushed,
+**	the picture stays until the next key frame of VDR.
+**
+**	@param stream	video stream
+*/
+static void VideoHistoryFallback(VideoStream * stream)
+{
+	pthread_mutex_lock(&PktsLockMutex);
+	if (stream->HistoryMode == -2 && !atomic_read(&stream->PacketsFilled)) {
+		stream->HistoryMode = 0;
+		stream->HistoryWaitKey = 1;
+	}
+	pthread_mutex_unlock(&PktsLockMutex);
+}
+
+/**
+**	Feed the packet ringbuffer from video history.
+**
+**	Forward replay decodes all access units, reverse trick play only
+**	the key access units GOP by GOP backwards.
+**
+**	@param stream	video stream
+**
+**	@retval 0	history packet queued or nothing to do
+**	@retval 1	end of history reached
+*/
+static int VideoHistoryFeed(VideoStream * stream)
+{
+	AVPacket *avpkt;
+	int size;
+
+	pthread_mutex_lock(&PktsLockMutex);
+	// reverse trick play: one key frame at a time
+	if (stream->HistoryMode < -1 || atomic_read(&stream->PacketsFilled) >=
+		(stream->HistoryMode > 0 ? 8 : 1)) {
+		pthread_mutex_unlock(&PktsLockMutex);
+		return 0;
+	}
+	// forward replay at real time never catches up, stop where it began
+	if (stream->HistoryMode > 0 &&
+		(int)(stream->HistorySeq - stream->HistoryEnd) > 0) {
+		pthread_mutex_unlock(&PktsLockMutex);
+		return 1;
+	}
+
+	avpkt = &stream->PacketRb[stream->PacketWrite];
+	pthread_mutex_lock(&HistoryLockMutex);
+	size = -1;
+	if (stream->History) {
+		size = HistoryGet(stream->History, stream->HistorySeq, &avpkt->pts,
+			avpkt->data, avpkt->buf->size - AV_INPUT_BUFFER_PADDING_SIZE);
+		if (size > avpkt->buf->size - AV_INPUT_BUFFER_PADDING_SIZE) {
+			avpkt->size = 0;
+			av_grow_packet(avpkt, size);
+			size = HistoryGet(stream->History, stream->HistorySeq,
+				&avpkt->pts, avpkt->data, size);
+		}
+	}
+	if (size < 0) {				// caught up or dropped
+		pthread_mutex_unlock(&HistoryLockMutex);
+		pthread_mutex_unlock(&PktsLockMutex);
+		return 1;
+	}
+
+	avpkt->size = size;
+	avpkt->dts = AV_NOPTS_VALUE;
+	memset(avpkt->data + avpkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	stream->PacketWrite = (stream->PacketWrite + 1) % VIDEO_PACKET_MAX;
+	atomic_inc(&stream->PacketsFilled);
+
+	if (stream->HistoryMode > 0) {
+		stream->HistorySeq++;
+	} else if (HistoryPrevKey(stream->History, stream->HistorySeq,
+		&stream->HistorySeq)) {
+		stream->HistoryMode = -2;	// oldest GOP, VDR takes over
+	}
+	pthread_mutex_unlock(&HistoryLockMutex);
+	pthread_mutex_unlock(&PktsLockMutex);
+
+	return 0;
+}
+
+/**
+**	Start reverse trick play from video history.
+**
+**	@param stream	video stream
+**
+**	@retval 0	reverse trick play served from history
+**	@retval -1	no history for current position
+*/
+static int VideoHistoryReverse(VideoStream * stream)
+{
+	unsigned seq;
+	int ret;
+
+	if (!stream->Render || stream->CodecID == AV_CODEC_ID_NONE) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&HistoryLockMutex);
+	ret = -1;
+	if (stream->History) {
+		ret = HistoryFindKey(stream->History,
+			VideoGetClock(stream->Render), &seq);
+	}
+	pthread_mutex_unlock(&HistoryLockMutex);
+
+	if (!ret) {
+		VideoHistoryStart(stream, seq, -1);
+	}
+	return ret;
+}
+
+/**
+**	Get next packet for the decoder.
+**
+**	The packet lock is held until VideoPacketDone.  Called with the
+**	codec lock held, clear and history switch take both locks the
+**	other way round: if the packet lock is busy, no packet is returned
+**	and the decoder burst ends.
+**
+**	@param opaque	video stream
+*/
+static const AVPacket *VideoNextPacket(void *opaque)
+{
+	VideoStream *stream = opaque;
+
+	if (pthread_mutex_trylock(&PktsLockMutex)) {
+		return NULL;
+	}
+	if (!atomic_read(&stream->PacketsFilled)) {
+		pthread_mutex_unlock(&PktsLockMutex);
+		return NULL;
+	}
+	return &stream->PacketRb[stream->PacketRead];
+}
+
+/**
+**	Release the packet taken by the decoder.
+**
+**	@param opaque	video stream
+**	@param sent	flag packet sent, drop it from the queue
+*/
+static void VideoPacketDone(void *opaque, int sent)
+{
+	VideoStream *stream = opaque;
+
+	if (sent) {
+		stream->PacketRead = (stream->PacketRead + 1) % VIDEO_PACKET_MAX;
+		atomic_dec(&stream->PacketsFilled);
+	}
 	pthread_mutex_unlock(&PktsLockMutex);
 }
 
@@ -1071,13 +1764,13 @@ void ClearVideo(VideoStream * stream)
 **
 **	@param stream	video stream
 **
-**	@retval 0	packet decoded
+**	@retval 0	packets sent or frames received
 **	@retval	1	stream paused
-**	@retval	-1	empty stream
+**	@retval	-1	empty stream or decoder waits for output room
 */
 int VideoDecodeInput(VideoStream * stream)
 {
-	AVPacket *avpkt;
+	int work;
 
 	if (StreamFreezed) {		// stream freezed
 //		fprintf(stderr, "VideoDecodeInput: stream->Freezed\n");
@@ -1087,6 +1780,11 @@ int VideoDecodeInput(VideoStream * stream)
 
 	if (stream->ClosingStream && stream->CodecID != AV_CODEC_ID_NONE) {
 		ClearVideo(stream);
+		pthread_mutex_lock(&HistoryLockMutex);
+		if (stream->History) {
+			HistoryReset(stream->History);
+		}
+		pthread_mutex_unlock(&HistoryLockMutex);
 		CodecVideoClose(stream->Decoder);
 		stream->CodecID = AV_CODEC_ID_NONE;
 		stream->ClosingStream = 0;
@@ -1094,30 +1792,48 @@ int VideoDecodeInput(VideoStream * stream)
 	}
 
 	if (stream->NewStream && stream->CodecID != AV_CODEC_ID_NONE) {
+		// wait for the parameter sets to configure the decoder
+		if (!stream->Par && (stream->CodecID == AV_CODEC_ID_H264 ||
+			stream->CodecID == AV_CODEC_ID_HEVC) &&
+			!(stream->Info.HaveSps && stream->Info.HavePps) &&
+			atomic_read(&stream->PacketsFilled) < VIDEO_PARSE_PACKETS) {
+			return -1;
+		}
+		pthread_mutex_lock(&HistoryLockMutex);
+		if (stream->History) {
+			HistoryReset(stream->History);
+		}
+		pthread_mutex_unlock(&HistoryLockMutex);
 		CodecVideoOpen(stream->Decoder, stream->CodecID, stream->Par,
-			&stream->timebase);
+			&stream->timebase, !stream->Par && stream->Info.HaveSps ?
+			&stream->Info : NULL);
 		stream->NewStream = 0;
 		stream->Par = NULL;
 	}
 
-	if (stream->CodecID != AV_CODEC_ID_NONE) {
-		pthread_mutex_lock(&PktsLockMutex);
-		if (!atomic_read(&stream->PacketsFilled)) {
-			pthread_mutex_unlock(&PktsLockMutex);
-			return -1;
-		}
-		avpkt = &stream->PacketRb[stream->PacketRead];
-		if (!CodecVideoSendPacket(stream->Decoder, avpkt)) {
-			stream->PacketRead = (stream->PacketRead + 1) % VIDEO_PACKET_MAX;
-			atomic_dec(&stream->PacketsFilled);
+	if (stream->HistoryMode && stream->CodecID != AV_CODEC_ID_NONE) {
+		if (VideoHistoryFeed(stream) && stream->HistoryMode > 0
+			&& !atomic_read(&stream->PacketsFilled)) {
+			// replay done, jump to the live position
+			VideoHistoryLeave(stream);
+			ClearAudio();
+			SkipAudio = 0;
+			VideoPlay(stream->Render);
+		} else if (stream->HistoryMode == -2) {
+			VideoHistoryFallback(stream);
 		}
-		pthread_mutex_unlock(&PktsLockMutex);
+	}
 
-		if (!stream->NewStream)
-			CodecVideoReceiveFrame(stream->Decoder, 0);
+	// new codec detected meanwhile, open it first
+	if (stream->CodecID == AV_CODEC_ID_NONE || stream->NewStream) {
+		return -1;
 	}
 
-	return 0;
+	// send and receive as long as the decoder moves
+	work = CodecVideoDecode(stream->Decoder, VideoNextPacket,
+		VideoPacketDone, stream);
+
+	return work ? 0 : -1;
 }
 
 /**
@@ -1156,6 +1872,11 @@ int PlayVideo(const uint8_t * data, int size)
 		return 0;
 	}
 
+	// reverse trick play from history, drop the stream
+	if (stream->HistoryMode < 0) {
+		return size;
+	}
+
 	// must be a PES video start code
 	if (size < 9 || !data || data[0] || data[1] || data[2] != 0x01 || data[3] >> 4 != 0x0e) {
 #ifdef DEBUG
@@ -1189,6 +1910,7 @@ int PlayVideo(const uint8_t * data, int size)
 						Debug(3, "video: mpeg2 detected\n");
 						stream->CodecID = AV_CODEC_ID_MPEG2VIDEO;
 						stream->NewStream = 1;
+						memset(&stream->Info, 0, sizeof(stream->Info));
 						stream->timebase.den = 90000;
 						stream->timebase.num = 1;
 						VideoEnqueue(stream, pts, data + i + n, size - i - n);
@@ -1205,6 +1927,7 @@ int PlayVideo(const uint8_t * data, int size)
 						Debug(3, "video: H264 detected\n");
 						stream->CodecID = AV_CODEC_ID_H264;
 						stream->NewStream = 1;
+						memset(&stream->Info, 0, sizeof(stream->Info));
 						stream->timebase.den = 90000;
 						stream->timebase.num = 1;
 						VideoEnqueue(stream, pts, data + i + n, size - i - n);
@@ -1221,6 +1944,7 @@ int PlayVideo(const uint8_t * data, int size)
 						Debug(3, "video: hevc detected\n");
 						stream->CodecID = AV_CODEC_ID_HEVC;
 						stream->NewStream = 1;
+						memset(&stream->Info, 0, sizeof(stream->Info));
 						stream->timebase.den = 90000;
 						stream->timebase.num = 1;
 						VideoEnqueue(stream, pts, data + i + n, size - i - n);
@@ -1254,6 +1978,7 @@ void StillPicture(const uint8_t * data, int size)
 {
 	AVPacket *avpkt;
 	const uint8_t * pos;
+	VideoStreamInfo info;
 	int size_rest;
 	int codec = AV_CODEC_ID_NONE;
 	int i;
@@ -1320,7 +2045,10 @@ void StillPicture(const uint8_t * data, int size)
 	}
 	atomic_inc(&MyVideoStream->PacketsFilled);
 
-	CodecVideoOpen(MyVideoStream->Decoder, codec, NULL, NULL);
+	memset(&info, 0, sizeof(info));
+	VideoParseStreamInfo(&info, codec, avpkt->data, avpkt->size);
+	CodecVideoOpen(MyVideoStream->Decoder, codec, NULL, NULL,
+		info.HaveSps ? &info : NULL);
 	VideoSetTrickSpeed(MyVideoStream->Render, 1);
 
 send:
@@ -1341,16 +2069,15 @@ send:
 }
 
 
-    /// call VDR support function
-extern uint8_t *CreateJpeg(uint8_t *, int *, int, int, int);
-
-#if defined(USE_JPEG) && JPEG_LIB_VERSION >= 80
+#if defined(USE_JPEG) && (JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED))
 
 /**
-**	Create a jpeg image in memory.
+**	Create a jpeg image in memory from planar YUV 4:2:0.
 **
-**	@param image		raw RGB image
-**	@param raw_size		size of raw image
+**	The planes are handed to libjpeg as raw data, there is no color
+**	conversion and no chroma downsampling.
+**
+**	@param image		YUV image of VideoGrabYuv
 **	@param size[out]	size of jpeg image
 **	@param quality		jpeg quality
 **	@param width		number of horizontal pixels in image
@@ -1358,15 +2085,27 @@ extern uint8_t *CreateJpeg(uint8_t *, int *, int, int, int);
 **
 **	@returns allocated jpeg image.
 */
-uint8_t *CreateJpeg(uint8_t * image, int raw_size, int *size, int quality,
+static uint8_t *CreateJpegYuv(uint8_t * image, int *size, int quality,
     int width, int height)
 {
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
-    JSAMPROW row_ptr[1];
-    int row_stride;
+    JSAMPROW y_rows[16];
+    JSAMPROW u_rows[8];
+    JSAMPROW v_rows[8];
+    JSAMPARRAY planes[3];
     uint8_t *outbuf;
     long unsigned int outsize;
+    uint8_t *u;
+    uint8_t *v;
+    int pw;
+    int ph;
+    int i;
+
+    pw = (width + 15) & ~15;
+    ph = (height + 15) & ~15;
+    u = image + pw * ph;
+    v = u + pw * ph / 4;
 
     outbuf = NULL;
     outsize = 0;
@@ -1376,17 +2115,33 @@ uint8_t *CreateJpeg(uint8_t * image, int raw_size, int *size, int quality,
 
     cinfo.image_width = width;
     cinfo.image_height = height;
-    cinfo.input_components = raw_size / height / width;
-    cinfo.in_color_space = JCS_RGB;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
 
     jpeg_set_defaults(&cinfo);
     jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    cinfo.comp_info[1].h_samp_factor = 1;
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;
+    cinfo.comp_info[2].v_samp_factor = 1;
     jpeg_start_compress(&cinfo, TRUE);
 
-    row_stride = width * 3;
+    planes[0] = y_rows;
+    planes[1] = u_rows;
+    planes[2] = v_rows;
+    // one MCU row of 16 luma and 8 chroma lines, padded by the grab
     while (cinfo.next_scanline < cinfo.image_height) {
-	row_ptr[0] = &image[cinfo.next_scanline * row_stride];
-	jpeg_write_scanlines(&cinfo, row_ptr, 1);
+	for (i = 0; i < 16; ++i) {
+	    y_rows[i] = image + (cinfo.next_scanline + i) * pw;
+	}
+	for (i = 0; i < 8; ++i) {
+	    u_rows[i] = u + (cinfo.next_scanline / 2 + i) * (pw / 2);
+	    v_rows[i] = v + (cinfo.next_scanline / 2 + i) * (pw / 2);
+	}
+	jpeg_write_raw_data(&cinfo, planes, 16);
     }
 
     jpeg_finish_compress(&cinfo);
@@ -1396,6 +2151,63 @@ uint8_t *CreateJpeg(uint8_t * image, int raw_size, int *size, int quality,
     return outbuf;
 }
 
+/**
+**	Grab the screen image as jpeg.
+**
+**	@param size[out]	size of jpeg image
+**	@param quality		jpeg quality
+**	@param width		number of horizontal pixels in the frame
+**	@param height		number of vertical pixels in the frame
+*/
+static uint8_t *GrabJpeg(int *size, int quality, int width, int height)
+{
+    uint8_t *image;
+    int raw_size;
+
+    raw_size = 0;
+    image = VideoGrabYuv(&raw_size, &width, &height);
+    if (image) {			// can fail, suspended, ...
+	uint8_t *jpg_image;
+
+	jpg_image = CreateJpegYuv(image, size, quality, width, height);
+
+	free(image);
+	return jpg_image;
+    }
+    return NULL;
+}
+
+#else
+
+    /// call VDR support function
+extern uint8_t *CreateJpeg(uint8_t *, int *, int, int, int);
+
+/**
+**	Grab the screen image as jpeg.
+**
+**	@param size[out]	size of jpeg image
+**	@param quality		jpeg quality
+**	@param width		number of horizontal pixels in the frame
+**	@param height		number of vertical pixels in the frame
+*/
+static uint8_t *GrabJpeg(int *size, int quality, int width, int height)
+{
+    uint8_t *image;
+    int raw_size;
+
+    raw_size = 0;
+    image = VideoGrab(&raw_size, &width, &height, 0);
+    if (image) {			// can fail, suspended, ...
+	uint8_t *jpg_image;
+
+	jpg_image = CreateJpeg(image, size, quality, width, height);
+
+	free(image);
+	return jpg_image;
+    }
+    return NULL;
+}
+
 #endif
 
 /**
@@ -1410,20 +2222,7 @@ uint8_t *CreateJpeg(uint8_t * image, int raw_size, int *size, int quality,
 uint8_t *GrabImage(int *size, int jpeg, int quality, int width, int height)
 {
     if (jpeg) {
-	uint8_t *image;
-	int raw_size;
-
-	raw_size = 0;
-	image = VideoGrab(&raw_size, &width, &height, 0);
-	if (image) {			// can fail, suspended, ...
-	    uint8_t *jpg_image;
-
-	    jpg_image = CreateJpeg(image, size, quality, width, height);
-
-	    free(image);
-	    return jpg_image;
-	}
-	return NULL;
+	return GrabJpeg(size, quality, width, height);
     }
     return VideoGrab(size, &width, &height, 1);
 }
@@ -1460,6 +2259,19 @@ int PlayVideoPkts(AVPacket * pkt)
 {
 	AVPacket *avpkt;
 
+	if (MyVideoStream->HistoryMode) {
+		// forward replay catches up with it
+		if (MyVideoStream->HistoryMode > 0) {
+			pthread_mutex_lock(&HistoryLockMutex);
+			if (MyVideoStream->History) {
+				HistoryAdd(MyVideoStream->History, pkt->pts, pkt->data,
+					pkt->size, pkt->flags & AV_PKT_FLAG_KEY);
+			}
+			pthread_mutex_unlock(&HistoryLockMutex);
+		}
+		return 1;
+	}
+
 	if (atomic_read(&MyVideoStream->PacketsFilled) >= VIDEO_PACKET_MAX - 10) {
 //		fprintf(stderr, "PlayVideoPkts: failed! >= VIDEO_PACKET_MAX\n");
 		return 0;
@@ -1479,6 +2291,14 @@ int PlayVideoPkts(AVPacket * pkt)
 	memcpy(avpkt->data, pkt->data, pkt->size);
 	avpkt->pts = pkt->pts;
 	avpkt->size = pkt->size;
+	VideoPacketQueued();
+
+	pthread_mutex_lock(&HistoryLockMutex);
+	if (MyVideoStream->History) {
+		HistoryAdd(MyVideoStream->History, avpkt->pts, avpkt->data,
+			avpkt->size, pkt->flags & AV_PKT_FLAG_KEY);
+	}
+	pthread_mutex_unlock(&HistoryLockMutex);
 	return 1;
 }
 
@@ -1490,16 +2310,27 @@ int PlayVideoPkts(AVPacket * pkt)
 **	Every single frame shall then be displayed the given number of
 **	times.
 **
+**	Reverse trick play is served from the video history, as long as
+**	the history holds older GOPs, then by the reverse stream of VDR.
+**
 **	@param speed	trick speed
+**	@param forward	flag forward direction
 */
-void TrickSpeed(int speed)
+void TrickSpeed(int speed, int forward)
 {
 #ifdef DEBUG
-	fprintf(stderr, "TrickSpeed: speed %d\n", speed);
+	fprintf(stderr, "TrickSpeed: speed %d %s\n", speed,
+		forward ? "forward" : "backward");
 #endif
 	MyVideoStream->TrickSpeed = speed;
 	VideoSetTrickSpeed(MyVideoStream->Render, speed);
 
+	if (forward) {
+		VideoHistoryLeave(MyVideoStream);
+	} else if (!MyVideoStream->HistoryMode) {
+		VideoHistoryReverse(MyVideoStream);
+	}
+
 	if (StreamFreezed) {
 #ifdef DEBUG
 		fprintf(stderr, "TrickSpeed: StreamFreezed %d SkipAudio %d\n", StreamFreezed, SkipAudio);
@@ -1532,10 +2363,84 @@ void Play(void)
 #endif
 	SkipAudio = 0;
 	StreamFreezed = 0;
+	VideoHistoryLeave(MyVideoStream);
 	AudioPlay();
 	VideoPlay(MyVideoStream->Render);
 }
 
+/**
+**	Replay the last seconds of video from the video history.
+**
+**	Audio is muted and the video is shown in trick mode.  The live
+**	stream is added to the history meanwhile.  When the replay reaches
+**	the position of the jump, video and audio continue live from the
+**	next key frame.
+**
+**	@param seconds	seconds to jump back
+**
+**	@retval 0	replay started
+**	@retval -1	nothing in history
+*/
+int VideoHistoryJump(int seconds)
+{
+	VideoStream *stream = MyVideoStream;
+	unsigned seq;
+	int64_t pts;
+	int ret;
+
+	if (!stream->Render || stream->CodecID == AV_CODEC_ID_NONE
+		|| !stream->timebase.num) {
+		return -1;
+	}
+
+	pts = VideoGetClock(stream->Render) - (int64_t)seconds *
+		stream->timebase.den / stream->timebase.num;
+
+	pthread_mutex_lock(&HistoryLockMutex);
+	ret = -1;
+	if (stream->History) {
+		ret = HistoryFindKey(stream->History, pts, &seq);
+		if (!ret) {
+			ret = HistoryLast(stream->History, &stream->HistoryEnd);
+		}
+	}
+	pthread_mutex_unlock(&HistoryLockMutex);
+	if (ret) {
+		return -1;
+	}
+
+	SkipAudio = 1;
+	ClearAudio();
+	VideoHistoryStart(stream, seq, 1);
+	VideoSetTrickSpeed(stream->Render, 1);
+
+	return 0;
+}
+
+/**
+**	Set memory budget of the video history.
+**
+**	@param size	history size in MB, 0 disables the history
+*/
+void SetVideoHistorySize(int size)
+{
+	History *history;
+
+	history = NULL;
+	if (size > 0 && !(history = HistoryNew((size_t)size * 1024 * 1024))) {
+		Error(_("softhddev: can't allocate %d MB video history\n"), size);
+	}
+
+	VideoHistoryLeave(MyVideoStream);
+
+	pthread_mutex_lock(&HistoryLockMutex);
+	if (MyVideoStream->History) {
+		HistoryDel(MyVideoStream->History);
+	}
+	MyVideoStream->History = history;
+	pthread_mutex_unlock(&HistoryLockMutex);
+}
+
 /**
 **	Sets the device into "freeze frame" mode.
 */
@@ -1630,6 +2535,11 @@ void GetScreenSize(int *width, int *height, double *pixel_aspect)
 	VideoGetScreenSize(MyVideoStream->Render, width, height, pixel_aspect);
 }
 
+void GetOsdSize(int *width, int *height, double *pixel_aspect)
+{
+	VideoGetOsdSize(MyVideoStream->Render, width, height, pixel_aspect);
+}
+
 void *GetVideoRender()
 {
 	return (void *)(MyVideoStream->Render);
@@ -1708,6 +2618,7 @@ void SoftHdDeviceExit(void)
 
     VideoExit(MyVideoStream->Render);
     VideoStreamClose(MyVideoStream);
+    SetVideoHistorySize(0);
 
     CodecExit();
 }
@@ -1783,15 +2694,23 @@ int64_t GetSTC(void)
 **	@param[out] duped	duped frames
 **	@param[out] dropped	dropped frames
 **	@param[out] count	number of decoded frames
+**	@param[out] reused	number of reused decoder contexts
+**	@param[out] reopened	number of newly opened decoder contexts
 */
-void GetStats(int *duped, int *dropped, int *counter)
+void GetStats(int *duped, int *dropped, int *counter, int *reused,
+	int *reopened)
 {
 	*duped = 0;
 	*dropped = 0;
 	*counter = 0;
+	*reused = 0;
+	*reopened = 0;
 	if (MyVideoStream->Render) {
 		VideoGetStats(MyVideoStream->Render, duped, dropped, counter);
 	}
+	if (MyVideoStream->Decoder) {
+		CodecVideoGetStats(MyVideoStream->Decoder, reused, reopened);
+	}
 }
 
 
@@ -1823,6 +2742,39 @@ void OsdClose(void)
     VideoOsdClear(MyVideoStream->Render);
 }
 
+/**
+**	Show the OSD pixmaps drawn since the last flip.
+*/
+void OsdFlip(void)
+{
+    VideoOsdFlip(MyVideoStream->Render);
+}
+
+/**
+**	Lock the OSD buffer for drawing.
+**
+**	@param[out] pitch	pitch of the buffer
+**
+**	@returns 32bit ARGB buffer of osd size, NULL not available.
+*/
+uint8_t *OsdLockBuffer(int *pitch)
+{
+    return VideoOsdLockBuffer(MyVideoStream->Render, pitch);
+}
+
+/**
+**	Unlock the OSD buffer.
+**
+**	@param x	x-coordinate on screen of drawn area
+**	@param y	y-coordinate on screen of drawn area
+**	@param width	width of drawn area
+**	@param height	height of drawn area
+*/
+void OsdUnlockBuffer(int x, int y, int width, int height)
+{
+    VideoOsdUnlockBuffer(MyVideoStream->Render, x, y, width, height);
+}
+
 /**
 **	Draw an OSD pixmap.
 **
@@ -1852,6 +2804,8 @@ const char *CommandLineHelp(void)
     return "  -a device\taudio device (fe. alsa: hw:0,0)\n"
 	"  -p device\taudio device for pass-through (hw:0,1)\n"
 	"  -c channel\taudio mixer channel name (fe. PCM)\n"
+	"  -o WxH\trender the OpenGL OSD at WxH, scaled to the screen\n"
+	"\t\tby the OSD plane (fe. 1920x1080 on 4K)\n"
 	"\n";
 }
 
@@ -1868,7 +2822,7 @@ int ProcessArgs(int argc, char *const argv[])
     //
 
     for (;;) {
-	switch (getopt(argc, argv, "-a:c:p:")) {
+	switch (getopt(argc, argv, "-a:c:o:p:")) {
 	    case 'a':			// audio device for pcm
 		AudioSetDevice(optarg);
 		continue;
@@ -1878,6 +2832,19 @@ int ProcessArgs(int argc, char *const argv[])
 	    case 'p':			// pass-through audio device
 		AudioSetPassthroughDevice(optarg);
 		continue;
+	    case 'o':			// osd render size
+		{
+		    int width;
+		    int height;
+
+		    if (sscanf(optarg, "%dx%d", &width, &height) != 2
+			|| width <= 0 || height <= 0) {
+			fprintf(stderr, _("Bad OSD size '%s'\n"), optarg);
+			return 0;
+		    }
+		    VideoSetOsdSize(width, height);
+		}
+		continue;
 	    case EOF:
 		break;
 	    case '-':
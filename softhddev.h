@@ -39,6 +39,12 @@ extern "C"
     /// C plugin draw osd pixmap
     extern void OsdDrawARGB(int, int, int, int, int, const uint8_t *, int,
 		int);
+    /// C plugin show drawn osd pixmaps
+    extern void OsdFlip(void);
+    /// C plugin lock osd buffer for drawing
+    extern uint8_t *OsdLockBuffer(int *);
+    /// C plugin unlock osd buffer
+    extern void OsdUnlockBuffer(int, int, int, int);
 
     /// C plugin play media file
     extern void SetAudioCodec(int, AVCodecParameters *, AVRational *);
@@ -57,6 +63,8 @@ extern "C"
     extern int PlayVideo(const uint8_t *, int);
     /// Decode video input buffers.
     extern int VideoDecodeInput(VideoStream *);
+    /// Wait for video input.
+    extern void VideoWaitInput(void);
     /// Get number of input buffers.
     extern int VideoGetPackets(void);
     /// C plugin grab an image
@@ -65,11 +73,15 @@ extern "C"
     /// C plugin set play mode
     extern int SetPlayMode(int);
     /// C plugin set trick speed
-    extern void TrickSpeed(int);
+    extern void TrickSpeed(int, int);
     /// C plugin clears all video and audio data from the device
     extern void Clear(void);
     /// C plugin sets the device into play mode
     extern void Play(void);
+    /// C plugin replay video from history
+    extern int VideoHistoryJump(int);
+    /// C plugin set video history size
+    extern void SetVideoHistorySize(int);
     /// C plugin sets the device into "freeze frame" mode
     extern void Freeze(void);
     /// C plugin mute audio
@@ -84,6 +96,7 @@ extern "C"
     extern int64_t GetSTC(void);
     /// C plugin get video stream size and aspect
     extern void GetScreenSize(int *, int *, double *);
+    extern void GetOsdSize(int *, int *, double *);
     /// C plugin command line help
     extern const char *CommandLineHelp(void);
     /// C plugin process the command line arguments
@@ -98,9 +111,7 @@ extern "C"
     /// C plugin house keeping
 
     /// Get decoder statistics
-    extern void GetStats(int *, int *, int *);
-    /// Get parsed width and height
-    extern void ParseResolutionH264(int *, int *);
+    extern void GetStats(int *, int *, int *, int *, int *);
     /// C plugin scale video
     extern void ScaleVideo(int, int, int, int);
 
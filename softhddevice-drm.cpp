@@ -27,6 +27,9 @@
 using std::string;
 #include <fstream>
 using std::ifstream;
+#include <vector>
+using std::vector;
+#include <algorithm>
 
 #include <vdr/player.h>
 #include <vdr/plugin.h>
@@ -109,6 +112,8 @@ cSoftOsd::cSoftOsd(int left, int top, uint level)
 #endif
 
     OsdLevel = level;
+    Scratch = NULL;
+    ScratchSize = 0;
 }
 
 /**
@@ -127,6 +132,7 @@ cSoftOsd::~cSoftOsd(void)
 
     SetActive(false);
     // done by SetActive: OsdClose();
+    free(Scratch);
 }
 
 /**
@@ -154,6 +160,189 @@ eOsdError cSoftOsd::SetAreas(const tArea * areas, int n)
     return cOsd::SetAreas(areas, n);
 }
 
+/**
+**	Convert an area of a palette bitmap to ARGB.
+**
+**	Walks the index rows directly through a 256 entry color table,
+**	no palette lookup per pixel.
+**
+**	@param bitmap	palette bitmap
+**	@param x1	x-coordinate of area in bitmap
+**	@param y1	y-coordinate of area in bitmap
+**	@param w	width of area
+**	@param h	height of area
+**	@param[out] argb	w * h pixels
+*/
+static void BitmapToArgb(const cBitmap * bitmap, int x1, int y1, int w, int h,
+    uint32_t * argb)
+{
+    uint32_t lut[256];
+    const tColor *colors;
+    int num_colors;
+    int x;
+    int y;
+
+    colors = bitmap->Colors(num_colors);
+    if (!colors || num_colors > 256) {
+	num_colors = 0;
+    } else {
+	memcpy(lut, colors, num_colors * sizeof(*lut));
+    }
+    memset(lut + num_colors, 0, (256 - num_colors) * sizeof(*lut));
+
+    for (y = 0; y < h; ++y) {
+	const tIndex *src = bitmap->Data(x1, y1 + y);
+	uint32_t *dst = argb + y * w;
+
+	for (x = 0; x + 4 <= w; x += 4) {
+	    dst[x + 0] = lut[src[x + 0]];
+	    dst[x + 1] = lut[src[x + 1]];
+	    dst[x + 2] = lut[src[x + 2]];
+	    dst[x + 3] = lut[src[x + 3]];
+	}
+	for (; x < w; ++x) {
+	    dst[x] = lut[src[x]];
+	}
+    }
+}
+
+#ifndef USE_GLES
+
+/**
+**	Create a new pixmap.
+**
+**	The pixmap is composed by the CPU OSD compositor.
+**
+**	@param layer	layer of pixmap, negative hidden
+**	@param viewPort	area of pixmap on the osd
+**	@param drawPort	area of pixmap data, relative to view port
+*/
+cPixmap *cSoftOsd::CreatePixmap(int layer, const cRect & viewPort,
+    const cRect & drawPort)
+{
+    cSoftPixmap *pm;
+    int i;
+
+    LOCK_PIXMAPS;
+    pm = new cSoftPixmap(layer, viewPort, drawPort);
+    if (!cOsd::AddPixmap(pm)) {
+	delete pm;
+	return NULL;
+    }
+    // find free slot
+    for (i = 0; i < SoftPixmaps.Size(); ++i) {
+	if (!SoftPixmaps[i]) {
+	    return SoftPixmaps[i] = pm;
+	}
+    }
+    SoftPixmaps.Append(pm);
+    return pm;
+}
+
+/**
+**	Destroy a pixmap.
+**
+**	The area of a shown pixmap is composed again with the next flush.
+**
+**	@param pixmap	pixmap to destroy
+*/
+void cSoftOsd::DestroyPixmap(cPixmap * pixmap)
+{
+    int i;
+
+    if (!pixmap) {
+	return;
+    }
+    LOCK_PIXMAPS;
+    for (i = 0; i < SoftPixmaps.Size(); ++i) {
+	if (SoftPixmaps[i] == pixmap) {
+	    if (pixmap->Layer() >= 0 || SoftPixmaps[i]->Shown()) {
+		Damage.Combine(pixmap->ViewPort());
+	    }
+	    SoftPixmaps[i] = NULL;
+	    break;
+	}
+    }
+    cOsd::DestroyPixmap(pixmap);
+}
+
+/**
+**	Compose the dirty area of all pixmaps into the OSD buffer.
+**
+**	The pixmaps are blended directly into the back buffer of the video
+**	module, no intermediate pixmap is rendered or copied.
+**
+**	@returns false, if the video module has no OSD buffer to compose
+**	into.
+*/
+bool cSoftOsd::ComposePixmaps(void)
+{
+    cRect dirty;
+    uint8_t *buf;
+    int pitch;
+    int width;
+    int height;
+    double video_aspect;
+    int layer;
+    int i;
+
+    if (!(buf = OsdLockBuffer(&pitch))) {
+	return false;
+    }
+
+    LOCK_PIXMAPS;
+    dirty = Damage;
+    Damage = cRect::Null;
+    if (Dirty) {			// forced complete update
+	dirty = cRect(0, 0, Width(), Height());
+    }
+    for (i = 0; i < SoftPixmaps.Size(); ++i) {
+	cSoftPixmap *pm = SoftPixmaps[i];
+	cRect area;
+
+	if (!pm) {
+	    continue;
+	}
+	area = pm->TakeDirty();
+	if (pm->Layer() >= 0 || pm->Shown()) {
+	    dirty.Combine(area);
+	}
+	pm->SetShown(pm->Layer() >= 0);
+    }
+
+    // clip to osd and screen
+    ::GetOsdSize(&width, &height, &video_aspect);
+    dirty = dirty.Intersected(cRect(0, 0, Width(), Height()));
+    dirty = dirty.Intersected(cRect(-Left(), -Top(), width, height));
+    if (dirty.IsEmpty()) {
+	OsdUnlockBuffer(0, 0, 0, 0);
+	return true;
+    }
+
+    // layers bottom up, same layer in creation order
+    Layers.clear();
+    for (layer = 0; layer < MAXPIXMAPLAYERS; ++layer) {
+	for (i = 0; i < SoftPixmaps.Size(); ++i) {
+	    if (SoftPixmaps[i] && SoftPixmaps[i]->Layer() == layer) {
+		Layers.push_back(SoftPixmaps[i]);
+	    }
+	}
+    }
+#ifdef OSD_DEBUG
+    dsyslog("[softhddev] OSD %s: compose %dx%d%+d%+d, %zu pixmaps\n",
+	__FUNCTION__, dirty.Width(), dirty.Height(), dirty.X() + Left(),
+	dirty.Y() + Top(), Layers.size());
+#endif
+    cSoftCompositor::Instance()->Compose(Layers.data(), Layers.size(), dirty,
+	buf, pitch, cPoint(Left(), Top()));
+
+    OsdUnlockBuffer(dirty.X() + Left(), dirty.Y() + Top(), dirty.Width(),
+	dirty.Height());
+    return true;
+}
+
+#endif
+
 /**
 **	Actually commits all data to the OSD hardware.
 */
@@ -185,11 +374,8 @@ void cSoftOsd::Flush(void)
 #endif
 	// draw all bitmaps
 	for (i = 0; (bitmap = GetBitmap(i)); ++i) {
-	    uint8_t *argb;
 	    int xs;
 	    int ys;
-	    int x;
-	    int y;
 	    int w;
 	    int h;
 	    int x1;
@@ -238,7 +424,7 @@ void cSoftOsd::Flush(void)
 		    }
 		    ys = 0;
 		}
-		::GetScreenSize(&width, &height, &video_aspect);
+		::GetOsdSize(&width, &height, &video_aspect);
 		if (w > width - xs - x1) {
 		    w = width - xs - x1;
 		    if (w <= 0) {
@@ -260,28 +446,41 @@ void cSoftOsd::Flush(void)
 		abort();
 	    }
 #endif
-	    argb = (uint8_t *) malloc(w * h * sizeof(uint32_t));
-	    for (y = y1; y <= y2; ++y) {
-		for (x = x1; x <= x2; ++x) {
-		    ((uint32_t *) argb)[x - x1 + (y - y1) * w] =
-			bitmap->GetColor(x, y);
+	    // scratch buffer grows to the largest dirty area
+	    if (w * h > ScratchSize) {
+		uint32_t *scratch;
+
+		if (!(scratch = (uint32_t *) realloc(Scratch,
+			    w * h * sizeof(uint32_t)))) {
+		    esyslog(tr("[softhddev]: out of memory\n"));
+		    continue;
 		}
+		Scratch = scratch;
+		ScratchSize = w * h;
 	    }
+	    BitmapToArgb(bitmap, x1, y1, w, h, Scratch);
 #ifdef OSD_DEBUG
 	    dsyslog("[softhddev] OSD %s: draw %dx%d%+d%+d bm\n", __FUNCTION__, w, h,
 		xs + x1, ys + y1);
 #endif
-	    OsdDrawARGB(0, 0, w, h, w * sizeof(uint32_t), argb, xs + x1,
-		ys + y1);
+	    OsdDrawARGB(0, 0, w, h, w * sizeof(uint32_t),
+		(const uint8_t *)Scratch, xs + x1, ys + y1);
 
 	    bitmap->Clean();
-	    // FIXME: reuse argb
-	    free(argb);
 	}
+	OsdFlip();
 	Dirty = 0;
 	return;
     }
 
+#ifndef USE_GLES
+    if (ComposePixmaps()) {
+	OsdFlip();
+	Dirty = 0;
+	return;
+    }
+#endif
+
     LOCK_PIXMAPS;
     while ((pm = (dynamic_cast < cPixmapMemory * >(RenderPixmaps())))) {
 	int xp;
@@ -341,7 +540,7 @@ void cSoftOsd::Flush(void)
 		y = 0;
 	    }
 
-	    ::GetScreenSize(&width, &height, &video_aspect);
+	    ::GetOsdSize(&width, &height, &video_aspect);
 	    if (w > width - x) {
 		w = width - x;
 	    }
@@ -357,6 +556,7 @@ void cSoftOsd::Flush(void)
 
 	DestroyPixmap(pm);
     }
+    OsdFlip();
     Dirty = 0;
 }
 
@@ -421,8 +621,18 @@ bool cSoftOsdProvider::StartOpenGlThread(void) {
         oglThread.reset();
     }
     cCondWait wait;
+    cOglContext *context = NULL;
+
     dsyslog("[softhddev]Trying to start openGL worker thread\n");
-    oglThread.reset(new cOglThread(&wait, ConfigMaxSizeGPUImageCache));
+    if (offscreen) {
+        int width;
+        int height;
+        double aspect;
+
+        ::GetOsdSize(&width, &height, &aspect);
+        context = new cOglPbufferContext(width, height);
+    }
+    oglThread.reset(new cOglThread(&wait, ConfigMaxSizeGPUImageCache, context));
     wait.Wait();
 
     if (oglThread->Active()) {
@@ -434,6 +644,24 @@ bool cSoftOsdProvider::StartOpenGlThread(void) {
     return false;
 }
 
+/**
+**	Render the OpenGL OSD offscreen or to the display.
+**
+**	The OpenGL thread is restarted, images stored before are dropped
+**	like on an OSD size change.  Only called with all OSDs closed.
+**
+**	@param on	render offscreen to a pbuffer
+**
+**	@returns true if the OpenGL thread runs.
+*/
+bool cSoftOsdProvider::SetOffscreen(bool on) {
+    if (on != offscreen) {
+        StopOpenGlThread();
+        offscreen = on;
+    }
+    return StartOpenGlThread();
+}
+
 void cSoftOsdProvider::StopOpenGlThread(void) {
     dsyslog("[softhddev]stopping openGL worker thread\n");
     if (oglThread) {
@@ -471,6 +699,8 @@ cSoftOsdProvider::~cSoftOsdProvider()
 #endif
 #ifdef USE_GLES
     StopOpenGlThread();
+#else
+    cSoftCompositor::Shutdown();
 #endif
 }
 
@@ -532,6 +762,8 @@ void cMenuSetupSoft::Create(void)
 		trVDR("no"), trVDR("yes")));
 	Add(new cMenuEditBoolItem(tr("Hide main menu entry"),
 		&HideMainMenuEntry, trVDR("no"), trVDR("yes")));
+	Add(new cMenuEditIntItem(tr("Video history size (MB)"),
+		&VideoHistorySize, 0, 1024));
 	//
 	//	osd
 	//
@@ -668,6 +900,7 @@ cMenuSetupSoft::cMenuSetupSoft(void)
     General = 0;
     MakePrimary = ConfigMakePrimary;
     HideMainMenuEntry = ConfigHideMainMenuEntry;
+    VideoHistorySize = ConfigVideoHistorySize;
     //
     //	audio
     //
@@ -709,6 +942,10 @@ void cMenuSetupSoft::Store(void)
 {
     SetupStore("MakePrimary", ConfigMakePrimary = MakePrimary);
     SetupStore("HideMainMenuEntry", ConfigHideMainMenuEntry = HideMainMenuEntry);
+    if (ConfigVideoHistorySize != VideoHistorySize) {
+	SetupStore("VideoHistorySize", ConfigVideoHistorySize = VideoHistorySize);
+	SetVideoHistorySize(ConfigVideoHistorySize);
+    }
     SetupStore("AudioDelay", ConfigVideoAudioDelay = AudioDelay);
     VideoSetAudioDelay(ConfigVideoAudioDelay);
 
@@ -905,7 +1142,7 @@ void cSoftHdDevice::TrickSpeed(int speed, bool forward)
 	fprintf(stderr, "[softhddev]TrickSpeed: speed %d %s\n",
 		speed, forward ? "forward" : "backward");
 #endif
-    ::TrickSpeed(speed);
+    ::TrickSpeed(speed, forward);
 }
 
 /**
@@ -1063,7 +1300,7 @@ void cSoftHdDevice::GetVideoSize(int &width, int &height, double &video_aspect)
 */
 void cSoftHdDevice::GetOsdSize(int &width, int &height, double &pixel_aspect)
 {
-    ::GetScreenSize(&width, &height, &pixel_aspect);
+    ::GetOsdSize(&width, &height, &pixel_aspect);
 }
 
 // ----------------------------------------------------------------------------
@@ -1362,6 +1599,10 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
 	ConfigHideMainMenuEntry = atoi(value);
 	return true;
     }
+    if (!strcasecmp(name, "VideoHistorySize")) {
+	SetVideoHistorySize(ConfigVideoHistorySize = atoi(value));
+	return true;
+    }
     if (!strcasecmp(name, "AudioDelay")) {
 	VideoSetAudioDelay(ConfigVideoAudioDelay = atoi(value));
 	return true;
@@ -1566,6 +1807,241 @@ bool cPluginSoftHdDevice::Service(const char *id, void *data)
     return false;
 }
 
+//----------------------------------------------------------------------------
+//	OSD benchmark
+//----------------------------------------------------------------------------
+
+#define OSD_BENCH_ROWS 12		///< list rows of the benchmark menu
+
+static cMutex OsdBenchMutex;		///< protects the queued benchmark
+static int OsdBenchFlushes;		///< flushes of queued benchmark, 0 none
+static bool OsdBenchOffscreen;		///< queued benchmark renders offscreen
+static bool OsdBenchRunning;		///< benchmark runs in main thread
+static cString OsdBenchResult = "no OSD benchmark run";	///< last result
+static int OsdBenchReply = 550;		///< SVDRP reply code of last result
+
+/**
+**	Get monotonic time in us for the OSD benchmark.
+*/
+static int64_t OsdBenchTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+**	Draw the header of the benchmark menu.
+**
+**	@returns number of draw commands.
+*/
+static int OsdBenchHeader(cPixmap * header, const cFont * font, int logo,
+    int w, int h, int n)
+{
+    header->DrawRectangle(cRect(0, 0, w, h), 0xE0102040);
+    header->DrawEllipse(cRect(w - h, h / 4, h / 2, h / 2),
+	n & 1 ? 0xFF20C040 : 0xFFC02040);
+    header->DrawImage(cPoint(h / 4, (h - 64) / 2), logo);
+    header->DrawText(cPoint(h + 64, 0), cString::sprintf("Benchmark %d",
+	    n), clrWhite, clrTransparent, font, w - 2 * h - 64, h, taLeft);
+
+    return 4;
+}
+
+/**
+**	Draw a row of the benchmark menu list.
+**
+**	@returns number of draw commands.
+*/
+static int OsdBenchRow(cPixmap * list, const cFont * font, int row, int w,
+    int h)
+{
+    list->DrawRectangle(cRect(0, row * h, w, h),
+	row & 1 ? 0xC0202830 : 0xC0283038);
+    list->DrawText(cPoint(h / 2, row * h), cString::sprintf("%d Menu item",
+	    row + 1), clrWhite, clrTransparent, font, w - h, h, taLeft);
+
+    return 2;
+}
+
+/**
+**	Replay a skin like draw sequence on a test OSD.
+**
+**	A menu with header, logo and list is drawn.  Each flush moves the
+**	selection and redraws the two rows involved, every fourth flush
+**	the header too.  The same sequence runs on the OpenGL and the CPU
+**	OSD, the flush latency includes the OpenGL thread.
+**
+**	@param flushes		number of flushes to replay
+**	@param reply_code	SVDRP reply code
+*/
+static cString OsdBenchmark(int flushes, int &reply_code)
+{
+    vector < int >latency;
+    cOsd *osd;
+    cPixmap *header;
+    cPixmap *list;
+    cPixmap *sel;
+    const cFont *font;
+    cImage image(cSize(64, 64));
+    int64_t start;
+    int64_t elapsed;
+    long executed_start;
+    long executed;
+    int commands;
+    int logo;
+    int w;
+    int h;
+    int x;
+    int y;
+    int i;
+
+    if (cOsd::IsOpen()) {
+	reply_code = 550;
+	return "OSD is open";
+    }
+    w = cOsd::OsdWidth();
+    h = cOsd::OsdHeight();
+    tArea area = { 0, 0, w - 1, h - 1, 32 };
+
+    if (!(osd = cOsdProvider::NewOsd(cOsd::OsdLeft(), cOsd::OsdTop()))) {
+	reply_code = 550;
+	return "can't open OSD";
+    }
+    if (osd->SetAreas(&area, 1) != oeOk) {
+	delete osd;
+	reply_code = 550;
+	return "no true color OSD";
+    }
+    h /= OSD_BENCH_ROWS + 3;
+    header = osd->CreatePixmap(1, cRect(0, 0, w, 2 * h));
+    list = osd->CreatePixmap(1, cRect(0, 2 * h, w, OSD_BENCH_ROWS * h));
+    sel = osd->CreatePixmap(2, cRect(0, 2 * h, w, h));
+    if (!header || !list || !sel) {
+	delete osd;
+	reply_code = 550;
+	return "can't create pixmaps";
+    }
+    font = cFont::GetFont(fontOsd);
+
+    for (y = 0; y < 64; ++y) {
+	for (x = 0; x < 64; ++x) {
+	    image.SetPixel(cPoint(x, y),
+		(tColor) (0x80 + x * 2) << 24 | x * 4 << 16 | y * 4 << 8 | 0x80);
+	}
+    }
+    logo = cOsdProvider::StoreImage(image);
+
+    // initial menu, not measured
+    OsdBenchHeader(header, font, logo, w, 2 * h, 0);
+    for (i = 0; i < OSD_BENCH_ROWS; ++i) {
+	OsdBenchRow(list, font, i, w, h);
+    }
+    sel->DrawRectangle(cRect(0, 0, w, h), 0x604080FF);
+    osd->Flush();
+    executed_start = 0;
+    executed = 0;
+#ifdef USE_GLES
+    cSoftOsdProvider::SyncOsd(&executed_start);
+#endif
+
+    commands = 0;
+    start = OsdBenchTime();
+    for (i = 0; i < flushes; ++i) {
+	int64_t flush;
+	int next;
+
+	next = (i + 1) % OSD_BENCH_ROWS;
+	commands += OsdBenchRow(list, font, i % OSD_BENCH_ROWS, w, h);
+	commands += OsdBenchRow(list, font, next, w, h);
+	sel->SetViewPort(cRect(0, (2 + next) * h, w, h));
+	commands++;
+	if (!(i % 4)) {
+	    commands += OsdBenchHeader(header, font, logo, w, 2 * h, i);
+	}
+
+	flush = OsdBenchTime();
+	osd->Flush();
+#ifdef USE_GLES
+	cSoftOsdProvider::SyncOsd(&executed);
+#endif
+	latency.push_back(OsdBenchTime() - flush);
+    }
+    elapsed = OsdBenchTime() - start;
+
+    delete osd;
+    cOsdProvider::DropImage(logo);
+
+    std::sort(latency.begin(), latency.end());
+    return cString::sprintf("%d flushes %d commands in %d ms, %d commands/s,"
+	" flush latency p50 %d p95 %d p99 %d max %d us, GL commands per"
+	" flush %ld", flushes, commands, (int)(elapsed / 1000),
+	elapsed ? (int)(commands * 1000000LL / elapsed) : 0,
+	latency[(flushes - 1) * 50 / 100], latency[(flushes - 1) * 95 / 100],
+	latency[(flushes - 1) * 99 / 100], latency[flushes - 1],
+	executed > executed_start ? (executed - executed_start) / flushes : 0L);
+}
+
+/**
+**	Run the queued OSD benchmark.
+**
+**	Called by the main thread, which opens all other OSDs, so no OSD
+**	can be opened while the benchmark runs.
+*/
+static void OsdBenchRun(void)
+{
+    cString result;
+    bool offscreen;
+    int flushes;
+    int reply_code;
+
+    OsdBenchMutex.Lock();
+    flushes = OsdBenchFlushes;
+    offscreen = OsdBenchOffscreen;
+    OsdBenchFlushes = 0;
+    OsdBenchRunning = flushes > 0;
+    OsdBenchMutex.Unlock();
+    if (!flushes) {
+	return;
+    }
+
+    reply_code = 900;
+    if (cOsd::IsOpen()) {
+	reply_code = 550;
+	result = "OSD is open";
+    } else if (!offscreen) {
+	result = OsdBenchmark(flushes, reply_code);
+    } else {
+#ifdef USE_GLES
+	// same OSD stack on a pbuffer, independent of the display
+	if (cSoftOsdProvider::SetOffscreen(true)) {
+	    result = OsdBenchmark(flushes, reply_code);
+	} else {
+	    reply_code = 550;
+	    result = "no offscreen EGL context";
+	}
+	cSoftOsdProvider::SetOffscreen(false);
+#endif
+    }
+    isyslog("[softhddev] OSD benchmark: %s", *result);
+
+    OsdBenchMutex.Lock();
+    OsdBenchResult = result;
+    OsdBenchReply = reply_code;
+    OsdBenchRunning = false;
+    OsdBenchMutex.Unlock();
+}
+
+/**
+**	Called for every plugin once during every cycle of VDR's main
+**	program loop.
+*/
+void cPluginSoftHdDevice::MainThreadHook(void)
+{
+    OsdBenchRun();
+}
+
 //----------------------------------------------------------------------------
 //	cPlugin SVDRP
 //----------------------------------------------------------------------------
@@ -1576,6 +2052,13 @@ bool cPluginSoftHdDevice::Service(const char *id, void *data)
 */
 static const char *SVDRPHelpText[] = {
 	"PLAY Url\n" "    Play the media from the given url.\n",
+	"BACK [seconds]\n" "    Replay the last seconds (default 10) from the video history.\n",
+	"STAT\n" "    Show video decoder statistics.\n",
+	"OSDB [flushes] [OFFSCREEN]\n"
+	"    Queue a skin draw sequence (default 200 flushes) on a test OSD,\n"
+	"    run by the main loop, when the OSD is closed.  OFFSCREEN renders\n"
+	"    the OpenGL OSD to a surfaceless EGL pbuffer.\n",
+	"OSDR\n" "    Show the result of the last OSD benchmark.\n",
 	NULL
 };
 
@@ -1598,8 +2081,7 @@ const char **cPluginSoftHdDevice::SVDRPHelpPages(void)
 **	@param reply_code	reply code
 */
 cString cPluginSoftHdDevice::SVDRPCommand(const char *command,
-		__attribute__ ((unused)) const char *option,
-		__attribute__ ((unused)) int &reply_code)
+		const char *option, int &reply_code)
 {
 	if (!strcasecmp(command, "PLAY")) {
 #ifdef MEDIA_DEBUG
@@ -1608,6 +2090,94 @@ cString cPluginSoftHdDevice::SVDRPCommand(const char *command,
 		cControl::Launch(new cSoftHdControl(option));
 		return "PLAY url";
 	}
+	if (!strcasecmp(command, "BACK")) {
+		int seconds = option && *option ? atoi(option) : 10;
+
+		if (seconds <= 0) {
+			reply_code = 501;
+			return "invalid seconds";
+		}
+		if (VideoHistoryJump(seconds)) {
+			reply_code = 550;
+			return "video history empty or disabled";
+		}
+		return cString::sprintf("replay last %d s", seconds);
+	}
+	if (!strcasecmp(command, "OSDB")) {
+		const char *s = skipspace(option ? option : "");
+		bool offscreen = false;
+		long flushes;
+		char *end;
+
+		flushes = strtol(s, &end, 10);
+		if (end == s) {
+			flushes = 200;
+		}
+		s = skipspace(end);
+		if (!strcasecmp(s, "OFFSCREEN")) {
+#ifndef USE_GLES
+			reply_code = 501;
+			return "offscreen needs the OpenGL OSD";
+#endif
+			offscreen = true;
+		} else if (*s) {
+			reply_code = 501;
+			return "invalid option";
+		}
+		if (flushes <= 0 || flushes > 10000) {
+			reply_code = 501;
+			return "invalid flushes";
+		}
+		cMutexLock lock(&OsdBenchMutex);
+
+		if (OsdBenchFlushes || OsdBenchRunning) {
+			reply_code = 550;
+			return "OSD benchmark already queued";
+		}
+		OsdBenchFlushes = flushes;
+		OsdBenchOffscreen = offscreen;
+		return cString::sprintf("OSD benchmark of %ld flushes queued, see OSDR",
+			flushes);
+	}
+	if (!strcasecmp(command, "OSDR")) {
+		cMutexLock lock(&OsdBenchMutex);
+
+		if (OsdBenchFlushes || OsdBenchRunning) {
+			reply_code = 550;
+			return "OSD benchmark not done yet";
+		}
+		reply_code = OsdBenchReply;
+		return OsdBenchResult;
+	}
+	if (!strcasecmp(command, "STAT")) {
+		int duped, dropped, counter, reused, reopened;
+
+		GetStats(&duped, &dropped, &counter, &reused, &reopened);
+#ifdef USE_GLES
+		int flushes, pixels, pixels_avg;
+		int hits = 0, misses = 0, evictions = 0;
+		int fb_hits, fb_misses;
+		long resident = 0, pooled;
+
+		cOglOsd::GetStats(&flushes, &pixels, &pixels_avg);
+		cSoftOsdProvider::GetImageCacheStats(&hits, &misses,
+		    &evictions, &resident);
+		cOglFb::GetPoolStats(&fb_hits, &fb_misses, &pooled);
+		return cString::sprintf("frames %d duped %d dropped %d,"
+			" decoder reused %d reopened %d, osd flushes %d"
+			" pixels composited last %d avg %d, image cache hits %d"
+			" misses %d evictions %d resident %ld kB, framebuffer"
+			" pool hits %d misses %d pooled %ld kB%s", counter,
+			duped, dropped, reused, reopened, flushes, pixels,
+			pixels_avg, hits, misses, evictions, resident / 1024,
+			fb_hits, fb_misses, pooled / 1024,
+			*cOglFont::GetRunCacheStats());
+#else
+		return cString::sprintf("frames %d duped %d dropped %d,"
+			" decoder reused %d reopened %d", counter, duped, dropped,
+			reused, reopened);
+#endif
+	}
 
     return NULL;
 }
@@ -32,6 +32,8 @@ static const char *const VERSION = "0.0.1rc1"
 
 #ifdef USE_GLES
 #include "openglosd.h"
+#else
+#include "softosd.h"
 #endif
 
     /// vdr-plugin description.
@@ -49,6 +51,7 @@ static class cSoftHdDevice *MyDevice;
 static char ConfigMakePrimary;		///< config primary wanted
 static char ConfigHideMainMenuEntry;	///< config hide main menu entry
 static int ConfigVideoAudioDelay;	///< config audio delay
+static int ConfigVideoHistorySize;	///< config video history size in MB
 static char ConfigAudioPassthrough;	///< config audio pass-through mask
 static char AudioPassthroughState;	///< flag audio pass-through on/off
 static char ConfigAudioDownmix;		///< config ffmpeg audio downmix
@@ -80,6 +83,17 @@ static int ConfigMaxSizeGPUImageCache = 128;
 */
 class cSoftOsd:public cOsd
 {
+  private:
+    uint32_t *Scratch;			///< argb of converted bitmaps
+    int ScratchSize;			///< pixels in scratch buffer
+#ifndef USE_GLES
+    cVector < cSoftPixmap * >SoftPixmaps;	///< pixmaps, NULL free slot
+    vector < cSoftPixmap * >Layers;	///< visible pixmaps, bottom first
+    cRect Damage;			///< area of destroyed pixmaps
+
+    bool ComposePixmaps(void);		///< compose pixmaps into osd buffer
+#endif
+
   public:
     static volatile char Dirty;		///< flag force redraw everything
     int OsdLevel;			///< current osd level FIXME: remove
@@ -90,6 +104,12 @@ class cSoftOsd:public cOsd
     virtual eOsdError SetAreas(const tArea *, int);
     virtual void Flush(void);		///< commits all data to the hardware
     virtual void SetActive(bool);	///< sets OSD to be the active one
+#ifndef USE_GLES
+    /// create a new pixmap
+    virtual cPixmap *CreatePixmap(int, const cRect &, const cRect & =
+	cRect::Null);
+    virtual void DestroyPixmap(cPixmap *);	///< destroy a pixmap
+#endif
 };
 
 volatile char cSoftOsd::Dirty;		///< flag force redraw everything
@@ -108,6 +128,7 @@ class cSoftOsdProvider:public cOsdProvider
     static cOsd *Osd;			///< single OSD
 #ifdef USE_GLES
     static std::shared_ptr<cOglThread> oglThread;
+    static bool offscreen;		///< render to a pbuffer, not the display
     static bool StartOpenGlThread(void);
   protected:
     virtual int StoreImageData(const cImage &Image);
@@ -121,6 +142,9 @@ class cSoftOsdProvider:public cOsdProvider
     static void StopOpenGlThread(void);
     static const cImage *GetImageData(int ImageHandle);
     static void OsdSizeChanged(void);
+    static bool GetImageCacheStats(int *, int *, int *, long *);
+    static bool SyncOsd(long *);
+    static bool SetOffscreen(bool);
 #endif
     virtual ~cSoftOsdProvider();	///< OSD provider destructor
 };
@@ -129,6 +153,7 @@ cOsd *cSoftOsdProvider::Osd;		///< single osd
 
 #ifdef USE_GLES
 std::shared_ptr<cOglThread> cSoftOsdProvider::oglThread;	// openGL worker Thread
+bool cSoftOsdProvider::offscreen;
 
 int cSoftOsdProvider::StoreImageData(const cImage &Image)
 {
@@ -144,6 +169,24 @@ void cSoftOsdProvider::DropImageData(int imgHandle)
     if (StartOpenGlThread())
         oglThread->DropImageData(imgHandle);
 }
+
+bool cSoftOsdProvider::GetImageCacheStats(int *hits, int *misses,
+    int *evictions, long *resident)
+{
+    if (!oglThread.get())
+        return false;
+    oglThread->GetImageCacheStats(hits, misses, evictions, resident);
+    return true;
+}
+
+bool cSoftOsdProvider::SyncOsd(long *executed)
+{
+    if (!oglThread.get() || !oglThread->Active())
+        return false;
+    oglThread->Sync();
+    *executed = oglThread->Executed();
+    return true;
+}
 #endif
 
 //////////////////////////////////////////////////////////////////////////////
@@ -162,6 +205,7 @@ class cMenuSetupSoft:public cMenuSetupPage
     int General;
     int MakePrimary;
     int HideMainMenuEntry;
+    int VideoHistorySize;
 
     int Audio;
     int AudioDelay;
@@ -271,6 +315,7 @@ class cPluginSoftHdDevice:public cPlugin
     virtual cMenuSetupPage *SetupMenu(void);
     virtual bool SetupParse(const char *, const char *);
     virtual bool Service(const char *, void * = NULL);
+    virtual void MainThreadHook(void);
     virtual const char **SVDRPHelpPages(void);
     virtual cString SVDRPCommand(const char *, const char *, int &);
 };
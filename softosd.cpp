@@ -0,0 +1,411 @@
+///
+///	@file softosd.cpp	@brief CPU OSD compositor
+///
+///	Copyright (c) 2021 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup SoftOsd The CPU OSD compositor.
+///
+///	Used for true color OSDs, if there is no OpenGL.  The pixmaps are
+///	blended bottom up directly into the OSD buffer of the video module,
+///	only the dirty area of a flush is composed.  Each row is cleared
+///	and all visible pixmaps are blended over it, which keeps every
+///	pixel in the cache while it is written.
+///
+
+#include <string.h>
+#include <unistd.h>
+
+#include "softosd.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//	Blending
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Multiply all four channels of a pixel by an alpha value.
+**
+**	Two channels are multiplied at once, each in its own 16 bit lane,
+**	and divided by 255 with rounding.
+**
+**	@param c	32bit pixel
+**	@param a	alpha value 0 - 255
+*/
+static inline uint32_t MulAlpha(uint32_t c, uint32_t a)
+{
+    uint32_t rb;
+    uint32_t ag;
+
+    rb = (c & 0x00FF00FF) * a + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = ((c >> 8) & 0x00FF00FF) * a + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+
+    return rb | ag;
+}
+
+/**
+**	Blend a row of a pixmap over the composed row.
+**
+**	The pixmap is straight alpha, the composed row premultiplied alpha.
+**	Transparent pixels are skipped, opaque pixels copied.
+**
+**	@param dst	premultiplied ARGB row
+**	@param src	ARGB row of pixmap
+**	@param n	pixels in row
+**	@param alpha	alpha of pixmap
+*/
+static void BlendRow(uint32_t * dst, const uint32_t * src, int n, int alpha)
+{
+    int x;
+
+    if (alpha == ALPHA_OPAQUE) {
+	for (x = 0; x < n; ++x) {
+	    uint32_t s;
+	    uint32_t a;
+
+	    s = src[x];
+	    a = s >> 24;
+	    if (a == ALPHA_OPAQUE) {
+		dst[x] = s;
+	    } else if (a) {
+		dst[x] = MulAlpha(s | 0xFF000000, a) + MulAlpha(dst[x], 255 - a);
+	    }
+	}
+	return;
+    }
+
+    for (x = 0; x < n; ++x) {
+	uint32_t s;
+	uint32_t a;
+
+	s = src[x];
+	a = (s >> 24) * alpha + 128;
+	a = (a + (a >> 8)) >> 8;
+	if (a) {
+	    dst[x] = MulAlpha(s | 0xFF000000, a) + MulAlpha(dst[x], 255 - a);
+	}
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Pixmap
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Create a pixmap of the CPU OSD compositor.
+**
+**	@param layer	layer of pixmap, negative hidden
+**	@param viewPort	area of pixmap on the osd
+**	@param drawPort	area of pixmap data, relative to view port
+*/
+cSoftPixmap::cSoftPixmap(int layer, const cRect & viewPort,
+    const cRect & drawPort)
+:  cPixmapMemory(layer, viewPort, drawPort)
+{
+    shown = false;
+}
+
+/**
+**	Get the dirty view port and mark the pixmap clean.
+**
+**	@returns dirty area in osd coordinates.
+*/
+cRect cSoftPixmap::TakeDirty(void)
+{
+    cRect dirty = DirtyViewPort();
+
+    SetClean();
+    return dirty;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Compositor
+//////////////////////////////////////////////////////////////////////////////
+
+cSoftCompositor *cSoftCompositor::instance;	///< shared compositor
+
+/**
+**	Create a compositor worker.
+**
+**	@param compositor	compositor of the worker
+**	@param band		band index composed by the worker
+*/
+cSoftCompositorWorker::cSoftCompositorWorker(cSoftCompositor * compositor,
+    int band)
+:  cThread("softhddev osd compositor")
+{
+    this->compositor = compositor;
+    this->band = band;
+}
+
+/**
+**	Compositor worker thread.
+*/
+void cSoftCompositorWorker::Action(void)
+{
+    compositor->Work(band);
+}
+
+/**
+**	Create the compositor and start the workers.
+**
+**	One thread per cpu core is used, up to SOFT_OSD_THREADS with the
+**	caller.  Single core boxes compose without workers.
+*/
+cSoftCompositor::cSoftCompositor(void)
+{
+    long cpus;
+    int i;
+
+    job = 0;
+    pending = 0;
+    stop = false;
+    layers = NULL;
+    numLayers = 0;
+    numBands = 0;
+    dst = NULL;
+    pitch = 0;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+	cpus = 1;
+    }
+    numWorkers = cpus < SOFT_OSD_THREADS ? cpus - 1 : SOFT_OSD_THREADS - 1;
+    for (i = 0; i < numWorkers; ++i) {
+	workers[i] = new cSoftCompositorWorker(this, i + 1);
+	workers[i]->Start();
+    }
+    dsyslog("[softhddev]%s: %d compositor threads\n", __FUNCTION__,
+	numWorkers + 1);
+}
+
+/**
+**	Stop the workers and destroy the compositor.
+*/
+cSoftCompositor::~cSoftCompositor()
+{
+    int i;
+
+    mutex.Lock();
+    stop = true;
+    start.Broadcast();
+    mutex.Unlock();
+
+    for (i = 0; i < numWorkers; ++i) {
+	// the worker loop ends by itself, wait for it
+	while (workers[i]->Active()) {
+	    cCondWait::SleepMs(1);
+	}
+	delete workers[i];
+    }
+}
+
+/**
+**	Worker loop, compose a band of each new job.
+**
+**	@param band	band index of the worker
+*/
+void cSoftCompositor::Work(int band)
+{
+    unsigned seen;
+
+    seen = 0;
+    mutex.Lock();
+    for (;;) {
+	while (!stop && job == seen) {
+	    start.Wait(mutex);
+	}
+	if (stop) {
+	    break;
+	}
+	seen = job;
+	mutex.Unlock();
+
+	ComposeBand(band);
+
+	mutex.Lock();
+	if (!--pending) {
+	    done.Broadcast();
+	}
+    }
+    mutex.Unlock();
+}
+
+/**
+**	Compose one horizontal band of the current job.
+**
+**	@param band	band index, bands beyond the job are empty
+*/
+void cSoftCompositor::ComposeBand(int band)
+{
+    int y1;
+    int y2;
+    int y;
+    int i;
+
+    if (band >= numBands) {
+	return;
+    }
+    y1 = area.Y() + area.Height() * band / numBands;
+    y2 = area.Y() + area.Height() * (band + 1) / numBands;
+
+    for (y = y1; y < y2; ++y) {
+	uint32_t *row;
+
+	row = (uint32_t *) (dst + (origin.Y() + y) * pitch) + origin.X() +
+	    area.X();
+	memset(row, 0, area.Width() * sizeof(*row));
+
+	for (i = 0; i < numLayers; ++i) {
+	    cSoftPixmap *pm = layers[i];
+	    const cRect & vp = pm->ViewPort();
+	    const cRect & dp = pm->DrawPort();
+	    const uint32_t *data;
+	    int x1;
+	    int x2;
+	    int sx;
+	    int sy;
+
+	    if (y < vp.Top() || y > vp.Bottom() || dp.IsEmpty()) {
+		continue;
+	    }
+	    x1 = vp.Left() > area.Left()? vp.Left() : area.Left();
+	    x2 = vp.Right() < area.Right()? vp.Right() : area.Right();
+	    data = (const uint32_t *)pm->Data();
+
+	    // draw port position relative to the view port
+	    sy = y - vp.Y() - dp.Y();
+	    if (pm->Tile()) {
+		sy %= dp.Height();
+		if (sy < 0) {
+		    sy += dp.Height();
+		}
+		while (x1 <= x2) {
+		    int n;
+
+		    sx = (x1 - vp.X() - dp.X()) % dp.Width();
+		    if (sx < 0) {
+			sx += dp.Width();
+		    }
+		    n = dp.Width() - sx;
+		    if (n > x2 - x1 + 1) {
+			n = x2 - x1 + 1;
+		    }
+		    BlendRow(row + x1 - area.X(), data + sy * dp.Width() + sx,
+			n, pm->Alpha());
+		    x1 += n;
+		}
+		continue;
+	    }
+	    if (sy < 0 || sy >= dp.Height()) {
+		continue;
+	    }
+	    if (x1 < vp.X() + dp.X()) {
+		x1 = vp.X() + dp.X();
+	    }
+	    if (x2 > vp.X() + dp.X() + dp.Width() - 1) {
+		x2 = vp.X() + dp.X() + dp.Width() - 1;
+	    }
+	    if (x1 > x2) {
+		continue;
+	    }
+	    sx = x1 - vp.X() - dp.X();
+	    BlendRow(row + x1 - area.X(), data + sy * dp.Width() + sx,
+		x2 - x1 + 1, pm->Alpha());
+	}
+    }
+}
+
+/**
+**	Compose pixmaps into a buffer.
+**
+**	The caller composes the first band, the workers the others.
+**	Returns after all bands are composed.
+**
+**	@param layers		visible pixmaps, bottom first
+**	@param numLayers	number of visible pixmaps
+**	@param area		area to compose, osd coordinates
+**	@param dst		32bit ARGB buffer
+**	@param pitch		pitch of buffer
+**	@param origin		osd position in buffer, area must be inside
+*/
+void cSoftCompositor::Compose(cSoftPixmap * const *layers, int numLayers,
+    const cRect & area, uint8_t * dst, int pitch, const cPoint & origin)
+{
+    int bands;
+
+    if (area.IsEmpty()) {
+	return;
+    }
+    // small areas aren't worth waking the workers
+    bands = area.Height() / SOFT_OSD_BAND_MIN;
+    if (bands > numWorkers + 1) {
+	bands = numWorkers + 1;
+    }
+    if (bands < 1) {
+	bands = 1;
+    }
+
+    mutex.Lock();
+    this->layers = layers;
+    this->numLayers = numLayers;
+    this->area = area;
+    this->numBands = bands;
+    this->dst = dst;
+    this->pitch = pitch;
+    this->origin = origin;
+    if (bands > 1) {
+	pending = numWorkers;
+	job++;
+	start.Broadcast();
+    }
+    mutex.Unlock();
+
+    ComposeBand(0);
+
+    if (bands > 1) {
+	mutex.Lock();
+	while (pending) {
+	    done.Wait(mutex);
+	}
+	mutex.Unlock();
+    }
+}
+
+/**
+**	Get the compositor shared by all OSDs, created on first use.
+*/
+cSoftCompositor *cSoftCompositor::Instance(void)
+{
+    if (!instance) {
+	instance = new cSoftCompositor();
+    }
+    return instance;
+}
+
+/**
+**	Stop the shared compositor.
+*/
+void cSoftCompositor::Shutdown(void)
+{
+    delete instance;
+    instance = NULL;
+}
@@ -0,0 +1,122 @@
+///
+///	@file softosd.h	@brief CPU OSD compositor header file
+///
+///	Copyright (c) 2021 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SOFTHDDEVICE_SOFTOSD_H
+#define __SOFTHDDEVICE_SOFTOSD_H
+
+#include <stdint.h>
+
+#include <vdr/osd.h>
+#include <vdr/thread.h>
+
+#define SOFT_OSD_THREADS 4		///< max compositor threads, incl. caller
+#define SOFT_OSD_BAND_MIN 32		///< min rows of a horizontal band
+
+//////////////////////////////////////////////////////////////////////////////
+//	Pixmap
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Memory pixmap of the CPU OSD compositor.
+**
+**	The drawing primitives are those of cPixmapMemory, the pixmap only
+**	hands its dirty view port to the compositor.
+*/
+class cSoftPixmap:public cPixmapMemory
+{
+  private:
+    bool shown;				///< visible at the last composition
+
+  public:
+    cSoftPixmap(int, const cRect &, const cRect & = cRect::Null);
+    cRect TakeDirty(void);		///< dirty view port, marks clean
+    bool Shown(void) const { return shown; }
+    void SetShown(bool on) { shown = on; }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//	Compositor
+//////////////////////////////////////////////////////////////////////////////
+
+class cSoftCompositor;
+
+/**
+**	Worker thread of the CPU OSD compositor.
+*/
+class cSoftCompositorWorker:public cThread
+{
+  private:
+    cSoftCompositor *compositor;	///< compositor of the worker
+    int band;				///< band index of the worker
+
+  protected:
+    virtual void Action(void);
+
+  public:
+    cSoftCompositorWorker(cSoftCompositor *, int);
+};
+
+/**
+**	Blends pixmaps into a 32bit ARGB buffer.
+**
+**	The area is split into horizontal bands, one per thread.  The
+**	caller composes the first band itself, a small pool of workers
+**	the others.  The result is premultiplied alpha.
+*/
+class cSoftCompositor
+{
+    friend class cSoftCompositorWorker;
+
+  private:
+    static cSoftCompositor *instance;	///< compositor shared by all OSDs
+
+    cMutex mutex;			///< protects job and counters
+    cCondVar start;			///< new job for workers
+    cCondVar done;			///< all bands of a job composed
+    cSoftCompositorWorker *workers[SOFT_OSD_THREADS - 1];
+    int numWorkers;			///< started workers
+    unsigned job;			///< running number of jobs
+    int pending;			///< workers busy with job
+    bool stop;				///< flag stop workers
+
+    // current job
+    cSoftPixmap *const *layers;		///< visible pixmaps, bottom first
+    int numLayers;			///< number of visible pixmaps
+    cRect area;				///< area to compose, osd coordinates
+    int numBands;			///< bands of area
+    uint8_t *dst;			///< 32bit ARGB buffer
+    int pitch;				///< pitch of buffer
+    cPoint origin;			///< osd position in buffer
+
+    void Work(int);			///< worker loop
+    void ComposeBand(int);		///< compose one band of the job
+
+  public:
+    cSoftCompositor(void);
+    ~cSoftCompositor();
+    void Compose(cSoftPixmap * const *, int, const cRect &, uint8_t *, int,
+	const cPoint &);
+    static cSoftCompositor *Instance(void);
+    static void Shutdown(void);
+};
+
+#endif //__SOFTHDDEVICE_SOFTOSD_H
@@ -54,6 +54,25 @@
 //----------------------------------------------------------------------------
 //	Typedefs
 //----------------------------------------------------------------------------
+
+    /// Video stream parameters parsed from SPS/VPS/PPS
+typedef struct _video_stream_info_
+{
+    int Width;				///< visible width
+    int Height;				///< visible height
+    int CodedWidth;			///< coded width (macroblock/CTB aligned)
+    int CodedHeight;			///< coded height
+    int BitDepth;			///< luma bit depth
+    int ChromaFormat;			///< 0 mono, 1 4:2:0, 2 4:2:2, 3 4:4:4
+    int Interlaced;			///< stream is coded in fields
+    int DpbSize;			///< decoded picture buffer size
+    AVRational FrameRate;		///< frame rate from timing info, 0 unknown
+    int Profile;			///< profile idc
+    int Level;				///< level idc
+    int HaveSps;			///< flag SPS parsed
+    int HavePps;			///< flag PPS seen
+} VideoStreamInfo;
+
 #ifdef MMAL
     /// Video hardware decoder typedef
 typedef struct _Mmal_Render_ VideoRender;
@@ -70,6 +89,29 @@ struct drm_buf {
 #endif
 };
 
+    /// input parameters a filter graph is configured for
+struct filter_key {
+	int format;			///< input pixel format
+	int width;			///< input width
+	int height;			///< input height
+	int interlaced;			///< input interlaced
+	int sar_num;			///< input sample aspect ratio
+	int sar_den;
+	int tb_num;			///< input time base
+	int tb_den;
+	int hw_type;			///< hw device type of input frames
+	int hw_sw_format;		///< sw format of hw frames context
+	int hw_width;			///< width of hw frames context
+	int hw_height;			///< height of hw frames context
+};
+
+#define OSD_DIRTY_RECTS 8		///< max dirty rectangles per osd flip
+
+    /// osd area, x2 and y2 exclusive
+struct osd_rect {
+	int x1, y1, x2, y2;
+};
+
 struct plane {
 	uint32_t plane_id;
 	drmModePlane *plane;
@@ -106,9 +148,15 @@ struct _Drm_Render_
 	int CodecMode;			/// 0: find codec by id, 1: set _mmal, 2: no mpeg hw,
 							/// 3: set _v4l2m2m for H264
 	int NoHwDeint;			/// set if no hw deinterlacer
+	int StreamInterlaced;		///< from SPS: -1 unknown, 0 progressive, 1 fields
+	int SwBuffersPreset;		///< NV12 buffers made from SPS, unused yet
 
 	AVFilterGraph *filter_graph;
 	AVFilterContext *buffersrc_ctx, *buffersink_ctx;
+	struct filter_key filter_key;	///< parameters of filter_graph
+	AVRational filter_timebase;	///< time base of the filter input
+	unsigned Filter_Gen;		///< stream generation, stale frames dropped
+	int Filter_Warmup;		///< next frame is the first of a reused graph
 
 	int fd_drm;
 	drmModeModeInfo mode;
@@ -123,7 +171,15 @@ struct _Drm_Render_
 	} video;
 	struct drm_buf *act_buf;
 	struct drm_buf bufs[36];
-	struct drm_buf buf_osd;
+	struct drm_buf buf_osd[2];	///< osd front and back buffer
+	int osd_front;			///< buf_osd index scanned out
+	int osd_flip;			///< back buffer waits for a commit
+	int osd_locked;			///< back buffer drawn by the caller
+	struct osd_rect osd_damage[OSD_DIRTY_RECTS];	///< back drawn since flip
+	int osd_damage_count;
+	struct osd_rect osd_forward[OSD_DIRTY_RECTS];	///< of the last flip,
+	int osd_forward_count;		///< copied to the new back buffer
+	struct osd_rect osd_drawn;	///< bounding box of the osd content
 #ifdef USE_GLES
 	struct drm_buf *buf_osd_gl;
 #endif
@@ -137,6 +193,8 @@ struct _Drm_Render_
 	int buffers;
 	int enqueue_buffer;
 	int OsdShown;
+	int osd_width;			///< osd render size, the plane scales
+	int osd_height;			///< it to the mode
 
 #ifdef USE_GLES
 	struct gbm_device *gbm_device;
@@ -147,6 +205,7 @@ struct _Drm_Render_
 	struct gbm_bo *bo;
 	struct gbm_bo *old_bo;
 	struct gbm_bo *next_bo;
+	int osd_fence_fd;		///< end of rendering buf_osd_gl, -1 none
 	int GlInit;
 #endif
 };
@@ -181,6 +240,9 @@ extern enum AVPixelFormat Video_get_format(VideoRender *, AVCodecContext *,
 extern void VideoRenderFrame(VideoRender *, AVCodecContext *,
     AVFrame *);
 
+    /// Get number of frames the render can take now.
+extern int VideoFramesFree(VideoRender *);
+
     /// Set audio delay.
 extern void VideoSetAudioDelay(int);
 
@@ -197,6 +259,9 @@ extern void VideoSetClosing(VideoRender *);
     /// Set trick play speed.
 extern void VideoSetTrickSpeed(VideoRender *, int);
 
+    /// Prepare render for a new stream.
+extern void VideoSetStreamInfo(VideoRender *, const VideoStreamInfo *, int);
+
     /// Set video output position and size
 extern void VideoSetOutputPosition(VideoRender *, int, int, int, int);
 
@@ -212,12 +277,30 @@ extern uint8_t *VideoGrab(int *, int *, int *, int);
     /// Grab screen raw.
 extern uint8_t *VideoGrabService(int *, int *, int *);
 
+    /// Grab screen planar YUV 4:2:0.
+extern uint8_t *VideoGrabYuv(int *, int *, int *);
+
     /// Get decoder statistics.
 extern void VideoGetStats(VideoRender *, int *, int *, int *);
 
     /// Get screen size
 extern void VideoGetScreenSize(VideoRender *, int *, int *, double *);
 
+    /// Get osd size
+extern void VideoGetOsdSize(VideoRender *, int *, int *, double *);
+
+    /// Set osd render size
+extern void VideoSetOsdSize(int, int);
+
+    /// Show osd drawn since last flip
+extern void VideoOsdFlip(VideoRender *);
+
+    /// Lock osd back buffer for drawing
+extern uint8_t *VideoOsdLockBuffer(VideoRender *, int *);
+
+    /// Unlock osd back buffer, area drawn
+extern void VideoOsdUnlockBuffer(VideoRender *, int, int, int, int);
+
     /// Get video clock.
 extern int64_t VideoGetClock(const VideoRender *);
 
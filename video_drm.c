@@ -46,11 +46,15 @@
 #include <pthread.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <linux/dma-buf.h>
 //#include <sys/utsname.h>
 #include <drm_fourcc.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_drm.h>
 #include <libavutil/pixdesc.h>
 //#include <libavutil/time.h>
@@ -78,11 +82,53 @@ static pthread_mutex_t PauseMutex;
 static pthread_cond_t WaitCleanCondition;
 static pthread_mutex_t WaitCleanMutex;
 
+static pthread_cond_t FramesFreeCondition;	///< a render queue got room
+static pthread_mutex_t FramesFreeMutex;
+
 static pthread_t DecodeThread;		///< video decode thread
 
 static pthread_t DisplayThread;
 
 static pthread_t FilterThread;
+static volatile char FilterThreadStop;	///< flag stop filter thread
+static pthread_cond_t FilterWakeCondition = PTHREAD_COND_INITIALIZER;	///< work for filter thread
+static pthread_mutex_t FilterWakeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t OsdThread;		///< osd presenter thread
+static volatile char OsdThreadStop;	///< flag stop osd presenter thread
+static pthread_mutex_t OsdMutex;	///< osd buffers, dirty and fence
+static pthread_cond_t OsdCondition;	///< osd drawn or taken by a commit
+static pthread_mutex_t CommitMutex;	///< one atomic commit at a time
+static pthread_mutex_t GrabMutex = PTHREAD_MUTEX_INITIALIZER;	///< displayed frame
+
+#define OSD_MERGE_WAIT 25		///< ms osd waits for a video commit
+
+#ifdef USE_GLES
+static int OsdFences = -1;		///< EGL native fences, -1 unknown
+static int OsdInFence = -1;		///< osd plane has IN_FENCE_FD, -1 unknown
+static PFNEGLCREATESYNCKHRPROC CreateSync;
+static PFNEGLDESTROYSYNCKHRPROC DestroySync;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC DupNativeFenceFD;
+#endif
+
+#define FILTER_CACHE_MAX 4		///< max parked filter graphs
+
+    /// parked, configured filter graph
+typedef struct _filter_cache_
+{
+    AVFilterGraph *Graph;		///< filter graph, NULL slot unused
+    AVFilterContext *SrcCtx;		///< buffer source of graph
+    AVFilterContext *SinkCtx;		///< buffer sink of graph
+    struct filter_key Key;		///< input parameters of graph
+    int Bug;				///< output pts must be halved
+    unsigned Used;			///< last use, for LRU
+} FilterCache;
+
+static FilterCache FilterCacheRb[FILTER_CACHE_MAX];	///< parked graphs
+static unsigned FilterCacheClock;	///< LRU clock
+
+static int VideoOsdWidth;		///< osd render width, 0 screen width
+static int VideoOsdHeight;		///< osd render height, 0 screen height
 
 //----------------------------------------------------------------------------
 //	Helper functions
@@ -95,8 +141,14 @@ static void ReleaseFrame( __attribute__ ((unused)) void *opaque, uint8_t *data)
 	av_free(primedata);
 }
 
-static void ThreadExitHandler( __attribute__ ((unused)) void * arg)
+static void ThreadExitHandler(void * arg)
 {
+	VideoRender * render = (VideoRender *)arg;
+
+	avfilter_graph_free(&render->filter_graph);
+	for (int i = 0; i < FILTER_CACHE_MAX; i++) {
+		avfilter_graph_free(&FilterCacheRb[i].Graph);
+	}
 	FilterThread = 0;
 }
 
@@ -457,6 +509,10 @@ static void free_properties(struct plane *plane)
 	free(plane->props_info);
 }
 
+#ifdef USE_GLES
+static int OsdTestScaling(VideoRender * render);
+#endif
+
 static int FindDevice(VideoRender * render)
 {
 	drmModeRes *resources;
@@ -558,6 +614,23 @@ search_mode:
 	Info(_("FindDevice: Found Monitor Mode %dx%d@%d\n"),
 		render->mode.hdisplay, render->mode.vdisplay, render->mode.vrefresh);
 
+	// a smaller osd is scaled up by the osd plane
+	render->osd_width = render->mode.hdisplay;
+	render->osd_height = render->mode.vdisplay;
+#ifdef USE_GLES
+	if (VideoOsdWidth > 0 && VideoOsdHeight > 0) {
+		if (VideoOsdWidth <= render->mode.hdisplay &&
+			VideoOsdHeight <= render->mode.vdisplay) {
+			render->osd_width = VideoOsdWidth;
+			render->osd_height = VideoOsdHeight;
+		} else {
+			Error(_("FindDevice: OSD size %dx%d bigger than mode %dx%d, ignored\n"),
+				VideoOsdWidth, VideoOsdHeight,
+				render->mode.hdisplay, render->mode.vdisplay);
+		}
+	}
+#endif
+
 	// find first plane
 	if ((plane_res = drmModeGetPlaneResources(render->fd_drm)) == NULL)
 		fprintf(stderr, "FindDevice: cannot retrieve PlaneResources (%d): %m\n", errno);
@@ -670,15 +743,29 @@ search_mode:
 	drmModeFreeResources(resources);
 
 #ifdef USE_GLES
+	// not every osd plane scales, later commits would fail
+	if (render->osd_width != render->mode.hdisplay ||
+		render->osd_height != render->mode.vdisplay) {
+		if (OsdTestScaling(render)) {
+			Error(_("FindDevice: OSD plane can't scale %dx%d to %dx%d, OSD rendered at mode size\n"),
+				render->osd_width, render->osd_height,
+				render->mode.hdisplay, render->mode.vdisplay);
+			render->osd_width = render->mode.hdisplay;
+			render->osd_height = render->mode.vdisplay;
+		} else {
+			Info(_("FindDevice: OSD rendered at %dx%d\n"),
+				render->osd_width, render->osd_height);
+		}
+	}
+
 	render->gbm_device = gbm_create_device(render->fd_drm);
 	if (!render->gbm_device) {
 		fprintf(stderr, "failed to create gbm device!\n");
 		return -1;
 	}
 
-	int w, h;
-	double pixel_aspect;
-	GetScreenSize(&w, &h, &pixel_aspect);
+	int w = render->osd_width;
+	int h = render->osd_height;
 
 	render->gbm_surface = gbm_surface_create(render->gbm_device, w, h, DRM_FORMAT_ARGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
 	if (!render->gbm_surface) {
@@ -992,6 +1079,94 @@ static void DestroyFB(int fd_drm, struct drm_buf *buf)
 	buf->fd_prime = 0;
 }
 
+#ifdef USE_GLES
+///
+///	Test if the osd plane scales the osd up to the mode.
+///
+///	A test only commit of the mode with a video plane and a
+///	dumb buffer of the osd size on the osd plane above it.
+///
+///	@param render	video render
+///
+///	@retval 0	osd plane scales
+///	@retval -1	commit rejected
+///
+static int OsdTestScaling(VideoRender * render)
+{
+	struct drm_buf osd;
+	struct drm_buf video;
+	drmModeAtomicReqPtr ModeReq;
+	uint32_t modeID = 0;
+	int ret = -1;
+
+	memset(&osd, 0, sizeof(osd));
+	osd.pix_fmt = DRM_FORMAT_ARGB8888;
+	osd.width = render->osd_width;
+	osd.height = render->osd_height;
+	memset(&video, 0, sizeof(video));
+	video.pix_fmt = DRM_FORMAT_NV12;
+	video.width = 720;
+	video.height = 576;
+	if (SetupFB(render, &osd, NULL))
+		return -1;
+	if (SetupFB(render, &video, NULL)) {
+		DestroyFB(render->fd_drm, &osd);
+		return -1;
+	}
+
+	if (drmModeCreatePropertyBlob(render->fd_drm, &render->mode, sizeof(render->mode), &modeID) != 0)
+		fprintf(stderr, "OsdTestScaling: failed to create mode property blob.\n");
+	else if (!(ModeReq = drmModeAtomicAlloc()))
+		fprintf(stderr, "OsdTestScaling: cannot allocate atomic request (%d): %m\n", errno);
+	else {
+		SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id,
+			DRM_MODE_OBJECT_CRTC, "MODE_ID", modeID);
+		SetPropertyRequest(ModeReq, render->fd_drm, render->connector_id,
+			DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", render->crtc_id);
+		SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id,
+			DRM_MODE_OBJECT_CRTC, "ACTIVE", 1);
+		if (render->use_zpos) {
+			SetPlaneZpos(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->zpos_primary);
+			SetPlaneZpos(ModeReq, render->planes[OSD_PLANE]->plane_id, render->zpos_overlay);
+		}
+		SetPlane(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->crtc_id, video.fb_id,
+			 0, 0, render->mode.hdisplay, render->mode.vdisplay, 0, 0, video.width, video.height);
+		SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id, osd.fb_id,
+			 0, 0, render->mode.hdisplay, render->mode.vdisplay, 0, 0, osd.width, osd.height);
+
+		ret = drmModeAtomicCommit(render->fd_drm, ModeReq,
+			DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, NULL) ? -1 : 0;
+		drmModeAtomicFree(ModeReq);
+	}
+	if (modeID)
+		drmModeDestroyPropertyBlob(render->fd_drm, modeID);
+
+	DestroyFB(render->fd_drm, &video);
+	DestroyFB(render->fd_drm, &osd);
+	return ret;
+}
+#endif
+
+///
+///	Wakeup the decode and filter thread, a frame left a render queue.
+///
+static void VideoFrameTaken(void)
+{
+	pthread_mutex_lock(&FramesFreeMutex);
+	pthread_cond_broadcast(&FramesFreeCondition);
+	pthread_mutex_unlock(&FramesFreeMutex);
+}
+
+///
+///	Wakeup the filter thread, new frame, close or stop.
+///
+static void VideoFilterWakeup(void)
+{
+	pthread_mutex_lock(&FilterWakeMutex);
+	pthread_cond_signal(&FilterWakeCondition);
+	pthread_mutex_unlock(&FilterWakeMutex);
+}
+
 ///
 /// Clean DRM
 ///
@@ -1000,9 +1175,11 @@ static void CleanDisplayThread(VideoRender * render)
 	AVFrame *frame;
 	int i;
 
+	pthread_mutex_lock(&GrabMutex);
 	if (render->lastframe) {
 		av_frame_free(&render->lastframe);
 	}
+	pthread_mutex_unlock(&GrabMutex);
 
 dequeue:
 	if (atomic_read(&render->FramesFilled)) {
@@ -1011,15 +1188,19 @@ dequeue:
 
 		render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
 		atomic_dec(&render->FramesFilled);
+		VideoFrameTaken();
 
 		av_frame_free(&frame);
 		goto dequeue;
 	}
 
-	if (FilterThread)
+	if (FilterThread) {
 		render->Filter_Close = 1;
+		VideoFilterWakeup();
+	}
 
 	// Destroy FBs
+	pthread_mutex_lock(&GrabMutex);
 	if (render->buffers) {
 		for (i = 0; i < render->buffers; ++i) {
 			DestroyFB(render->fd_drm, &render->bufs[i]);
@@ -1027,6 +1208,8 @@ dequeue:
 		render->buffers = 0;
 		render->enqueue_buffer = 0;
 	}
+	pthread_mutex_unlock(&GrabMutex);
+	render->SwBuffersPreset = 0;
 
 	pthread_cond_signal(&WaitCleanCondition);
 
@@ -1036,6 +1219,433 @@ dequeue:
 #endif
 }
 
+#ifndef USE_GLES
+///
+///	Add an area to a dirty rectangle list.
+///
+///	If the list is full, the area is merged into the last rectangle.
+///
+static void OsdAddRect(struct osd_rect *rects, int *count, int x1, int y1,
+	int x2, int y2)
+{
+	struct osd_rect *r;
+
+	if (x1 >= x2 || y1 >= y2) {
+		return;
+	}
+	if (*count < OSD_DIRTY_RECTS) {
+		r = &rects[(*count)++];
+		r->x1 = x1;
+		r->y1 = y1;
+		r->x2 = x2;
+		r->y2 = y2;
+		return;
+	}
+	r = &rects[OSD_DIRTY_RECTS - 1];
+	r->x1 = x1 < r->x1 ? x1 : r->x1;
+	r->y1 = y1 < r->y1 ? y1 : r->y1;
+	r->x2 = x2 > r->x2 ? x2 : r->x2;
+	r->y2 = y2 > r->y2 ? y2 : r->y2;
+}
+
+///
+///	Get the osd back buffer for drawing.
+///
+///	Caller holds OsdMutex.  Waits until a flipped back buffer is
+///	committed and no caller draws into it, then brings it up to date
+///	with the areas of the last flip.
+///
+static struct drm_buf *OsdBackBuffer(VideoRender * render)
+{
+	struct drm_buf *front;
+	struct drm_buf *back;
+	int i;
+	int y;
+
+	while (render->osd_flip || render->osd_locked) {
+		pthread_cond_wait(&OsdCondition, &OsdMutex);
+	}
+
+	front = &render->buf_osd[render->osd_front];
+	back = &render->buf_osd[render->osd_front ^ 1];
+	for (i = 0; i < render->osd_forward_count; ++i) {
+		const struct osd_rect *r = &render->osd_forward[i];
+
+		for (y = r->y1; y < r->y2; ++y) {
+			memcpy(back->plane[0] + r->x1 * 4 + y * back->pitch[0],
+				front->plane[0] + r->x1 * 4 + y * front->pitch[0],
+				(size_t)(r->x2 - r->x1) * 4);
+		}
+	}
+	render->osd_forward_count = 0;
+
+	return back;
+}
+
+///
+///	Add a drawn area to the osd damage and content.
+///
+///	Caller holds OsdMutex.
+///
+static void OsdDrawn(VideoRender * render, int x, int y, int width,
+	int height)
+{
+	struct osd_rect *r;
+
+	OsdAddRect(render->osd_damage, &render->osd_damage_count, x, y,
+		x + width, y + height);
+
+	r = &render->osd_drawn;
+	if (r->x1 >= r->x2 || r->y1 >= r->y2) {
+		r->x1 = x;
+		r->y1 = y;
+		r->x2 = x + width;
+		r->y2 = y + height;
+	} else {
+		r->x1 = x < r->x1 ? x : r->x1;
+		r->y1 = y < r->y1 ? y : r->y1;
+		r->x2 = x + width > r->x2 ? x + width : r->x2;
+		r->y2 = y + height > r->y2 ? y + height : r->y2;
+	}
+	render->OsdShown = 1;
+}
+#endif
+
+///
+///	Osd waits for a commit.
+///
+///	Caller holds OsdMutex.
+///
+static int OsdPending(VideoRender * render)
+{
+#ifdef USE_GLES
+	return render->buf_osd_gl && render->buf_osd_gl->dirty;
+#else
+	return render->osd_flip;
+#endif
+}
+
+#ifdef USE_GLES
+///
+///	Osd plane has the IN_FENCE_FD property.
+///
+static int OsdHasInFence(VideoRender * render)
+{
+	if (OsdInFence < 0) {
+		struct plane *osd = render->planes[OSD_PLANE];
+		unsigned i;
+
+		OsdInFence = 0;
+		for (i = 0; i < osd->props->count_props; i++) {
+			if (!strcmp(osd->props_info[i]->name, "IN_FENCE_FD"))
+				OsdInFence = 1;
+		}
+	}
+	return OsdInFence;
+}
+
+///
+///	Osd is rendered, or the plane waits for its fence.
+///
+///	Caller holds OsdMutex.
+///
+static int OsdRendered(VideoRender * render)
+{
+	struct pollfd pfd = { render->osd_fence_fd, POLLIN, 0 };
+
+	if (!render->OsdShown || render->osd_fence_fd < 0 || OsdHasInFence(render))
+		return 1;
+	return poll(&pfd, 1, 0) > 0;
+}
+#endif
+
+///
+///	Add a pending osd to an atomic request.
+///
+///	Caller holds CommitMutex, the osd can't be taken by two commits.
+///	After the commit the caller must call OsdCommitted().
+///	Without IN_FENCE_FD an osd still rendered by the GPU stays pending,
+///	unless forced.
+///
+///	@param render	video render
+///	@param ModeReq	atomic request
+///	@param[out] fence_fd	fence the commit waits for, -1 none
+///	@param force	take a rendering osd
+///
+///	@returns 1 osd added, 0 no osd pending
+///
+static int OsdTakePlane(VideoRender * render, drmModeAtomicReqPtr ModeReq,
+	int *fence_fd, int force)
+{
+	struct drm_buf *buf;
+
+	*fence_fd = -1;
+	pthread_mutex_lock(&OsdMutex);
+	if (!OsdPending(render)) {
+		pthread_mutex_unlock(&OsdMutex);
+		return 0;
+	}
+#ifdef USE_GLES
+	// don't wait under CommitMutex, the osd goes with a later commit
+	if (!force && !OsdRendered(render)) {
+		pthread_mutex_unlock(&OsdMutex);
+		return 0;
+	}
+	buf = render->buf_osd_gl;
+
+	if (render->OsdShown) {
+		if (render->use_zpos) {
+			SetPlaneZpos(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->zpos_primary);
+			SetPlaneZpos(ModeReq, render->planes[OSD_PLANE]->plane_id, render->zpos_overlay);
+		}
+		SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id, buf->fb_id,
+			 0, 0, render->mode.hdisplay, render->mode.vdisplay,
+			 0, 0, buf->width, buf->height);
+	} else {
+		if (render->use_zpos) {
+			SetPlaneZpos(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->zpos_overlay);
+			SetPlaneZpos(ModeReq, render->planes[OSD_PLANE]->plane_id, render->zpos_primary);
+		}
+		SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	}
+	buf->dirty = 0;
+
+	*fence_fd = render->osd_fence_fd;
+	render->osd_fence_fd = -1;
+	pthread_cond_broadcast(&OsdCondition);
+	pthread_mutex_unlock(&OsdMutex);
+
+	// scanout waits for the GPU, without IN_FENCE_FD the osd presenter
+	if (*fence_fd >= 0 && render->OsdShown && OsdHasInFence(render)) {
+		SetPlanePropertyRequest(ModeReq, render->planes[OSD_PLANE]->plane_id,
+			"IN_FENCE_FD", *fence_fd);
+	}
+#else
+	(void)force;
+	// the flipped back buffer isn't drawn until OsdCommitted()
+	pthread_mutex_unlock(&OsdMutex);
+	buf = &render->buf_osd[render->osd_front ^ 1];
+
+	uint64_t value;
+	if (render->OsdShown) {
+		if (render->use_zpos) {
+			// TODO: We may drop GetPropertyValue and "hardcode" zpos like in the gles code
+			if (GetPropertyValue(render->fd_drm, render->planes[OSD_PLANE]->plane_id, DRM_MODE_OBJECT_PLANE, "zpos", &value))
+				fprintf(stderr, "Failed to get property 'zpos'\n");
+			if (render->zpos_overlay != value)
+				SetChangePlanes(ModeReq, 0);
+		}
+		SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id, buf->fb_id,
+			 0, 0, buf->width, buf->height,
+			 0, 0, buf->width, buf->height);
+	} else {
+		if (render->use_zpos) {
+			// TODO: We may drop GetPropertyValue and "hardcode" zpos like in the gles code
+			if (GetPropertyValue(render->fd_drm, render->planes[OSD_PLANE]->plane_id, DRM_MODE_OBJECT_PLANE, "zpos", &value))
+				fprintf(stderr, "Failed to get property 'zpos'\n");
+			if (render->zpos_overlay == value)
+				SetChangePlanes(ModeReq, 1);
+		}
+		SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	}
+#endif
+	return 1;
+}
+
+///
+///	Finish an osd taken by OsdTakePlane(), after the commit.
+///
+///	@param render	video render
+///	@param taken	return value of OsdTakePlane()
+///	@param fence_fd	fence of OsdTakePlane()
+///
+static void OsdCommitted(VideoRender * render, int taken, int fence_fd)
+{
+#ifdef USE_GLES
+	(void)render;
+	(void)taken;
+	if (fence_fd >= 0)
+		close(fence_fd);
+#else
+	(void)fence_fd;
+	if (!taken)
+		return;
+
+	// back buffer is scanned out, the old front gets its changes before
+	// the next draw
+	pthread_mutex_lock(&OsdMutex);
+	render->osd_front ^= 1;
+	memcpy(render->osd_forward, render->osd_damage, sizeof(render->osd_forward));
+	render->osd_forward_count = render->osd_damage_count;
+	render->osd_damage_count = 0;
+	render->osd_flip = 0;
+	pthread_cond_broadcast(&OsdCondition);
+	pthread_mutex_unlock(&OsdMutex);
+#endif
+}
+
+///
+///	Video commits are imminent, a pending osd goes with the next one.
+///
+static int OsdMergeWithVideo(VideoRender * render)
+{
+	return DisplayThread && !render->Closing && !render->VideoPaused
+		&& !render->TrickSpeed && render->StartCounter
+		&& atomic_read(&render->FramesFilled);
+}
+
+///
+///	Osd presenter thread.
+///
+///	Commits drawn osd buffers to the osd plane as soon as they are
+///	rendered, without waiting for the next video frame.  While video is
+///	running the osd is left to the video commit, unless it isn't taken
+///	within OSD_MERGE_WAIT ms.
+///
+static void *OsdHandlerThread(void *arg)
+{
+	VideoRender *render = (VideoRender *)arg;
+
+	pthread_mutex_lock(&OsdMutex);
+	while (!OsdThreadStop) {
+		drmModeAtomicReqPtr ModeReq;
+		int fence_fd;
+		int taken;
+		int force;
+
+		if (!OsdPending(render)) {
+			pthread_cond_wait(&OsdCondition, &OsdMutex);
+			continue;
+		}
+
+		if (OsdMergeWithVideo(render)) {
+			struct timespec abstime;
+
+			clock_gettime(CLOCK_REALTIME, &abstime);
+			abstime.tv_nsec += OSD_MERGE_WAIT * 1000 * 1000;
+			if (abstime.tv_nsec >= 1000 * 1000 * 1000) {
+				abstime.tv_sec++;
+				abstime.tv_nsec -= 1000 * 1000 * 1000;
+			}
+			if (pthread_cond_timedwait(&OsdCondition, &OsdMutex,
+				&abstime) != ETIMEDOUT)
+				continue;
+			if (!OsdPending(render))
+				continue;
+		}
+		force = 0;
+#ifdef USE_GLES
+		// wait for the GPU without locks, a stuck GPU doesn't hide the osd
+		if (!OsdRendered(render)) {
+			struct pollfd pfd = { dup(render->osd_fence_fd), POLLIN, 0 };
+
+			pthread_mutex_unlock(&OsdMutex);
+			force = !poll(&pfd, 1, 100);
+			close(pfd.fd);
+			pthread_mutex_lock(&OsdMutex);
+		}
+#endif
+		pthread_mutex_unlock(&OsdMutex);
+
+		if (!(ModeReq = drmModeAtomicAlloc())) {
+			fprintf(stderr, "OsdHandlerThread: cannot allocate atomic request (%d): %m\n", errno);
+			pthread_mutex_lock(&OsdMutex);
+			continue;
+		}
+		pthread_mutex_lock(&CommitMutex);
+		// osd plane only, no page flip event for the display thread
+		taken = OsdTakePlane(render, ModeReq, &fence_fd, force);
+		if (taken && drmModeAtomicCommit(render->fd_drm, ModeReq, 0, NULL) != 0)
+			fprintf(stderr, "OsdHandlerThread: cannot commit osd plane (%d): %m\n", errno);
+		OsdCommitted(render, taken, fence_fd);
+		pthread_mutex_unlock(&CommitMutex);
+		drmModeAtomicFree(ModeReq);
+
+		pthread_mutex_lock(&OsdMutex);
+	}
+	pthread_mutex_unlock(&OsdMutex);
+
+	return NULL;
+}
+
+#ifdef USE_GLES
+///
+///	Hand a swapped osd buffer to the osd presenter.
+///
+///	Called by the OpenGL thread after rendering.  With
+///	EGL_ANDROID_native_fence_sync the end of rendering is passed to the
+///	commit as fence, otherwise rendering is finished here.
+///
+static void VideoOsdSwap(VideoRender * render)
+{
+	struct drm_buf *buf;
+	EGLSyncKHR sync = EGL_NO_SYNC_KHR;
+	int fence_fd = -1;
+
+	if (OsdFences < 0) {
+		const char *ext = eglQueryString(render->eglDisplay, EGL_EXTENSIONS);
+
+		CreateSync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+		DestroySync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+		DupNativeFenceFD = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
+			eglGetProcAddress("eglDupNativeFenceFDANDROID");
+		OsdFences = ext && strstr(ext, "EGL_ANDROID_native_fence_sync")
+			&& CreateSync && DestroySync && DupNativeFenceFD;
+#ifdef GL_DEBUG
+		fprintf(stderr, "VideoOsdSwap: native fences %d\n", OsdFences);
+#endif
+	}
+
+	if (OsdFences)
+		EGL_CHECK(sync = CreateSync(render->eglDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL));
+	if (sync == EGL_NO_SYNC_KHR)
+		GL_CHECK(glFinish());
+
+	// flushes the fence command
+	EGL_CHECK(eglSwapBuffers(render->eglDisplay, render->eglSurface));
+	if (sync != EGL_NO_SYNC_KHR) {
+		EGL_CHECK(fence_fd = DupNativeFenceFD(render->eglDisplay, sync));
+		EGL_CHECK(DestroySync(render->eglDisplay, sync));
+		if (fence_fd == EGL_NO_NATIVE_FENCE_FD_ANDROID)
+			GL_CHECK(glFinish());
+	}
+
+	render->next_bo = gbm_surface_lock_front_buffer(render->gbm_surface);
+	assert(render->next_bo);
+
+	buf = drm_get_buf_from_bo(render, render->next_bo);
+	if (!buf) {
+		fprintf(stderr, "Failed to get GL buffer\n");
+		if (fence_fd >= 0)
+			close(fence_fd);
+		return;
+	}
+
+	pthread_mutex_lock(&OsdMutex);
+	// a not yet committed osd is replaced
+	if (render->osd_fence_fd >= 0)
+		close(render->osd_fence_fd);
+	render->osd_fence_fd = fence_fd;
+	render->buf_osd_gl = buf;
+	render->buf_osd_gl->dirty = 1;
+	pthread_cond_broadcast(&OsdCondition);
+	pthread_mutex_unlock(&OsdMutex);
+
+	// release old buffer for writing again
+	if (render->bo)
+		gbm_surface_release_buffer(render->gbm_surface, render->bo);
+
+	// rotate bos and create and keep bo as old_bo to make it free'able
+	render->old_bo = render->bo;
+	render->bo = render->next_bo;
+
+#ifdef GL_DEBUG
+	fprintf(stderr, "VideoOsdSwap: eglSwapBuffers eglDisplay %p eglSurface %p (%i x %i, %i) fence %d\n",
+		render->eglDisplay, render->eglSurface, buf->width, buf->height, buf->pitch[0], fence_fd);
+#endif
+}
+#endif
+
 ///
 ///	Draw a video frame.
 ///
@@ -1047,6 +1657,9 @@ static void Frame2Display(VideoRender * render)
 	int64_t audio_pts;
 	int64_t video_pts;
 	int i;
+	int osd_taken;
+	int fence_fd;
+	int cancel_state;
 
 	if (render->Closing) {
 closing:
@@ -1062,15 +1675,7 @@ dequeue:
 	while (!atomic_read(&render->FramesFilled)) {
 		if (render->Closing)
 			goto closing;
-		// We had draw activity on the osd buffer
-#ifdef USE_GLES
-		if (render->buf_osd_gl && render->buf_osd_gl->dirty) {
-#else
-		if (render->buf_osd.dirty) {
-#endif
-			buf = &render->buf_black;
-			goto page_flip;
-		}
+		// osd draw activity is committed by the osd presenter
 		usleep(10000);
 	}
 
@@ -1133,6 +1738,7 @@ audioclock:
 		av_frame_free(&frame);
 		render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
 		atomic_dec(&render->FramesFilled);
+		VideoFrameTaken();
 
 		if (!render->StartCounter)
 			render->StartCounter++;
@@ -1169,6 +1775,7 @@ audioclock:
 	buf->frame = frame;
 	render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
 	atomic_dec(&render->FramesFilled);
+	VideoFrameTaken();
 
 page_flip:
 	render->act_buf = buf;
@@ -1205,55 +1812,11 @@ page_flip:
 	SetPlaneCrtcId(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->crtc_id);
 	SetPlaneFbId(ModeReq, render->planes[VIDEO_PLANE]->plane_id, buf->fb_id);
 
-	// handle the osd plane
-#ifdef USE_GLES
-	// We had draw activity on the osd buffer
-	if (render->buf_osd_gl && render->buf_osd_gl->dirty) {
-		if (render->OsdShown) {
-			if (render->use_zpos) {
-				SetPlaneZpos(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->zpos_primary);
-				SetPlaneZpos(ModeReq, render->planes[OSD_PLANE]->plane_id, render->zpos_overlay);
-			}
-			SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id, render->buf_osd_gl->fb_id,
-				 0, 0, render->buf_osd_gl->width, render->buf_osd_gl->height,
-				 0, 0, render->buf_osd_gl->width, render->buf_osd_gl->height);
-		} else {
-			if (render->use_zpos) {
-				SetPlaneZpos(ModeReq, render->planes[VIDEO_PLANE]->plane_id, render->zpos_overlay);
-				SetPlaneZpos(ModeReq, render->planes[OSD_PLANE]->plane_id, render->zpos_primary);
-			}
-			SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-		}
-		render->buf_osd_gl->dirty = 0;
-	}
-#else
-	// We had draw activity on the osd buffer
-	if (render->buf_osd.dirty) {
-		uint64_t value;
-		if (render->OsdShown) {
-			if (render->use_zpos) {
-				// TODO: We may drop GetPropertyValue and "hardcode" zpos like in the gles code
-				if (GetPropertyValue(render->fd_drm, render->planes[OSD_PLANE]->plane_id, DRM_MODE_OBJECT_PLANE, "zpos", &value))
-					fprintf(stderr, "Failed to get property 'zpos'\n");
-				if (render->zpos_overlay != value)
-					SetChangePlanes(ModeReq, 0);
-			}
-			SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id, render->buf_osd.fb_id,
-				 0, 0, render->buf_osd.width, render->buf_osd.height,
-				 0, 0, render->buf_osd.width, render->buf_osd.height);
-		} else {
-			if (render->use_zpos) {
-				// TODO: We may drop GetPropertyValue and "hardcode" zpos like in the gles code
-				if (GetPropertyValue(render->fd_drm, render->planes[OSD_PLANE]->plane_id, DRM_MODE_OBJECT_PLANE, "zpos", &value))
-					fprintf(stderr, "Failed to get property 'zpos'\n");
-				if (render->zpos_overlay == value)
-					SetChangePlanes(ModeReq, 1);
-			}
-			SetPlane(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-		}
-		render->buf_osd.dirty = 0;
-	}
-#endif
+	// handle the osd plane, merge pending osd into the video commit
+	// (not canceled while the osd presenter may wait for the lock)
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+	pthread_mutex_lock(&CommitMutex);
+	osd_taken = OsdTakePlane(render, ModeReq, &fence_fd, 0);
 
 	if (drmModeAtomicCommit(render->fd_drm, ModeReq, flags, NULL) != 0) {
 		fprintf(stderr, "Frame2Display: cannot page flip to FB %i (%d): %m\n",
@@ -1262,6 +1825,9 @@ page_flip:
 		abort();
 	}
 	drmModeAtomicFree(ModeReq);
+	OsdCommitted(render, osd_taken, fence_fd);
+	pthread_mutex_unlock(&CommitMutex);
+	pthread_setcancelstate(cancel_state, NULL);
 }
 
 ///
@@ -1306,10 +1872,12 @@ static void *DisplayHandlerThread(void * arg)
 		last_tick = tick;
 #endif*/
 
+		pthread_mutex_lock(&GrabMutex);
 		if (render->lastframe) {
 			av_frame_free(&render->lastframe);
 		}
 		render->lastframe = render->act_buf->frame;
+		pthread_mutex_unlock(&GrabMutex);
 
 		if (render->Closing && render->buf_black.fb_id == render->act_buf->fb_id) {
 			CleanDisplayThread(render);
@@ -1329,39 +1897,31 @@ static void *DisplayHandlerThread(void * arg)
 void VideoOsdClear(VideoRender * render)
 {
 #ifdef USE_GLES
-	struct drm_buf *buf;
+	render->OsdShown = 0;
+	VideoOsdSwap(render);
+#else
+	struct drm_buf *back;
+	struct osd_rect *r;
+	int y;
 
-	EGL_CHECK(eglSwapBuffers(render->eglDisplay, render->eglSurface));
-	render->next_bo = gbm_surface_lock_front_buffer(render->gbm_surface);
-	assert(render->next_bo);
+	pthread_mutex_lock(&OsdMutex);
+	back = OsdBackBuffer(render);
 
-	buf = drm_get_buf_from_bo(render, render->next_bo);
-	if (!buf) {
-		fprintf(stderr, "Failed to get GL buffer\n");
-		return;
+	// only the drawn area needs clearing
+	r = &render->osd_drawn;
+	for (y = r->y1; y < r->y2; ++y) {
+		memset(back->plane[0] + r->x1 * 4 + y * back->pitch[0], 0,
+			(size_t)(r->x2 - r->x1) * 4);
 	}
-
-	render->buf_osd_gl = buf;
-	render->buf_osd_gl->dirty = 1;
-
-	// release old buffer for writing again
-	if (render->bo)
-		gbm_surface_release_buffer(render->gbm_surface, render->bo);
-
-	// rotate bos and create and keep bo as old_bo to make it free'able
-	render->old_bo = render->bo;
-	render->bo = render->next_bo;
-
-#ifdef GL_DEBUG
-	fprintf(stderr, "VideoOsdClear(GL): eglSwapBuffers eglDisplay %p eglSurface %p (%i x %i, %i)\n", render->eglDisplay, render->eglSurface, buf->width, buf->height, buf->pitch[0]);
-#endif
-#else
-	memset((void *)render->buf_osd.plane[0], 0,
-		(size_t)(render->buf_osd.pitch[0] * render->buf_osd.height));
-	render->buf_osd.dirty = 1;
-#endif
+	OsdAddRect(render->osd_damage, &render->osd_damage_count, r->x1,
+		r->y1, r->x2, r->y2);
+	memset(r, 0, sizeof(*r));
 
 	render->OsdShown = 0;
+	render->osd_flip = 1;
+	pthread_cond_broadcast(&OsdCondition);
+	pthread_mutex_unlock(&OsdMutex);
+#endif
 }
 
 ///
@@ -1383,55 +1943,125 @@ void VideoOsdDrawARGB(VideoRender * render, __attribute__ ((unused)) int xi,
 		__attribute__ ((unused)) const uint8_t * argb,
 		__attribute__ ((unused)) int x,  __attribute__ ((unused)) int y)
 #else
-void VideoOsdDrawARGB(VideoRender * render, __attribute__ ((unused)) int xi,
-		__attribute__ ((unused)) int yi, __attribute__ ((unused)) int width,
+void VideoOsdDrawARGB(VideoRender * render, int xi, int yi, int width,
 		int height, int pitch, const uint8_t * argb, int x, int y)
 #endif
 {
 #ifdef USE_GLES
-	struct drm_buf *buf;
-
-	EGL_CHECK(eglSwapBuffers(render->eglDisplay, render->eglSurface));
-	render->next_bo = gbm_surface_lock_front_buffer(render->gbm_surface);
-	assert(render->next_bo);
+	render->OsdShown = 1;
+	VideoOsdSwap(render);
+#else
+	struct drm_buf *back;
+	int i;
 
-	buf = drm_get_buf_from_bo(render, render->next_bo);
-	if (!buf) {
-		fprintf(stderr, "Failed to get GL buffer\n");
+	if (width <= 0 || height <= 0)
 		return;
+
+	// shown with the next VideoOsdFlip()
+	pthread_mutex_lock(&OsdMutex);
+	back = OsdBackBuffer(render);
+	for (i = 0; i < height; ++i) {
+		memcpy(back->plane[0] + x * 4 + (i + y) * back->pitch[0],
+			argb + xi * 4 + (i + yi) * pitch, (size_t)width * 4);
 	}
+	OsdDrawn(render, x, y, width, height);
+	pthread_mutex_unlock(&OsdMutex);
+#endif
+}
 
-	render->buf_osd_gl = buf;
-	render->buf_osd_gl->dirty = 1;
+///
+///	Show the OSD drawn since the last flip.
+///
+///	The back buffer is swapped with the scanned out buffer by the next
+///	commit.  The OpenGL OSD is shown by VideoOsdDrawARGB() already.
+///
+void VideoOsdFlip(VideoRender * render)
+{
+#ifdef USE_GLES
+	(void)render;
+#else
+	pthread_mutex_lock(&OsdMutex);
+	if (render->osd_damage_count) {
+		render->osd_flip = 1;
+		pthread_cond_broadcast(&OsdCondition);
+	}
+	pthread_mutex_unlock(&OsdMutex);
+#endif
+}
 
-	// release old buffer for writing again
-	if (render->bo)
-		gbm_surface_release_buffer(render->gbm_surface, render->bo);
+///
+///	Lock the OSD back buffer for drawing.
+///
+///	The caller draws into the buffer without holding OsdMutex, other
+///	osd drawing waits until VideoOsdUnlockBuffer().  The OpenGL OSD
+///	has no buffer to draw into.
+///
+///	@param[out] pitch	pitch of the buffer
+///
+///	@returns 32bit ARGB buffer of osd size, NULL not available.
+///
+uint8_t *VideoOsdLockBuffer(VideoRender * render, int *pitch)
+{
+#ifdef USE_GLES
+	(void)render;
+	(void)pitch;
 
-	// rotate bos and create and keep bo as old_bo to make it free'able
-	render->old_bo = render->bo;
-	render->bo = render->next_bo;
+	return NULL;
+#else
+	struct drm_buf *back;
 
-#ifdef GL_DEBUG
-	fprintf(stderr, "VideoOsdDrawARGB(GL): eglSwapBuffers eglDisplay %p eglSurface %p (%i x %i, %i)\n", render->eglDisplay, render->eglSurface, buf->width, buf->height, buf->pitch[0]);
+	pthread_mutex_lock(&OsdMutex);
+	back = OsdBackBuffer(render);
+	render->osd_locked = 1;
+	pthread_mutex_unlock(&OsdMutex);
+
+	*pitch = back->pitch[0];
+	return back->plane[0];
 #endif
-#else
-	int i;
+}
 
-	for (i = 0; i < height; ++i) {
-		memcpy(render->buf_osd.plane[0] + x * 4 + (i + y) * render->buf_osd.pitch[0],
-			argb + i * pitch, (size_t)pitch);
+///
+///	Unlock the OSD back buffer.
+///
+///	The drawn area is shown with the next VideoOsdFlip().
+///
+///	@param x	x-coordinate on screen of drawn area
+///	@param y	y-coordinate on screen of drawn area
+///	@param width	width of drawn area, 0 nothing drawn
+///	@param height	height of drawn area
+///
+void VideoOsdUnlockBuffer(VideoRender * render, int x, int y, int width,
+	int height)
+{
+#ifdef USE_GLES
+	(void)render;
+	(void)x;
+	(void)y;
+	(void)width;
+	(void)height;
+#else
+	pthread_mutex_lock(&OsdMutex);
+	if (width > 0 && height > 0) {
+		OsdDrawn(render, x, y, width, height);
 	}
-	render->buf_osd.dirty = 1;
+	render->osd_locked = 0;
+	pthread_cond_broadcast(&OsdCondition);
+	pthread_mutex_unlock(&OsdMutex);
 #endif
-
-	render->OsdShown = 1;
 }
 
 //----------------------------------------------------------------------------
 //	Thread
 //----------------------------------------------------------------------------
 
+///
+///	Unlock the frames free mutex, cleanup of a canceled wait.
+///
+static void FramesFreeUnlock(__attribute__ ((unused)) void *arg)
+{
+	pthread_mutex_unlock(&FramesFreeMutex);
+}
+
 ///
 ///	Video render thread.
 ///
@@ -1448,14 +2078,21 @@ static void *DecodeHandlerThread(void *arg)
 		pthread_testcancel();
 
 		// manage fill frame output ring buffer
-		if (atomic_read(&render->FramesDeintFilled) < VIDEO_SURFACES_MAX &&
-			atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX) {
+		if (VideoFramesFree(render)) {
 
 			if (VideoDecodeInput(render->Stream))
-				usleep(10000);
+				VideoWaitInput();
 
 		} else {
-			usleep(10000);
+			// wait until display or filter thread take a frame,
+			// each taken frame signals the condition
+			pthread_mutex_lock(&FramesFreeMutex);
+			pthread_cleanup_push(FramesFreeUnlock, NULL);
+			while (!VideoFramesFree(render)) {
+				pthread_cond_wait(&FramesFreeCondition,
+					&FramesFreeMutex);
+			}
+			pthread_cleanup_pop(1);
 		}
 	}
 	pthread_exit((void *)pthread_self());
@@ -1503,6 +2140,20 @@ void VideoThreadExit(void)
 		}
 		DisplayThread = 0;
 	}
+
+	if (FilterThread) {
+		pthread_t thread = FilterThread;
+
+#ifdef DEBUG
+		fprintf(stderr, "VideoThreadExit: stop filter thread\n");
+#endif
+		FilterThreadStop = 1;
+		VideoFilterWakeup();
+		if (pthread_join(thread, &retval)) {
+			Error(_("video: can't stop filter thread\n"));
+			fprintf(stderr, "VideoThreadExit: can't stop filter thread\n");
+		}
+	}
 }
 
 ///
@@ -1522,6 +2173,9 @@ void VideoThreadWakeup(VideoRender * render)
 		pthread_cond_init(&WaitCleanCondition,NULL);
 		pthread_mutex_init(&WaitCleanMutex, NULL);
 
+		pthread_cond_init(&FramesFreeCondition, NULL);
+		pthread_mutex_init(&FramesFreeMutex, NULL);
+
 		pthread_create(&DecodeThread, NULL, DecodeHandlerThread, render);
 		pthread_setname_np(DecodeThread, "softhddev video");
 	}
@@ -1556,6 +2210,10 @@ VideoRender *VideoNewRender(VideoStream * stream)
 	render->Closing = 0;
 	render->enqueue_buffer = 0;
 	render->VideoPaused = 0;
+	render->StreamInterlaced = -1;
+#ifdef USE_GLES
+	render->osd_fence_fd = -1;
+#endif
 
 	return render;
 }
@@ -1611,6 +2269,37 @@ enum AVPixelFormat Video_get_format(__attribute__ ((unused))VideoRender * render
 	return avcodec_default_get_format(video_ctx, fmt);
 }
 
+///
+///	Create the NV12 buffers for software decoded frames.
+///
+///	@param render	video render
+///	@param width	frame width
+///	@param height	frame height
+///
+static void SetupSwFB(VideoRender * render, int width, int height)
+{
+	struct drm_buf *buf;
+
+	for (int i = 0; i < VIDEO_SURFACES_MAX + 2; i++) {
+		buf = &render->bufs[i];
+		buf->width = (uint32_t)width;
+		buf->height = (uint32_t)height;
+		buf->pix_fmt = DRM_FORMAT_NV12;
+
+		if (SetupFB(render, buf, NULL))
+			fprintf(stderr, "SetupSwFB: SetupFB FB %i x %i failed\n",
+				buf->width, buf->height);
+		else {
+			render->buffers++;
+		}
+
+		if (drmPrimeHandleToFD(render->fd_drm, buf->handle[0],
+			DRM_CLOEXEC | DRM_RDWR, &buf->fd_prime))
+			fprintf(stderr, "SetupSwFB: Failed to retrieve the Prime FD (%d): %m\n",
+				errno);
+	}
+}
+
 void EnqueueFB(VideoRender * render, AVFrame *inframe)
 {
 	struct drm_buf *buf = 0;
@@ -1618,27 +2307,25 @@ void EnqueueFB(VideoRender * render, AVFrame *inframe)
 	AVFrame *frame;
 	int i;
 
-	if (!render->buffers) {
-		for (int i = 0; i < VIDEO_SURFACES_MAX + 2; i++) {
-			buf = &render->bufs[i];
-			buf->width = (uint32_t)inframe->width;
-			buf->height = (uint32_t)inframe->height;
-			buf->pix_fmt = DRM_FORMAT_NV12;
-
-			if (SetupFB(render, buf, NULL))
-				fprintf(stderr, "EnqueueFB: SetupFB FB %i x %i failed\n",
-					buf->width, buf->height);
-			else {
-				render->buffers++;
+	// buffers made from the SPS, nothing displayed yet
+	if (render->SwBuffersPreset) {
+		render->SwBuffersPreset = 0;
+		if (render->bufs[0].width != (uint32_t)inframe->width ||
+			render->bufs[0].height != (uint32_t)inframe->height) {
+			pthread_mutex_lock(&GrabMutex);
+			for (i = 0; i < render->buffers; ++i) {
+				DestroyFB(render->fd_drm, &render->bufs[i]);
 			}
-
-			if (drmPrimeHandleToFD(render->fd_drm, buf->handle[0],
-				DRM_CLOEXEC | DRM_RDWR, &buf->fd_prime))
-				fprintf(stderr, "EnqueueFB: Failed to retrieve the Prime FD (%d): %m\n",
-					errno);
+			render->buffers = 0;
+			render->enqueue_buffer = 0;
+			pthread_mutex_unlock(&GrabMutex);
 		}
 	}
 
+	if (!render->buffers) {
+		SetupSwFB(render, inframe->width, inframe->height);
+	}
+
 	buf = &render->bufs[render->enqueue_buffer];
 
 	for (i = 0; i < inframe->height; ++i) {
@@ -1675,60 +2362,212 @@ void EnqueueFB(VideoRender * render, AVFrame *inframe)
 	else render->enqueue_buffer++;
 }
 
+static int VideoFilterInit(VideoRender *, AVFrame *);
+
+/**
+**	Park the filter graph of the closed stream for reuse.
+**
+**	Frames still buffered in the graph belong to the old stream, they
+**	are dropped by their generation when they come out.  A graph can't
+**	be flushed without ending it, the first frame of the next stream
+**	is filtered with fields of the old one and dropped too, see
+**	Filter_Warmup.
+*/
+static void VideoFilterPark(VideoRender * render)
+{
+	FilterCache *slot;
+	AVFrame *frame;
+
+	if (!render->filter_graph) {
+		return;
+	}
+	render->Filter_Gen++;
+
+	frame = av_frame_alloc();
+	while (av_buffersink_get_frame(render->buffersink_ctx, frame) >= 0) {
+		av_frame_unref(frame);
+	}
+	av_frame_free(&frame);
+
+	// free slot or least recently used
+	slot = &FilterCacheRb[0];
+	for (int i = 0; i < FILTER_CACHE_MAX; i++) {
+		if (!FilterCacheRb[i].Graph) {
+			slot = &FilterCacheRb[i];
+			break;
+		}
+		if (FilterCacheRb[i].Used < slot->Used) {
+			slot = &FilterCacheRb[i];
+		}
+	}
+	avfilter_graph_free(&slot->Graph);
+
+	slot->Graph = render->filter_graph;
+	slot->SrcCtx = render->buffersrc_ctx;
+	slot->SinkCtx = render->buffersink_ctx;
+	slot->Key = render->filter_key;
+	slot->Bug = render->Filter_Bug;
+	slot->Used = ++FilterCacheClock;
+
+	render->filter_graph = NULL;
+	render->buffersrc_ctx = NULL;
+	render->buffersink_ctx = NULL;
+}
+
+/**
+**	Get a filter graph for the frame, parked or new.
+**
+**	@retval 0	filter graph ready
+**	@retval	-1	no filter graph for the frame
+*/
+static int VideoFilterSetup(VideoRender * render, AVFrame * frame)
+{
+	struct filter_key key;
+
+	memset(&key, 0, sizeof(key));
+	key.format = frame->format;
+	key.width = frame->width;
+	key.height = frame->height;
+	key.interlaced = frame->interlaced_frame;
+	key.sar_num = frame->sample_aspect_ratio.num;
+	key.sar_den = frame->sample_aspect_ratio.den;
+	key.tb_num = render->filter_timebase.num;
+	key.tb_den = render->filter_timebase.den;
+	key.hw_type = AV_HWDEVICE_TYPE_NONE;
+	// each stream has its own frames context, a graph fits its parameters
+	if (frame->hw_frames_ctx) {
+		AVHWFramesContext *hw_frames =
+			(AVHWFramesContext *)frame->hw_frames_ctx->data;
+
+		key.hw_type = hw_frames->device_ctx->type;
+		key.hw_sw_format = hw_frames->sw_format;
+		key.hw_width = hw_frames->width;
+		key.hw_height = hw_frames->height;
+	}
+
+	if (render->filter_graph) {
+		if (!memcmp(&key, &render->filter_key, sizeof(key))) {
+			return 0;
+		}
+		VideoFilterPark(render);
+	}
+
+	for (int i = 0; i < FILTER_CACHE_MAX; i++) {
+		FilterCache *slot = &FilterCacheRb[i];
+
+		// a configured graph keeps its source parameters
+		if (slot->Graph && !memcmp(&key, &slot->Key, sizeof(key))) {
+			if (frame->hw_frames_ctx) {
+				AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+
+				// drop the reference to the frames of the old stream
+				par->format = AV_PIX_FMT_NONE;
+				par->hw_frames_ctx = frame->hw_frames_ctx;
+				if (av_buffersrc_parameters_set(slot->SrcCtx, par) < 0)
+					fprintf(stderr, "VideoFilterSetup: Cannot av_buffersrc_parameters_set\n");
+				av_free(par);
+			}
+			render->filter_graph = slot->Graph;
+			render->buffersrc_ctx = slot->SrcCtx;
+			render->buffersink_ctx = slot->SinkCtx;
+			render->filter_key = key;
+			render->Filter_Bug = slot->Bug;
+			render->Filter_Warmup = 1;
+			slot->Graph = NULL;
+#ifdef DEBUG
+			fprintf(stderr, "VideoFilterSetup: reuse filter graph %dx%d\n",
+				key.width, key.height);
+#endif
+			return 0;
+		}
+	}
+
+	if (VideoFilterInit(render, frame)) {
+		return -1;
+	}
+	render->filter_key = key;
+	return 0;
+}
+
 /**
 **	Filter thread.
+**
+**	Runs for the lifetime of the video module, graphs of closed streams
+**	are parked and reused by the next stream with the same input.
 */
 static void *FilterHandlerThread(void * arg)
 {
 	VideoRender * render = (VideoRender *)arg;
-	AVFrame *frame = 0;
-	int ret = 0;
+	AVFrame *frame;
+	int ret;
 
-	while (1) {
-		while (!atomic_read(&render->FramesDeintFilled) && !render->Filter_Close) {
-			usleep(10000);
-		}
-getinframe:
-		if (atomic_read(&render->FramesDeintFilled)) {
-			frame = render->FramesDeintRb[render->FramesDeintRead];
-			render->FramesDeintRead = (render->FramesDeintRead + 1) % VIDEO_SURFACES_MAX;
-			atomic_dec(&render->FramesDeintFilled);
+	pthread_cleanup_push(ThreadExitHandler, render);
+	while (!FilterThreadStop) {
+		if (!atomic_read(&render->FramesDeintFilled) && !render->Filter_Close) {
+			pthread_mutex_lock(&FilterWakeMutex);
+			while (!FilterThreadStop && !render->Filter_Close &&
+				!atomic_read(&render->FramesDeintFilled)) {
+				pthread_cond_wait(&FilterWakeCondition, &FilterWakeMutex);
+			}
+			pthread_mutex_unlock(&FilterWakeMutex);
+			continue;
 		}
+
 		if (render->Filter_Close) {
-			if (frame)
+			// stream closed, drop input and keep the graph
+			while (atomic_read(&render->FramesDeintFilled)) {
+				frame = render->FramesDeintRb[render->FramesDeintRead];
+				render->FramesDeintRead = (render->FramesDeintRead + 1) % VIDEO_SURFACES_MAX;
+				atomic_dec(&render->FramesDeintFilled);
+				VideoFrameTaken();
 				av_frame_free(&frame);
-			if (atomic_read(&render->FramesDeintFilled)) {
-				goto getinframe;
 			}
-			frame = NULL;
+			VideoFilterPark(render);
+			render->Filter_Close = 0;
+			continue;
+		}
+
+		frame = render->FramesDeintRb[render->FramesDeintRead];
+		render->FramesDeintRead = (render->FramesDeintRead + 1) % VIDEO_SURFACES_MAX;
+		atomic_dec(&render->FramesDeintFilled);
+		VideoFrameTaken();
+
+		if (VideoFilterSetup(render, frame)) {
+			av_frame_free(&frame);
+			continue;
 		}
+
+		// first frame of a reused graph, filtered with old fields
+		frame->opaque = (void *)(uintptr_t)(render->Filter_Warmup ?
+			render->Filter_Gen - 1 : render->Filter_Gen);
+		render->Filter_Warmup = 0;
 		if (av_buffersrc_add_frame_flags(render->buffersrc_ctx,
 			frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
 			fprintf(stderr, "FilterHandlerThread: can't add_frame.\n");
-		} else {
-			av_frame_free(&frame);
 		}
+		av_frame_free(&frame);
 
 		while (1) {
 			AVFrame *filt_frame = av_frame_alloc();
 			ret = av_buffersink_get_frame(render->buffersink_ctx, filt_frame);
 
-			if (ret == AVERROR(EAGAIN)) {
+			if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
 				av_frame_free(&filt_frame);
 				break;
 			}
-			if (ret == AVERROR_EOF) {
-				av_frame_free(&filt_frame);
-				goto closing;
-			}
 			if (ret < 0) {
 				fprintf(stderr, "FilterHandlerThread: can't get filtered frame: %s\n",
 					av_err2str(ret));
 				av_frame_free(&filt_frame);
 				break;
 			}
+			// left in the graph by the previous stream
+			if (filt_frame->opaque != (void *)(uintptr_t)render->Filter_Gen) {
+				av_frame_free(&filt_frame);
+				continue;
+			}
 fillframe:
-			if (render->Filter_Close) {
+			if (render->Filter_Close || FilterThreadStop) {
 				av_frame_free(&filt_frame);
 				break;
 			}
@@ -1743,19 +2582,30 @@ fillframe:
 					atomic_inc(&render->FramesFilled);
 				}
 			} else {
-				usleep(10000);
+				struct timespec abstime;
+
+				// wait until the display thread takes a frame
+				clock_gettime(CLOCK_REALTIME, &abstime);
+				abstime.tv_nsec += 20 * 1000 * 1000;
+				if (abstime.tv_nsec >= 1000 * 1000 * 1000) {
+					abstime.tv_sec++;
+					abstime.tv_nsec -= 1000 * 1000 * 1000;
+				}
+				pthread_mutex_lock(&FramesFreeMutex);
+				if (atomic_read(&render->FramesFilled) >= VIDEO_SURFACES_MAX ||
+					render->Closing) {
+					pthread_cond_timedwait(&FramesFreeCondition,
+						&FramesFreeMutex, &abstime);
+				}
+				pthread_mutex_unlock(&FramesFreeMutex);
 				goto fillframe;
 			}
 		}
 	}
 
-closing:
-	avfilter_graph_free(&render->filter_graph);
-	render->Filter_Close = 0;
 #ifdef DEBUG
 	fprintf(stderr, "FilterHandlerThread: Thread Exit.\n");
 #endif
-	pthread_cleanup_push(ThreadExitHandler, render);
 	pthread_cleanup_pop(1);
 	pthread_exit((void *)pthread_self());
 }
@@ -1766,8 +2616,7 @@ closing:
 **	@retval 0	filter initialised
 **	@retval	-1	filter initialise failed
 */
-int VideoFilterInit(VideoRender * render, const AVCodecContext * video_ctx,
-		AVFrame * frame)
+static int VideoFilterInit(VideoRender * render, AVFrame * frame)
 {
 	char args[512];
 	const char *filter_descr = NULL;
@@ -1798,9 +2647,9 @@ int VideoFilterInit(VideoRender * render, const AVCodecContext * video_ctx,
 
 	snprintf(args, sizeof(args),
 		"video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-		video_ctx->width, video_ctx->height, frame->format,
-		video_ctx->time_base.num, video_ctx->time_base.den,
-		video_ctx->sample_aspect_ratio.num, video_ctx->sample_aspect_ratio.den);
+		frame->width, frame->height, frame->format,
+		render->filter_timebase.num, render->filter_timebase.den,
+		frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den);
 
 	if (avfilter_graph_create_filter(&render->buffersrc_ctx, buffersrc, "src",
 		args, NULL, render->filter_graph) < 0)
@@ -1869,6 +2718,19 @@ fail:
 	return -1;
 }
 
+///
+///	Get number of frames the render can take now.
+///
+///	@param render	video render
+///
+int VideoFramesFree(VideoRender * render)
+{
+	int deint = VIDEO_SURFACES_MAX - atomic_read(&render->FramesDeintFilled);
+	int frames = VIDEO_SURFACES_MAX - atomic_read(&render->FramesFilled);
+
+	return deint < frames ? deint : frames;
+}
+
 ///
 ///	Display a ffmpeg frame
 ///
@@ -1892,22 +2754,22 @@ void VideoRenderFrame(VideoRender * render,
 		return;
 	}
 
+	// a progressive SPS overrides wrong interlace flags of the frames
 	if (frame->format == AV_PIX_FMT_YUV420P || (frame->interlaced_frame &&
-		frame->format == AV_PIX_FMT_DRM_PRIME && !render->NoHwDeint)) {
+		render->StreamInterlaced && frame->format == AV_PIX_FMT_DRM_PRIME &&
+		!render->NoHwDeint)) {
 
+		render->filter_timebase = video_ctx->time_base;
 		if (!FilterThread) {
-			if (VideoFilterInit(render, video_ctx, frame)) {
-				av_frame_free(&frame);
-				return;
-			} else {
-				pthread_create(&FilterThread, NULL, FilterHandlerThread, render);
-				pthread_setname_np(FilterThread, "softhddev deint");
-			}
+			FilterThreadStop = 0;
+			pthread_create(&FilterThread, NULL, FilterHandlerThread, render);
+			pthread_setname_np(FilterThread, "softhddev deint");
 		}
 
 		render->FramesDeintRb[render->FramesDeintWrite] = frame;
 		render->FramesDeintWrite = (render->FramesDeintWrite + 1) % VIDEO_SURFACES_MAX;
 		atomic_inc(&render->FramesDeintFilled);
+		VideoFilterWakeup();
 	} else {
 		if (frame->format == AV_PIX_FMT_DRM_PRIME) {
 			render->FramesRb[render->FramesWrite] = frame;
@@ -1999,6 +2861,30 @@ void VideoPause(VideoRender * render)
 	render->VideoPaused = 1;
 }
 
+///
+///	Set stream info parsed from the SPS before the decoder starts.
+///
+///	@param render	video render
+///	@param info	parsed stream info or NULL
+///	@param sw	frames come from the software decoder
+///
+void VideoSetStreamInfo(VideoRender * render, const VideoStreamInfo * info,
+	int sw)
+{
+	if (!info) {
+		render->StreamInterlaced = -1;
+		return;
+	}
+	render->StreamInterlaced = info->Interlaced;
+
+	// make the copy buffers now, not with the first frame
+	if (sw && !render->buffers && !render->filter_graph && info->Width > 0 &&
+		info->Height > 0) {
+		SetupSwFB(render, info->Width, info->Height);
+		render->SwBuffersPreset = 1;
+	}
+}
+
 ///
 ///	Set trick play speed.
 ///
@@ -2035,40 +2921,687 @@ void VideoPlay(VideoRender * render)
 	StartVideo(render);
 }
 
+//----------------------------------------------------------------------------
+//	Grab
+//----------------------------------------------------------------------------
+
+#define GRAB_TAPS 4			///< max box filter taps per direction
+
+    /// planes of the grabbed video frame, mapped read-only
+struct grab_frame {
+	const uint8_t *y;		///< luma plane
+	const uint8_t *u;		///< chroma plane, NV12 interleaved
+	const uint8_t *v;		///< chroma plane, NULL for NV12
+	int pitch_y;
+	int pitch_u;
+	int pitch_v;
+	int width;
+	int height;
+	uint8_t *map[AV_DRM_MAX_PLANES];	///< mapped dma-buf objects
+	size_t map_size[AV_DRM_MAX_PLANES];
+	int map_fd[AV_DRM_MAX_PLANES];	///< own dup of the object fds
+	int nb_maps;
+};
+
+///
+///	Unmap the grabbed video frame.
+///
+static void GrabUnmap(struct grab_frame *g)
+{
+	struct dma_buf_sync sync;
+	int i;
+
+	for (i = 0; i < g->nb_maps; ++i) {
+		sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+		drmIoctl(g->map_fd[i], DMA_BUF_IOCTL_SYNC, &sync);
+		munmap(g->map[i], g->map_size[i]);
+		close(g->map_fd[i]);
+	}
+	g->nb_maps = 0;
+}
+
+///
+///	Map a dma-buf object of the grabbed video frame read-only.
+///
+///	The mapping and a dup of the fd hold their own references, the
+///	frame may be freed while it is converted.
+///
+static uint8_t *GrabMapObject(struct grab_frame *g, int fd, size_t size)
+{
+	struct dma_buf_sync sync;
+	uint8_t *map;
+
+	if ((fd = dup(fd)) < 0) {
+		fprintf(stderr, "GrabMapObject: cannot dup dma-buf fd (%d): %m\n",
+			errno);
+		return NULL;
+	}
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "GrabMapObject: cannot mmap dma-buf (%d): %m\n",
+			errno);
+		close(fd);
+		return NULL;
+	}
+	sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+	drmIoctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+	g->map[g->nb_maps] = map;
+	g->map_size[g->nb_maps] = size;
+	g->map_fd[g->nb_maps] = fd;
+	g->nb_maps++;
+
+	return map;
+}
+
+///
+///	Map the displayed video frame.
+///
+///	Software decoded frames are NV12 dumb buffers, they are mapped
+///	through their prime fd.  Decoder frames are mapped, if they are
+///	linear NV12 or YUV420.
+///
+///	@param render	video render
+///	@param[out] g	mapped planes
+///
+///	@returns 0 ok, -1 nothing to grab.
+///
+static int GrabMap(VideoRender * render, struct grab_frame *g)
+{
+	const AVDRMFrameDescriptor *desc;
+	const AVDRMLayerDescriptor *layer;
+	struct drm_buf *buf;
+	const uint8_t *planes[3];
+	int i;
+
+	memset(g, 0, sizeof(*g));
+
+	pthread_mutex_lock(&GrabMutex);
+	buf = render->act_buf;
+	if (!buf || buf == &render->buf_black || !buf->width || !buf->height) {
+		pthread_mutex_unlock(&GrabMutex);
+		return -1;
+	}
+	g->width = buf->width;
+	g->height = buf->height;
+
+	if (buf->plane[0]) {
+		uint8_t *map;
+
+		if (!(map = GrabMapObject(g, buf->fd_prime, buf->size))) {
+			pthread_mutex_unlock(&GrabMutex);
+			return -1;
+		}
+		g->y = map + buf->offset[0];
+		g->pitch_y = buf->pitch[0];
+		g->u = map + buf->offset[1];
+		g->pitch_u = buf->pitch[1];
+		pthread_mutex_unlock(&GrabMutex);
+		return 0;
+	}
+
+	if (!buf->frame) {
+		pthread_mutex_unlock(&GrabMutex);
+		return -1;
+	}
+	desc = (const AVDRMFrameDescriptor *)buf->frame->data[0];
+	layer = &desc->layers[0];
+	if (desc->nb_layers != 1 ||
+		((layer->format != DRM_FORMAT_NV12 || layer->nb_planes != 2) &&
+		(layer->format != DRM_FORMAT_YUV420 || layer->nb_planes != 3))) {
+		pthread_mutex_unlock(&GrabMutex);
+		Debug(3, "video: grab of %4.4s unsupported\n",
+			(const char *)&layer->format);
+		return -1;
+	}
+	if (desc->nb_objects < 1 || desc->nb_objects > AV_DRM_MAX_PLANES) {
+		pthread_mutex_unlock(&GrabMutex);
+		return -1;
+	}
+	for (i = 0; i < layer->nb_planes; ++i) {
+		if (layer->planes[i].object_index < 0 ||
+			layer->planes[i].object_index >= desc->nb_objects) {
+			pthread_mutex_unlock(&GrabMutex);
+			Debug(3, "video: grab plane %d of missing object %d\n",
+				i, layer->planes[i].object_index);
+			return -1;
+		}
+	}
+	for (i = 0; i < desc->nb_objects; ++i) {
+		// tiled frames can't be read linear
+		if (desc->objects[i].format_modifier != DRM_FORMAT_MOD_LINEAR ||
+			!GrabMapObject(g, desc->objects[i].fd, desc->objects[i].size)) {
+			GrabUnmap(g);
+			pthread_mutex_unlock(&GrabMutex);
+			return -1;
+		}
+	}
+
+	// the descriptor belongs to the frame, read it before unlocking
+	for (i = 0; i < layer->nb_planes; ++i) {
+		planes[i] = g->map[layer->planes[i].object_index] +
+			layer->planes[i].offset;
+	}
+	g->y = planes[0];
+	g->pitch_y = layer->planes[0].pitch;
+	g->u = planes[1];
+	g->pitch_u = layer->planes[1].pitch;
+	if (layer->format == DRM_FORMAT_YUV420) {
+		g->v = planes[2];
+		g->pitch_v = layer->planes[2].pitch;
+	}
+	pthread_mutex_unlock(&GrabMutex);
+	return 0;
+}
+
+///
+///	Scale and convert an area of the grabbed video frame to RGB.
+///
+///	Each output pixel is the box filtered average of its source area,
+///	large areas are sampled with GRAB_TAPS x GRAB_TAPS taps.  Luma and
+///	chroma are averaged and converted once per output pixel, no full
+///	resolution RGB image is made.
+///
+///	@param g	grabbed video frame
+///	@param sx	x-coordinate of source area
+///	@param sy	y-coordinate of source area
+///	@param sw	width of source area
+///	@param sh	height of source area
+///	@param[out] dst	dw * dh pixels
+///	@param dw	output width
+///	@param dh	output height
+///	@param bgra	flag output BGRA, else RGB
+///
+static void GrabConvert(const struct grab_frame *g, int sx, int sy, int sw,
+	int sh, uint8_t * dst, int dw, int dh, int bgra)
+{
+	int cr_v;
+	int cg_u;
+	int cg_v;
+	int cb_u;
+	int dx;
+	int dy;
+
+	// BT.709 for HD, BT.601 for SD, limited range
+	if (g->height > 576) {
+		cr_v = 459;
+		cg_u = 55;
+		cg_v = 136;
+		cb_u = 541;
+	} else {
+		cr_v = 409;
+		cg_u = 100;
+		cg_v = 208;
+		cb_u = 516;
+	}
+
+	for (dy = 0; dy < dh; ++dy) {
+		int y0;
+		int y1;
+		int ystep;
+
+		y0 = sy + dy * sh / dh;
+		y1 = sy + (dy + 1) * sh / dh;
+		if (y1 <= y0) {
+			y1 = y0 + 1;
+		}
+		ystep = (y1 - y0 + GRAB_TAPS - 1) / GRAB_TAPS;
+
+		for (dx = 0; dx < dw; ++dx) {
+			int x0;
+			int x1;
+			int xstep;
+			int sum_y;
+			int sum_u;
+			int sum_v;
+			int n;
+			int x;
+			int y;
+			int c;
+			int d;
+			int e;
+			int r;
+			int gr;
+			int b;
+
+			x0 = sx + dx * sw / dw;
+			x1 = sx + (dx + 1) * sw / dw;
+			if (x1 <= x0) {
+				x1 = x0 + 1;
+			}
+			xstep = (x1 - x0 + GRAB_TAPS - 1) / GRAB_TAPS;
+
+			sum_y = sum_u = sum_v = n = 0;
+			for (y = y0; y < y1; y += ystep) {
+				const uint8_t *ly = g->y + y * g->pitch_y;
+				const uint8_t *lu = g->u + (y >> 1) * g->pitch_u;
+
+				if (g->v) {
+					const uint8_t *lv = g->v + (y >> 1) * g->pitch_v;
+
+					for (x = x0; x < x1; x += xstep) {
+						sum_y += ly[x];
+						sum_u += lu[x >> 1];
+						sum_v += lv[x >> 1];
+						n++;
+					}
+				} else {
+					for (x = x0; x < x1; x += xstep) {
+						sum_y += ly[x];
+						sum_u += lu[x & ~1];
+						sum_v += lu[x | 1];
+						n++;
+					}
+				}
+			}
+
+			c = 298 * (sum_y / n - 16) + 128;
+			d = sum_u / n - 128;
+			e = sum_v / n - 128;
+			r = (c + cr_v * e) >> 8;
+			gr = (c - cg_u * d - cg_v * e) >> 8;
+			b = (c + cb_u * d) >> 8;
+			r = r < 0 ? 0 : r > 255 ? 255 : r;
+			gr = gr < 0 ? 0 : gr > 255 ? 255 : gr;
+			b = b < 0 ? 0 : b > 255 ? 255 : b;
+
+			if (bgra) {
+				*dst++ = b;
+				*dst++ = gr;
+				*dst++ = r;
+				*dst++ = 0xFF;
+			} else {
+				*dst++ = r;
+				*dst++ = gr;
+				*dst++ = b;
+			}
+		}
+	}
+}
+
+///
+///	Get the output size of a grab.
+///
+///	A size of 0 or less keeps the video size, or its aspect, if only
+///	one is given.
+///
+static void GrabSize(const struct grab_frame *g, int *width, int *height)
+{
+	int dw;
+	int dh;
+
+	dw = *width;
+	dh = *height;
+	if (dw <= 0 && dh <= 0) {
+		dw = g->width;
+		dh = g->height;
+	} else if (dw <= 0) {
+		dw = dh * g->width / g->height;
+	} else if (dh <= 0) {
+		dh = dw * g->height / g->width;
+	}
+	*width = dw < 1 ? 1 : dw;
+	*height = dh < 1 ? 1 : dh;
+}
+
+///
+///	Scale an area of one plane of the grabbed video frame.
+///
+///	Same box filter as GrabConvert, an unscaled plane is only copied.
+///	The samples are mapped through a table, which expands the video
+///	range.
+///
+///	@param src	plane
+///	@param pitch	pitch of plane
+///	@param step	distance of samples, 2 for interleaved chroma
+///	@param sw	width of source area
+///	@param sh	height of source area
+///	@param[out] dst	scaled plane
+///	@param dpitch	pitch of scaled plane
+///	@param dw	output width
+///	@param dh	output height
+///	@param lut	sample table
+///
+static void GrabScalePlane(const uint8_t * src, int pitch, int step, int sw,
+	int sh, uint8_t * dst, int dpitch, int dw, int dh, const uint8_t * lut)
+{
+	int dx;
+	int dy;
+
+	if (sw == dw && sh == dh) {
+		for (dy = 0; dy < dh; ++dy) {
+			const uint8_t *line = src + dy * pitch;
+
+			for (dx = 0; dx < dw; ++dx) {
+				dst[dx] = lut[line[dx * step]];
+			}
+			dst += dpitch;
+		}
+		return;
+	}
+
+	for (dy = 0; dy < dh; ++dy) {
+		int y0;
+		int y1;
+		int ystep;
+
+		y0 = dy * sh / dh;
+		y1 = (dy + 1) * sh / dh;
+		if (y1 <= y0) {
+			y1 = y0 + 1;
+		}
+		ystep = (y1 - y0 + GRAB_TAPS - 1) / GRAB_TAPS;
+
+		for (dx = 0; dx < dw; ++dx) {
+			int x0;
+			int x1;
+			int xstep;
+			int sum;
+			int n;
+			int x;
+			int y;
+
+			x0 = dx * sw / dw;
+			x1 = (dx + 1) * sw / dw;
+			if (x1 <= x0) {
+				x1 = x0 + 1;
+			}
+			xstep = (x1 - x0 + GRAB_TAPS - 1) / GRAB_TAPS;
+
+			sum = n = 0;
+			for (y = y0; y < y1; y += ystep) {
+				const uint8_t *line = src + y * pitch;
+
+				for (x = x0; x < x1; x += xstep) {
+					sum += line[x * step];
+					n++;
+				}
+			}
+			dst[dx] = lut[sum / n];
+		}
+		dst += dpitch;
+	}
+}
+
+///
+///	Convert full range BT.709 YUV 4:2:0 planes to BT.601.
+///
+///	JFIF expects BT.601, the luma takes the chroma difference of
+///	its chroma sample.
+///
+///	@param y	luma plane
+///	@param pitch	pitch of luma plane
+///	@param u	U plane
+///	@param v	V plane
+///	@param cpitch	pitch of U and V plane
+///	@param w	width of luma plane
+///	@param h	height of luma plane
+///
+static void GrabYuv709To601(uint8_t * y, int pitch, uint8_t * u, uint8_t * v,
+	int cpitch, int w, int h)
+{
+	int cx;
+	int cy;
+
+	for (cy = 0; cy < (h + 1) / 2; ++cy) {
+		for (cx = 0; cx < (w + 1) / 2; ++cx) {
+			int cb;
+			int cr;
+			int dy;
+			int c;
+			int i;
+			int j;
+
+			cb = u[cy * cpitch + cx] - 128;
+			cr = v[cy * cpitch + cx] - 128;
+			dy = (26 * cb + 50 * cr + 128) >> 8;
+			c = ((253 * cb - 28 * cr + 128) >> 8) + 128;
+			u[cy * cpitch + cx] = c < 0 ? 0 : c > 255 ? 255 : c;
+			c = ((252 * cr - 19 * cb + 128) >> 8) + 128;
+			v[cy * cpitch + cx] = c < 0 ? 0 : c > 255 ? 255 : c;
+
+			for (j = cy * 2; j < cy * 2 + 2 && j < h; ++j) {
+				for (i = cx * 2; i < cx * 2 + 2 && i < w; ++i) {
+					c = y[j * pitch + i] + dy;
+					y[j * pitch + i] = c < 0 ? 0 : c > 255 ? 255 : c;
+				}
+			}
+		}
+	}
+}
+
+///
+///	Pad a plane with its right and bottom edge.
+///
+///	@param plane	plane
+///	@param pitch	pitch and padded width of plane
+///	@param w	width of plane
+///	@param h	height of plane
+///	@param ph	padded height of plane
+///
+static void GrabPadPlane(uint8_t * plane, int pitch, int w, int h, int ph)
+{
+	int y;
+
+	for (y = 0; y < h; ++y) {
+		memset(plane + y * pitch + w, plane[y * pitch + w - 1], pitch - w);
+	}
+	for (; y < ph; ++y) {
+		memcpy(plane + y * pitch, plane + (h - 1) * pitch, pitch);
+	}
+}
+
+///
+///	Grab full screen image as planar YUV 4:2:0.
+///
+///	For encoders which take the planes as they are, fe. the raw data
+///	input of libjpeg.  The frame is scaled like VideoGrab, the samples
+///	are expanded to full range and HD is converted from BT.709 to the
+///	BT.601 of JFIF.  The luma plane is padded with its
+///	edge to a multiple of 16 in both directions, the U and V planes
+///	follow with half the padded size.
+///
+///	@param size[out]	size of allocated image
+///	@param width[in,out]	width of image
+///	@param height[in,out]	height of image
+///
+///	@returns allocated YUV image, NULL nothing to grab.
+///
+uint8_t *VideoGrabYuv(int *size, int *width, int *height)
+{
+	VideoRender *render = (VideoRender *)GetVideoRender();
+	struct grab_frame g;
+	uint8_t luma[256];
+	uint8_t chroma[256];
+	uint8_t *image;
+	uint8_t *u;
+	uint8_t *v;
+	int dw;
+	int dh;
+	int pw;
+	int ph;
+	int i;
+
+	if (!render || GrabMap(render, &g)) {
+		Debug(3, "video: nothing to grab\n");
+		return NULL;
+	}
+
+	dw = *width;
+	dh = *height;
+	GrabSize(&g, &dw, &dh);
+	pw = (dw + 15) & ~15;
+	ph = (dh + 15) & ~15;
+
+	if (!(image = malloc(pw * ph * 3 / 2))) {
+		GrabUnmap(&g);
+		return NULL;
+	}
+	u = image + pw * ph;
+	v = u + pw * ph / 4;
+
+	// video range 16-235 (240 chroma) to full range
+	for (i = 0; i < 256; ++i) {
+		int c;
+
+		c = ((i - 16) * 255 + 109) / 219;
+		luma[i] = c < 0 ? 0 : c > 255 ? 255 : c;
+		c = ((i - 128) * 255 + (i < 128 ? -112 : 112)) / 224 + 128;
+		chroma[i] = c < 0 ? 0 : c > 255 ? 255 : c;
+	}
+
+	GrabScalePlane(g.y, g.pitch_y, 1, g.width, g.height, image, pw, dw, dh,
+		luma);
+	if (g.v) {
+		GrabScalePlane(g.u, g.pitch_u, 1, (g.width + 1) / 2,
+			(g.height + 1) / 2, u, pw / 2, (dw + 1) / 2, (dh + 1) / 2,
+			chroma);
+		GrabScalePlane(g.v, g.pitch_v, 1, (g.width + 1) / 2,
+			(g.height + 1) / 2, v, pw / 2, (dw + 1) / 2, (dh + 1) / 2,
+			chroma);
+	} else {
+		GrabScalePlane(g.u, g.pitch_u, 2, (g.width + 1) / 2,
+			(g.height + 1) / 2, u, pw / 2, (dw + 1) / 2, (dh + 1) / 2,
+			chroma);
+		GrabScalePlane(g.u + 1, g.pitch_u, 2, (g.width + 1) / 2,
+			(g.height + 1) / 2, v, pw / 2, (dw + 1) / 2, (dh + 1) / 2,
+			chroma);
+	}
+	// BT.709 for HD like GrabConvert
+	if (g.height > 576) {
+		GrabYuv709To601(image, pw, u, v, pw / 2, dw, dh);
+	}
+	GrabUnmap(&g);
+
+	GrabPadPlane(image, pw, dw, dh, ph);
+	GrabPadPlane(u, pw / 2, (dw + 1) / 2, (dh + 1) / 2, ph / 2);
+	GrabPadPlane(v, pw / 2, (dw + 1) / 2, (dh + 1) / 2, ph / 2);
+
+	*size = pw * ph * 3 / 2;
+	*width = dw;
+	*height = dh;
+	return image;
+}
+
 ///
 ///	Grab full screen image.
 ///
+///	The displayed video frame is scaled to the requested size, a size
+///	of 0 or less keeps the video size (or aspect, if only one is
+///	given).
+///
 ///	@param size[out]	size of allocated image
 ///	@param width[in,out]	width of image
 ///	@param height[in,out]	height of image
+///	@param write_header	flag write PNM header
+///
+///	@returns allocated RGB image, NULL nothing to grab.
 ///
 uint8_t *VideoGrab(int *size, int *width, int *height, int write_header)
 {
-    Debug(3, "video: no grab service\n");
+	VideoRender *render = (VideoRender *)GetVideoRender();
+	struct grab_frame g;
+	char header[64];
+	uint8_t *image;
+	int dw;
+	int dh;
+	int n;
+
+	if (!render || GrabMap(render, &g)) {
+		Debug(3, "video: nothing to grab\n");
+		return NULL;
+	}
 
-    (void)write_header;
-    (void)size;
-    (void)width;
-    (void)height;
-    return NULL;
+	dw = *width;
+	dh = *height;
+	GrabSize(&g, &dw, &dh);
+
+	n = 0;
+	if (write_header) {
+		n = snprintf(header, sizeof(header), "P6\n%d\n%d\n255\n", dw, dh);
+	}
+	if (!(image = malloc(n + dw * dh * 3))) {
+		GrabUnmap(&g);
+		return NULL;
+	}
+	memcpy(image, header, n);
+	GrabConvert(&g, 0, 0, g.width, g.height, image + n, dw, dh, 0);
+	GrabUnmap(&g);
+
+	*size = n + dw * dh * 3;
+	*width = dw;
+	*height = dh;
+	return image;
 }
 
 ///
 ///	Grab image service.
 ///
+///	A negative width is the analyse size of the v1.0 atmo grab
+///	service, the height then is the clipped overscan in 1/1000 of the
+///	video size.  The larger side of the image gets the analyse size.
+///
 ///	@param size[out]	size of allocated image
 ///	@param width[in,out]	width of image
 ///	@param height[in,out]	height of image
 ///
+///	@returns allocated BGRA image, NULL nothing to grab.
+///
 uint8_t *VideoGrabService(int *size, int *width, int *height)
 {
-    Debug(3, "video: no grab service\n");
-	Warning(_("softhddev: grab unsupported\n"));
+	VideoRender *render = (VideoRender *)GetVideoRender();
+	struct grab_frame g;
+	uint8_t *image;
+	int sx;
+	int sy;
+	int sw;
+	int sh;
+	int dw;
+	int dh;
+
+	if (!render || GrabMap(render, &g)) {
+		Debug(3, "video: nothing to grab\n");
+		return NULL;
+	}
+
+	sx = 0;
+	sy = 0;
+	sw = g.width;
+	sh = g.height;
+	dw = *width;
+	dh = *height;
+	if (dw < 0) {			// atmo grab service v1.0
+		int analyse = -dw;
+
+		sx = sw * dh / 1000;
+		sy = sh * dh / 1000;
+		sw -= 2 * sx;
+		sh -= 2 * sy;
+		if (sw >= sh) {
+			dw = analyse;
+			dh = analyse * sh / sw;
+		} else {
+			dh = analyse;
+			dw = analyse * sw / sh;
+		}
+	} else if (dw == 0 || dh <= 0) {
+		dw = sw;
+		dh = sh;
+	}
+	dw = dw < 1 ? 1 : dw;
+	dh = dh < 1 ? 1 : dh;
 
-    (void)size;
-    (void)width;
-    (void)height;
-    return NULL;
+	if (!(image = malloc(dw * dh * 4))) {
+		GrabUnmap(&g);
+		return NULL;
+	}
+	GrabConvert(&g, sx, sy, sw, sh, image, dw, dh, 1);
+	GrabUnmap(&g);
+
+	*size = dw * dh * 4;
+	*width = dw;
+	*height = dh;
+	return image;
 }
 
 ///
@@ -2107,6 +3640,36 @@ void VideoGetScreenSize(VideoRender * render, int *width, int *height,
 	*pixel_aspect = (double)16 / (double)9;
 }
 
+///
+///	Get osd size.
+///
+///	The osd is rendered at this size, the osd plane scales it to the
+///	screen.
+///
+///	@param[out] width	osd width
+///	@param[out] height	osd height
+///	@param[out] pixel_aspect	osd pixel aspect
+///
+void VideoGetOsdSize(VideoRender * render, int *width, int *height,
+		double *pixel_aspect)
+{
+	*width = render->osd_width;
+	*height = render->osd_height;
+	*pixel_aspect = (double)16 / (double)9;
+}
+
+///
+///	Set osd render size, before the video module is initialized.
+///
+///	@param width	osd width, 0 screen width
+///	@param height	osd height, 0 screen height
+///
+void VideoSetOsdSize(int width, int height)
+{
+	VideoOsdWidth = width;
+	VideoOsdHeight = height;
+}
+
 ///
 ///	Set audio delay.
 ///
@@ -2134,15 +3697,18 @@ void VideoInit(VideoRender * render)
 	render->bufs[0].height = render->bufs[1].height = 0;
 	render->bufs[0].pix_fmt = render->bufs[1].pix_fmt = DRM_FORMAT_NV12;
 
-	// osd FB
+	// osd FBs, front and back
 #ifndef USE_GLES
-	render->buf_osd.pix_fmt = DRM_FORMAT_ARGB8888;
-	render->buf_osd.width = render->mode.hdisplay;
-	render->buf_osd.height = render->mode.vdisplay;
-	if (SetupFB(render, &render->buf_osd, NULL)){
-		fprintf(stderr, "VideoOsdInit: SetupFB FB OSD failed\n");
-		Fatal(_("VideoOsdInit: SetupFB FB OSD failed!\n"));
+	for (i = 0; i < 2; ++i) {
+		render->buf_osd[i].pix_fmt = DRM_FORMAT_ARGB8888;
+		render->buf_osd[i].width = render->mode.hdisplay;
+		render->buf_osd[i].height = render->mode.vdisplay;
+		if (SetupFB(render, &render->buf_osd[i], NULL)){
+			fprintf(stderr, "VideoOsdInit: SetupFB FB OSD failed\n");
+			Fatal(_("VideoOsdInit: SetupFB FB OSD failed!\n"));
+		}
 	}
+	render->osd_front = 0;
 #endif
 
 	// black fb
@@ -2182,8 +3748,8 @@ void VideoInit(VideoRender * render)
 #ifndef USE_GLES
 	SetPlaneCrtcId(ModeReq, render->planes[OSD_PLANE]->plane_id, render->crtc_id);
 	SetPlaneCrtc(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, render->mode.hdisplay, render->mode.vdisplay);
-	SetPlaneSrc(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, render->buf_osd.width, render->buf_osd.height);
-	SetPlaneFbId(ModeReq,render->planes[OSD_PLANE]->plane_id, render->buf_osd.fb_id);
+	SetPlaneSrc(ModeReq, render->planes[OSD_PLANE]->plane_id, 0, 0, render->buf_osd[0].width, render->buf_osd[0].height);
+	SetPlaneFbId(ModeReq,render->planes[OSD_PLANE]->plane_id, render->buf_osd[0].fb_id);
 #else
 	// We don't have the buf_osd_gl yet, so we can't set anything. Set src and FbId later when osd was drawn,
 	// but initially move the OSD behind the VIDEO
@@ -2207,6 +3773,13 @@ void VideoInit(VideoRender * render)
 
 	render->OsdShown = 0;
 
+	pthread_mutex_init(&OsdMutex, NULL);
+	pthread_cond_init(&OsdCondition, NULL);
+	pthread_mutex_init(&CommitMutex, NULL);
+	OsdThreadStop = 0;
+	pthread_create(&OsdThread, NULL, OsdHandlerThread, render);
+	pthread_setname_np(OsdThread, "softhddev osd");
+
 	// init variables page flip
 //    if (render->ev.page_flip_handler != Drm_page_flip_event) {
 		memset(&render->ev, 0, sizeof(render->ev));
@@ -2222,6 +3795,21 @@ void VideoInit(VideoRender * render)
 void VideoExit(VideoRender * render)
 {
 	VideoThreadExit();
+	if (OsdThread) {
+		void *retval;
+
+		pthread_mutex_lock(&OsdMutex);
+		OsdThreadStop = 1;
+		pthread_cond_broadcast(&OsdCondition);
+		pthread_mutex_unlock(&OsdMutex);
+		if (pthread_join(OsdThread, &retval)) {
+			fprintf(stderr, "VideoExit: can't stop osd presenter thread\n");
+		}
+		OsdThread = 0;
+		pthread_cond_destroy(&OsdCondition);
+		pthread_mutex_destroy(&OsdMutex);
+		pthread_mutex_destroy(&CommitMutex);
+	}
 
 	if (render) {
 		// restore saved CRTC configuration
@@ -2240,13 +3828,16 @@ void VideoExit(VideoRender * render)
 
 		DestroyFB(render->fd_drm, &render->buf_black);
 #ifdef USE_GLES
+		if (render->osd_fence_fd >= 0)
+			close(render->osd_fence_fd);
 		if (render->next_bo)
 			gbm_bo_destroy(render->next_bo);
 
 		if (render->old_bo)
 			gbm_bo_destroy(render->old_bo);
 #else
-		DestroyFB(render->fd_drm, &render->buf_osd);
+		DestroyFB(render->fd_drm, &render->buf_osd[0]);
+		DestroyFB(render->fd_drm, &render->buf_osd[1]);
 #endif
 
 		close(render->fd_drm);
@@ -2258,6 +3849,13 @@ void VideoExit(VideoRender * render)
 ///
 void VideoSetOutputPosition(VideoRender *render, int x, int y, int width, int height)
 {
+	// osd coordinates to screen coordinates
+	if (render->osd_width && render->osd_height) {
+		x = x * render->mode.hdisplay / render->osd_width;
+		y = y * render->mode.vdisplay / render->osd_height;
+		width = width * render->mode.hdisplay / render->osd_width;
+		height = height * render->mode.vdisplay / render->osd_height;
+	}
 	render->video.x = x;
 	render->video.y = y;
 	render->video.width = width;
@@ -606,6 +606,32 @@ void VideoOsdClear(VideoRender * render)
 	}
 }
 
+///
+///	Show the OSD drawn since the last flip, drawn directly here.
+///
+void VideoOsdFlip(__attribute__ ((unused)) VideoRender * render)
+{
+}
+
+///
+///	Lock the OSD back buffer, osd is drawn directly here.
+///
+uint8_t *VideoOsdLockBuffer(__attribute__ ((unused)) VideoRender * render,
+		__attribute__ ((unused)) int *pitch)
+{
+	return NULL;
+}
+
+///
+///	Unlock the OSD back buffer.
+///
+void VideoOsdUnlockBuffer(__attribute__ ((unused)) VideoRender * render,
+		__attribute__ ((unused)) int x, __attribute__ ((unused)) int y,
+		__attribute__ ((unused)) int width,
+		__attribute__ ((unused)) int height)
+{
+}
+
 ///
 ///	Draw an OSD ARGB image.
 ///
@@ -711,7 +737,7 @@ static void *DisplayHandlerThread(void *arg)
 
 		if (render->buffers < 7) {
 			if (VideoDecodeInput(render->Stream))
-				usleep(10000);
+				VideoWaitInput();
 
 		} else {
 			usleep(10000);
@@ -817,6 +843,16 @@ enum AVPixelFormat Video_get_format(__attribute__ ((unused))VideoRender * render
 	return AV_PIX_FMT_NONE;
 }
 
+///
+///	Get number of frames the render can take now.
+///
+///	@param render	video render
+///
+int VideoFramesFree(VideoRender * render)
+{
+	return render->buffers < 7 ? 7 - render->buffers : 0;
+}
+
 ///
 ///	Display a ffmpeg frame
 ///
@@ -930,6 +966,15 @@ void VideoPause( __attribute__ ((unused)) VideoRender * render)
 #endif
 }
 
+///
+///	Set stream info parsed from the SPS, mmal configures itself.
+///
+void VideoSetStreamInfo(__attribute__ ((unused)) VideoRender * render,
+	__attribute__ ((unused)) const VideoStreamInfo * info,
+	__attribute__ ((unused)) int sw)
+{
+}
+
 ///
 ///	Set trick play speed.
 ///
@@ -997,6 +1042,23 @@ uint8_t *VideoGrabService(int *size, int *width, int *height)
     return NULL;
 }
 
+///
+///	Grab full screen image as planar YUV 4:2:0.
+///
+///	@param size[out]	size of allocated image
+///	@param width[in,out]	width of image
+///	@param height[in,out]	height of image
+///
+uint8_t *VideoGrabYuv(int *size, int *width, int *height)
+{
+    Debug(3, "video: no grab service\n");
+
+    (void)size;
+    (void)width;
+    (void)height;
+    return NULL;
+}
+
 ///
 ///	Get render statistics.
 ///
@@ -1029,6 +1091,23 @@ void VideoGetScreenSize(__attribute__ ((unused)) VideoRender * render,
 	*pixel_aspect = (double)16 / (double)9;
 }
 
+///
+///	Get osd size, same as screen size.
+///
+void VideoGetOsdSize(VideoRender * render, int *width, int *height,
+		double *pixel_aspect)
+{
+	VideoGetScreenSize(render, width, height, pixel_aspect);
+}
+
+///
+///	Set osd render size, not supported.
+///
+void VideoSetOsdSize(__attribute__ ((unused)) int width,
+		__attribute__ ((unused)) int height)
+{
+}
+
 //----------------------------------------------------------------------------
 //	Setup
 //----------------------------------------------------------------------------